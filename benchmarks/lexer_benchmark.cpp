@@ -0,0 +1,166 @@
+// lexer_benchmark measures the time needed to lex a whole file, with the
+// Lexer and with the char by char word matching it has replaced.
+//
+// Build with -DMEH_BUILD_BENCHMARKS=ON and run:
+//   ./lexer_benchmark [file] [lines]
+// Without a file, a Go file of 50000 lines is generated.
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <cstdio>
+
+#include "../lexer.h"
+
+// legacyLex splits the line in words as SyntaxHighlighter was doing and
+// compares them with the list of keywords it was using.
+static int legacyLex(const QString& text, const QStringList& keywords) {
+    int found = 0;
+    QString wordBuffer = "";
+    QString quoteBuffer = "";
+    QChar isInQuote = '0';
+    QChar pc = '0';
+
+    for (int i = 0; i < text.size(); i++) {
+        if (i > 0) { pc = text[i-1]; }
+        QChar c = text[i];
+
+        if ((c == '/' && pc == '/') || (c == ' ' && pc == '#')) {
+            found++;
+            break;
+        }
+
+        if (isInQuote != '0') {
+            if (c == isInQuote && pc != '\\') {
+                found++;
+                isInQuote = '0';
+                quoteBuffer.clear();
+                wordBuffer.clear();
+                continue;
+            }
+            quoteBuffer += c;
+        }
+
+        if (isInQuote == '0' && pc != '\\' && (c == '\"' || c == '\'' || c == '`')) {
+            isInQuote = c;
+            quoteBuffer.clear();
+            continue;
+        }
+
+        if (c.isSpace() || (c.isPunct() && c != '_') || i == text.size()-1) {
+            if (wordBuffer.size() > 1) {
+                for (int k = 0; k < keywords.size(); k++) {
+                    if (wordBuffer == keywords[k]) {
+                        found++;
+                    }
+                }
+            }
+            wordBuffer.clear();
+            continue;
+        }
+
+        wordBuffer.append(c);
+    }
+
+    return found;
+}
+
+static QStringList generate(int lines) {
+    const char* sample[] = {
+        "package main",
+        "",
+        "import (",
+        "\t\"fmt\"",
+        "\t\"strings\"",
+        ")",
+        "",
+        "// Server is serving the requests. TODO(remy): limits",
+        "type Server struct {",
+        "\tname    string",
+        "\tclients map[string]*Client",
+        "}",
+        "",
+        "func (s *Server) Handle(req *Request) (int, error) {",
+        "\tfor i, client := range s.clients {",
+        "\t\tif client == nil || strings.HasPrefix(i, \"tmp\") {",
+        "\t\t\tcontinue",
+        "\t\t}",
+        "\t\tfmt.Printf(\"%s: %d\\n\", client.Name(), len(req.Body))",
+        "\t}",
+        "\treturn 0, nil",
+        "}",
+    };
+    int count = sizeof(sample) / sizeof(sample[0]);
+
+    QStringList rv;
+    rv.reserve(lines);
+    for (int i = 0; i < lines; i++) {
+        rv.append(QString::fromLatin1(sample[i % count]));
+    }
+    return rv;
+}
+
+int main(int argc, char** argv) {
+    QString filename = "generated.go";
+    QStringList lines;
+    int count = 50000;
+
+    if (argc > 2) {
+        count = QString(argv[2]).toInt();
+    }
+
+    if (argc > 1) {
+        filename = QString(argv[1]);
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "can't open %s\n", argv[1]);
+            return 1;
+        }
+        lines = QString::fromUtf8(file.readAll()).split('\n');
+    } else {
+        lines = generate(count);
+    }
+
+    // the keywords shared by all the languages before the Lexer
+    QStringList keywords{
+        "char", "class", "const", "double", "enum", "explicit", "friend", "inline", "int",
+        "long", "namespace", "operator", "private", "protected", "public", "slots", "static",
+        "struct", "if", "else", "const", "var", "return", "continue", "void", "string", "bool",
+        "func", "select", "range", "for", "switch", "case", "break", "true", "false", "type",
+        "null", "nil", "nullptr", "while", "delete", "new", "def", "end", "until", "unless",
+        "package", "import", "#include"
+    };
+
+    QElapsedTimer timer;
+    int found = 0;
+
+    timer.start();
+    for (const QString& line : lines) {
+        found += legacyLex(line, keywords);
+    }
+    qint64 legacy = timer.nsecsElapsed();
+
+    Lexer lexer(filename);
+    QVector<LexerToken> tokens;
+    int tokensCount = 0;
+    int state = LexerStateDefault;
+
+    timer.restart();
+    for (const QString& line : lines) {
+        state = lexer.lex(line, state, &tokens);
+        tokensCount += tokens.size();
+    }
+    qint64 lexed = timer.nsecsElapsed();
+
+    printf("%lld lines of %s\n", static_cast<long long>(lines.size()), qPrintable(filename));
+    printf("legacy: %8.2f ms (%d matches)\n", legacy / 1e6, found);
+    printf("lexer:  %8.2f ms (%d tokens)\n", lexed / 1e6, tokensCount);
+    if (lexed > 0) {
+        printf("speedup: %.1fx\n", double(legacy) / double(lexed));
+    }
+
+    return 0;
+}
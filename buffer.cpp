@@ -1,8 +1,7 @@
 #include <QFileInfo>
-#include <QMessageBox>
+#include <QTextBlock>
 #include <QTextCursor>
 #include <QScrollBar>
-#include <QSettings>
 
 #include "buffer.h"
 #include "editor.h"
@@ -17,6 +16,11 @@ Buffer::Buffer(Editor* editor, QString name) :
     filename(""),
     name(name),
     alreadyReadFromDisk(false),
+    mappedFile(nullptr),
+    hibernated(false),
+    fullSyncNeeded(false),
+    version(0),
+    revision(0),
     bufferType(BUFFER_TYPE_UNKNOWN) {
 }
 
@@ -25,6 +29,11 @@ Buffer::Buffer(Editor* editor, QString name, QString filename) :
     modified(false),
     name(name),
     alreadyReadFromDisk(false),
+    mappedFile(nullptr),
+    hibernated(false),
+    fullSyncNeeded(false),
+    version(0),
+    revision(0),
     bufferType(BUFFER_TYPE_FILE) {
     // resolve the absolute path of this
     QFileInfo info(filename);
@@ -43,39 +52,102 @@ Buffer::Buffer(Editor* editor, QString name, QByteArray data) :
     filename(""),
     name(name),
     alreadyReadFromDisk(false),
+    text(QString::fromUtf8(data)),
+    mappedFile(nullptr),
+    hibernated(false),
+    fullSyncNeeded(false),
+    version(0),
+    revision(0),
     bufferType(BUFFER_TYPE_UNKNOWN) {
-    this->data = data;
 };
 
-QByteArray Buffer::read() {
+Buffer::~Buffer() {
+    if (this->mappedFile != nullptr) {
+        delete this->mappedFile;
+    }
+}
+
+// documentText returns the text of the document using '\n' as line separator.
+static QString documentText(QTextDocument* document) {
+    QString text = document->toRawText();
+    text.replace(QChar::ParagraphSeparator, '\n');
+    text.replace(QChar::LineSeparator, '\n');
+    return text;
+}
+
+// documentRange returns the text of the document in the given range using '\n'
+// as line separator.
+static QString documentRange(QTextDocument* document, int position, int length) {
+    QTextCursor cursor(document);
+    cursor.setPosition(position);
+    cursor.setPosition(position + length, QTextCursor::KeepAnchor);
+    QString text = cursor.selectedText();
+    text.replace(QChar::ParagraphSeparator, '\n');
+    text.replace(QChar::LineSeparator, '\n');
+    return text;
+}
+
+const PieceTable& Buffer::read() {
+    if (this->hibernated) {
+        this->text = PieceTable(QString::fromUtf8(qUncompress(this->compressedText)));
+        this->compressedText.clear();
+        this->hibernated = false;
+        return this->text;
+    }
+
     if (alreadyReadFromDisk) {
-        return this->data;
+        return this->text;
     }
 
     if (QFile::exists(this->filename)) {
         QFile file(this->filename);
-        // warn when the file is larger than 10MB
-        if (file.size() > 1024*1024*10) {
-            QMessageBox msgBox;
-            msgBox.setWindowTitle("Large file.");
-            msgBox.setText("The file '" + this->filename + "' is " + QString::number(file.size()/1024/1024) +  "MB, do you confirm that you want to open it?");
-            msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::Cancel);
-            msgBox.setDefaultButton(QMessageBox::Cancel);
-            if (msgBox.exec() == QMessageBox::Cancel) {
-                file.close();
-                return this->data;
+        // large files are mapped in memory instead of being read, the editor
+        // only shows the lines around its viewport.
+        if (file.size() > BUFFER_HUGE_FILE_SIZE) {
+            MappedFile* mappedFile = new MappedFile(this->filename);
+            if (mappedFile->open()) {
+                mappedFile->buildIndex();
+                this->mappedFile = mappedFile;
+                this->alreadyReadFromDisk = true;
+                return this->text;
             }
+            delete mappedFile;
         }
         file.open(QIODevice::ReadOnly);
-        this->data = file.readAll();
+        this->text = PieceTable(QString::fromUtf8(file.readAll()));
+        this->words.clear();
         file.close();
+        this->fullSyncNeeded = true;
+        this->revision++;
         this->alreadyReadFromDisk = true;
     }
 
-    return this->data;
+    return this->text;
 }
 
-QByteArray Buffer::reload() {
+PieceTable Buffer::snapshot() const {
+    if (this->hibernated) {
+        return PieceTable(QString::fromUtf8(qUncompress(this->compressedText)));
+    }
+    return this->text;
+}
+
+void Buffer::hibernate() {
+    if (this->hibernated || this->isHuge()) {
+        return;
+    }
+    this->compressedText = qCompress(this->text.toString().toUtf8());
+    this->text = PieceTable();
+    this->hibernated = true;
+}
+
+const PieceTable& Buffer::reload() {
+    if (this->mappedFile != nullptr) {
+        delete this->mappedFile;
+        this->mappedFile = nullptr;
+    }
+    this->hibernated = false;
+    this->compressedText.clear();
     this->alreadyReadFromDisk = false;
     return this->read();
 }
@@ -124,102 +196,190 @@ QString Buffer::getId() {
     return rv;
 }
 
-// TODO(remy): while saving the buffer into a file, it should turns the buffer
-// into a BUFFER_TYPE_FILE.
-void Buffer::save(Window* window) {
+void Buffer::replaceContent(const QString& content) {
     Q_ASSERT(this->editor != nullptr);
 
-    QFile file(filename);
+    // store some cursor / scroll positions
+    QTextCursor cursor = this->editor->textCursor();
+    int position = cursor.position();
+    QScrollBar* vscroll = this->editor->verticalScrollBar();
+    int value = vscroll->value();
+
+    // we do it this way instead of a simple setText in order
+    // to keep the editor history.
+    // The text of the buffer is updated through the editor document changes.
+    cursor.beginEditBlock();
+    cursor.movePosition(QTextCursor::Start);
+    cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+    cursor.deleteChar();
+    cursor.insertText(content);
+    cursor.endEditBlock();
+
+    // reposition the scroll and the cursor
+    cursor.setPosition(qMin(position, this->editor->document()->characterCount() - 1));
+    this->editor->setTextCursor(cursor);
+    vscroll->setValue(value);
+    this->editor->ensureCursorVisible();
+}
 
-    file.open(QIODevice::Truncate | QIODevice::ReadWrite);
-    if (this->editor->getBuffer() == this) {
-        file.write(this->editor->toPlainText().toUtf8());
-    } else {
-        file.write(this->data);
+bool Buffer::isGitTempFile() {
+    return Git::isGitTempFile(this->filename);
+}
+
+// changeEnd computes where a text starting at the given line and character ends.
+static void changeEnd(int line, int character, const QString& text, int* endLine, int* endCharacter) {
+    int lineReturns = text.count('\n');
+    if (lineReturns == 0) {
+        *endLine = line;
+        *endCharacter = character + text.size();
+        return;
     }
-    file.close();
-
-    if (this->postProcess()) {
-        this->alreadyReadFromDisk = false;
-        if (this->editor->getBuffer() == this) {
-            // store some cursor / scroll positions
-            QTextCursor cursor = this->editor->textCursor();
-            int position = cursor.position();
-            QScrollBar* vscroll = this->editor->verticalScrollBar();
-            int value = vscroll->value();
-
-            // reset the content by re-reading the text
-            // we do it this way instead of a simple setText in order
-            // to keep the editor history.
-            cursor.beginEditBlock();
-            cursor.movePosition(QTextCursor::Start);
-            cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
-            cursor.deleteChar();
-            cursor.insertText(this->read());
-            cursor.endEditBlock();
-
-            // reposition the scroll and the cursor
-            cursor.setPosition(position);
-            editor->setTextCursor(cursor);
-            vscroll->setValue(value);
-            this->editor->ensureCursorVisible();
-        } else {
-            // refresh the data of this buffer
-            this->read();
+    *endLine = line + lineReturns;
+    *endCharacter = text.size() - text.lastIndexOf('\n') - 1;
+}
+
+bool Buffer::onContentsChange(QTextDocument* document, int position, int charsRemoved, int charsAdded,
+                              BufferChange* change) {
+    Q_ASSERT(document != nullptr);
+
+    // when the whole document is replaced, Qt reports a change including the
+    // last paragraph separator, which is not part of the text.
+    int documentSize = document->characterCount() - 1;
+    charsAdded = qMax(0, qMin(charsAdded, documentSize - position));
+
+    QString added;
+    if (charsAdded > 0) {
+        added = documentRange(document, position, charsAdded);
+    }
+
+    // the syntax highlighter reports its format changes as contents changes
+    // of the same size, in this case the text has not changed at all.
+    if (charsRemoved == charsAdded && this->text.mid(position, charsRemoved) == added) {
+        return false;
+    }
+
+    // the change is recorded before being applied: the range is expressed
+    // in the text as it was before it.
+    // The text before the position has not changed, its line and column are
+    // the same in the document than before the change.
+    QString removed = this->text.mid(position, charsRemoved);
+    QTextBlock block = document->findBlock(position);
+    BufferChange replaced;
+    replaced.startLine = block.blockNumber();
+    replaced.startCharacter = position - block.position();
+    changeEnd(replaced.startLine, replaced.startCharacter, removed,
+              &replaced.endLine, &replaced.endCharacter);
+    replaced.text = added;
+    this->recordChange(replaced, removed);
+    if (change != nullptr) {
+        *change = replaced;
+    }
+
+    if (this->words.isBuilt()) {
+        // the words around the change may have been split or joined: the
+        // lines of the change are indexed again.
+        QTextBlock first = document->findBlock(position);
+        QTextBlock last = document->findBlock(position + charsAdded);
+        if (!last.isValid()) {
+            last = document->lastBlock();
         }
+        QString prefix = first.text().left(position - first.position());
+        QString suffix = last.text().mid(position + charsAdded - last.position());
+        this->words.remove(prefix + removed + suffix);
+        this->words.add(prefix + added + suffix);
+    }
+
+    this->text.remove(position, charsRemoved);
+    this->text.insert(position, added);
+    this->revision++;
+
+    // should never happen, but if for any reason the text has drifted from the
+    // document, read it again entirely.
+    if (this->text.size() != documentSize) {
+        qWarning() << "Buffer::onContentsChange: text out of sync with the document, reading it again";
+        this->text = PieceTable(documentText(document));
+        this->words.clear();
+        this->fullSyncNeeded = true;
     }
 
-    this->modified = false;
-    // TODO(remy): error management
+    return true;
 }
 
-bool Buffer::isGitTempFile() {
-    return Git::isGitTempFile(this->filename);
+const WordIndex& Buffer::getWordIndex() {
+    if (!this->words.isBuilt()) {
+        this->words.build(this->snapshot().toString());
+    }
+    return this->words;
 }
 
-bool Buffer::postProcess() {
-    if (this->filename.endsWith(".go")) {
-        QProcess process;
-        process.start("gofmt", QStringList() << "-l" << "-w" << this->filename);
-        if (!process.waitForFinished(10000)) {
-            qWarning() << "while running: gofmt";
-        }
-        process.start("goimports", QStringList() << "-w" << this->filename);
-        if (!process.waitForFinished(10000)) {
-            qWarning() << "while running: goimports";
-        }
-        return true;
+void Buffer::recordChange(const BufferChange& change, const QString& removed) {
+    if (this->fullSyncNeeded) {
+        // the whole text will be sent anyway
+        return;
     }
-    if (this->filename.endsWith(".zig")) {
-        QProcess process;
-        process.start("zig", QStringList() << "fmt" << this->filename);
-        if (!process.waitForFinished(10000)) {
-            qWarning() << "while running: zig fmt";
+
+    // while typing, merge the change with the previous one when it is
+    // inserting, or removing, characters at the end of what it has inserted.
+    if (!this->pendingChanges.isEmpty()) {
+        BufferChange& previous = this->pendingChanges.last();
+        if (previous.startLine == previous.endLine && previous.startCharacter == previous.endCharacter) {
+            int line = 0, character = 0;
+            changeEnd(previous.startLine, previous.startCharacter, previous.text, &line, &character);
+            if (removed.isEmpty() && change.startLine == line && change.startCharacter == character) {
+                previous.text.append(change.text);
+                return;
+            }
+            if (change.text.isEmpty() && change.endLine == line && change.endCharacter == character &&
+                    previous.text.endsWith(removed)) {
+                previous.text.chop(removed.size());
+                return;
+            }
         }
-        return true;
     }
-    return false;
+
+    this->pendingChanges.append(change);
+
+    if (this->pendingChanges.size() > BUFFER_MAX_PENDING_CHANGES) {
+        this->pendingChanges.clear();
+        this->fullSyncNeeded = true;
+    }
+}
+
+int Buffer::takeChanges(QList<BufferChange>* changes, bool* fullSync) {
+    Q_ASSERT(changes != nullptr);
+    Q_ASSERT(fullSync != nullptr);
+
+    if (!this->fullSyncNeeded && this->pendingChanges.isEmpty()) {
+        return -1;
+    }
+
+    *fullSync = this->fullSyncNeeded;
+    *changes = this->pendingChanges;
+
+    this->pendingChanges.clear();
+    this->fullSyncNeeded = false;
+    return ++this->version;
 }
 
-void Buffer::refreshData(Window* window) {
-    Q_ASSERT(window != NULL);
-    Q_ASSERT(window->getEditor(this->getId()) != NULL);
-    // store the last data from the currently displayed document in the buffer
-    this->data = window->getEditor(this->getId())->document()->toPlainText().toUtf8();
+void Buffer::resetChanges(int version) {
+    this->pendingChanges.clear();
+    this->fullSyncNeeded = false;
+    this->version = version;
 }
 
 void Buffer::onLeave() {
     Q_ASSERT(this->editor != nullptr);
 
-    // store the last data from the document in the buffer
-    this->data = this->editor->document()->toPlainText().toUtf8();
+    // the editor only contains a part of the file in huge-file mode
+    if (this->isHuge()) {
+        return;
+    }
 
     QScrollBar* vscroll = this->editor->verticalScrollBar();
 
-    // store last cursor position in settings
-    QSettings settings("mehteor", "meh");
-    settings.setValue("buffer/" + this->filename + "/cursor", editor->textCursor().position());
-    settings.setValue("buffer/" + this->filename + "/vscroll", vscroll->value());
+    // store last cursor position in the session, written later on
+    this->editor->getWindow()->getSessionStore()->setFilePosition(this->filename,
+            editor->textCursor().position(), vscroll->value());
 }
 
 void Buffer::onClose() {
@@ -233,17 +393,28 @@ void Buffer::onEnter() {
     // TODO(remy): check whether the file has changed on disk? compare timestamp?
 
     // restore the text in the editor
-    this->editor->setPlainText(this->read());
+    const PieceTable& text = this->read();
+
+    // in huge-file mode, the editor is loading itself the lines to display
+    if (this->isHuge()) {
+        return;
+    }
+
+    this->editor->setPlainText(text.toString());
 
     // restore last cursor position, but do not do that for git messages
     if (this->isGitTempFile()) {
         return;
     }
 
-    QSettings settings("mehteor", "meh");
+    FileSession session;
+    if (!this->editor->getWindow()->getSessionStore()->file(this->filename, &session)) {
+        session.cursor = 0;
+        session.vscroll = 0;
+    }
 
     QTextCursor cursor = this->editor->textCursor();
-    auto pos = settings.value("buffer/" + this->filename + "/cursor", 0).toInt();
+    int pos = session.cursor;
     if (pos > this->editor->document()->characterCount()) {
         cursor.setPosition(this->editor->document()->characterCount() - 1);
     } else {
@@ -252,6 +423,6 @@ void Buffer::onEnter() {
     this->editor->setTextCursor(cursor);
 
     QScrollBar* vscroll = this->editor->verticalScrollBar();
-    vscroll->setValue(settings.value("buffer/" + this->filename + "/vscroll", 0).toInt());
+    vscroll->setValue(session.vscroll);
     this->editor->centerCursor();
 }
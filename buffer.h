@@ -2,9 +2,15 @@
 
 #include <QByteArray>
 #include <QFile>
+#include <QList>
 #include <QProcess>
 #include <QTextEdit>
 #include <QString>
+#include <QTextDocument>
+
+#include "mapped_file.h"
+#include "piece_table.h"
+#include "word_index.h"
 
 // buffer is showing data, we don't know from where the data come from
 #define BUFFER_TYPE_UNKNOWN	0
@@ -19,6 +25,26 @@
 // buffer is showing a command exec result
 #define BUFFER_TYPE_COMMAND	5
 
+// files larger than this are opened in huge-file mode: they are memory mapped
+// and only the lines around the viewport are loaded in the editor, read-only.
+// The smaller ones, e.g. generated sources of tens of MB, stay editable.
+#define BUFFER_HUGE_FILE_SIZE (1024*1024*256)
+
+// after this many changes not taken, the changes are dropped and the next
+// synchronization of the buffer has to send its whole text.
+#define BUFFER_MAX_PENDING_CHANGES 512
+
+// BufferChange is a change of the text of a buffer: the range of the text
+// before the change is replaced by the given text.
+// Lines and characters start with 0, characters being counted in QChar.
+typedef struct BufferChange {
+    int startLine;
+    int startCharacter;
+    int endLine;
+    int endCharacter;
+    QString text;
+} BufferChange;
+
 class Window;
 class Editor;
 class Buffer
@@ -32,27 +58,54 @@ public:
     // Buffer creates a buffer showing the given data
     Buffer(Editor* editor, QString name, QByteArray data);
 
+    ~Buffer();
+
     // getId returns an identifier for this buffer. This identifier will be generated using the
     // type of buffer.
     QString getId();
 
     // read returns the content of the buffer. It reads the content from the file
     // on disk if has not been already done.
-    QByteArray read();
+    const PieceTable& read();
 
     // reload returns the content of the buffer as it is on disk.
-    QByteArray reload();
-
-    // save saves the file on disk.
-    void save(Window* window);
+    const PieceTable& reload();
 
     const QString& getFilename() const { return this->filename; }
 
-    const QByteArray& getData() const { return this->data; }
+    // snapshot returns a read-only view of the current content of the buffer.
+    // It is cheap to obtain: no copy of the text is done.
+    PieceTable snapshot() const;
+
+    // getRevision returns a number incremented on every change of the text.
+    int getRevision() const { return this->revision; }
+
+    // replaceContent replaces the whole content of the editor with the given
+    // one, keeping the editor history, the cursor and the scroll positions.
+    void replaceContent(const QString& content);
 
-    // refreshData refreshes the data of the current buffer with what's available
-    // in the editor data.
-    void refreshData(Window* window);
+    // onContentsChange must be called on every change of the editor document
+    // to keep the content of the buffer up-to-date.
+    // Returns false if the text has not changed (e.g. only formats have).
+    // If given, change is set to the range of the text which has been replaced,
+    // as it was before the change, and to the text replacing it.
+    bool onContentsChange(QTextDocument* document, int position, int charsRemoved, int charsAdded,
+                          BufferChange* change = nullptr);
+
+    // getWordIndex returns the index of the words of the buffer, used to
+    // autocomplete. It is built on the first call and then kept up-to-date
+    // with the changes.
+    const WordIndex& getWordIndex();
+
+    // takeChanges moves in changes the changes done since the last call and
+    // returns the new version of the text. fullSync is set to true when the
+    // changes can't be used and the whole text has to be sent instead.
+    // Returns -1 if nothing has changed.
+    int takeChanges(QList<BufferChange>* changes, bool* fullSync);
+
+    // resetChanges forgets the changes done so far and sets the version
+    // of the text to the given one.
+    void resetChanges(int version);
 
     // onLeave is called when the Window is leaving this Buffer (to show another one).
     void onLeave();
@@ -64,10 +117,6 @@ public:
     // onEnter is called when the window is starting to display this buffer.
     void onEnter();
 
-    // postProcess applies post processing to the current file.
-    // Returns true if the file has changed since saving and should be reloaded.
-    bool postProcess();
-
     // modified is true if something has changed in the buffer which has not be
     // stored on disk.
     bool modified;
@@ -87,16 +136,59 @@ public:
     // getName returns the name of this buffer, which is used when there is no filename attached.
     const QString& getName() { return this->name; }
 
+    // isHuge returns true if this buffer is showing a file in huge-file mode.
+    // In this mode, the buffer text is empty and the content is read from
+    // the mapped file.
+    bool isHuge() const { return this->mappedFile != nullptr; }
+
+    // getMappedFile returns the mapped file of a buffer in huge-file mode,
+    // nullptr otherwise.
+    MappedFile* getMappedFile() { return this->mappedFile; }
+
+    // hibernate releases the text of the buffer, kept compressed until the
+    // buffer is read again.
+    void hibernate();
+
+    // isHibernated returns true if the text of the buffer is compressed,
+    // see hibernate.
+    bool isHibernated() const { return this->hibernated; }
+
 protected:
 
 private:
+    // recordChange stores the change of the text in the pending changes.
+    void recordChange(const BufferChange& change, const QString& removed);
+
     Editor* editor; // editor containing this buffer
 
     QString filename;
     QString name; // if the buffer doesn't has a filename attached, it may have a name
 
     bool alreadyReadFromDisk;
-    QByteArray data;
+
+    // text is the content of the buffer, kept in sync with the editor document.
+    PieceTable text;
+
+    // mappedFile is used instead of text in huge-file mode.
+    MappedFile* mappedFile;
+
+    // hibernated is true while the text is only kept compressed, in
+    // compressedText.
+    bool hibernated;
+    QByteArray compressedText;
+
+    // changes done to the text and not taken yet, see takeChanges.
+    QList<BufferChange> pendingChanges;
+    // fullSyncNeeded is true when the pending changes are not describing
+    // everything which happened to the text.
+    bool fullSyncNeeded;
+    // version is incremented every time changes are taken.
+    int version;
+
+    // revision is incremented on every change of the text.
+    int revision;
+
+    WordIndex words;
 
     int bufferType;
 };
\ No newline at end of file
@@ -2,8 +2,6 @@
 #include <QDateTime>
 #include <QDir>
 #include <QMessageBox>
-#include <QRandomGenerator>
-#include <QSettings>
 
 #include "qdebug.h"
 
@@ -11,6 +9,8 @@
 #include "exec.h"
 #include "lsp.h"
 #include "git.h"
+#include "git_blame.h"
+#include "git_gutter.h"
 #include "window.h"
 
 Command::Command(Window* window) :
@@ -33,8 +33,7 @@ void Command::keyPressEvent(QKeyEvent* event) {
             return;
         case Qt::Key_Up:
             {
-                QSettings settings("mehteor", "meh");
-                const QStringList list = settings.value("command/history").toStringList();
+                const QStringList& list = this->window->getSessionStore()->history();
                 if (list.size() == 0 || list.size() <= this->historyIdx) {
                     return;
                 }
@@ -95,15 +94,7 @@ bool Command::warningModifiedBuffers() {
 void Command::execute(QString text) {
     this->clear();
 
-    QSettings settings("mehteor", "meh");
-    QStringList commands = settings.value("command/history").toStringList();
-    if (commands.size() == 0 || commands.last() != text) {
-        commands.append(text);
-    }
-    while (commands.size() > 1000) {
-        commands.removeFirst();
-    }
-    settings.setValue("command/history", commands);
+    this->window->getSessionStore()->appendHistory(text);
 
     QStringList list = text.split(" ");
     QString& command = list[0];
@@ -176,7 +167,7 @@ void Command::execute(QString text) {
 		if (this->warningModifiedBuffers()) {
 			return;
 		}
-        QCoreApplication::quit();
+        this->window->quitWhenSaved();
         return;
     }
 
@@ -185,7 +176,7 @@ void Command::execute(QString text) {
             // TODO(remy):  save to another file
         }
         this->window->saveAll();
-        QCoreApplication::quit();
+        this->window->quitWhenSaved();
         return;
     }
 
@@ -200,7 +191,7 @@ void Command::execute(QString text) {
         if (buffer == nullptr) {
             return;
         }
-        this->window->getEditor()->getGit()->blame();
+        this->window->getEditor()->toggleGitBlame();
         return;
     }
 
@@ -210,17 +201,27 @@ void Command::execute(QString text) {
         }
 
         // gshow is used to show the commit of a given checksum
-        // if no parameter is given, use the word under the cursor for the checksum
+        // if no parameter is given, use the commit of the current line if the
+        // blame is shown, the word under the cursor otherwise.
+        Editor* editor = this->window->getEditor();
+        GitCommit commit;
         QString checksum;
         if (list.size() > 1) {
             checksum = list[1];
-        } else if (this->window->getEditor()->getBuffer() != nullptr) {
-            checksum = this->window->getEditor()->getWordUnderCursor();
+        } else if (editor->getGitBlame() != nullptr && editor->getGitBlame()->commit(editor->currentLineNumber(), &commit)) {
+            checksum = commit.oid;
+        } else if (editor->getBuffer() != nullptr) {
+            checksum = editor->getWordUnderCursor();
         } else {
             this->window->getStatusBar()->setMessage("no checksum provided");
             return;
         }
-        this->window->getEditor()->getGit()->show(this->window->getBaseDir(), checksum);
+
+        QString path = this->window->getBaseDir();
+        if (editor->getBuffer() != nullptr && !editor->getBuffer()->getFilename().isEmpty()) {
+            path = editor->getBuffer()->getFilename();
+        }
+        editor->getGit()->show(path, checksum);
     }
 
     if (command == ":gdiff") {
@@ -228,17 +229,20 @@ void Command::execute(QString text) {
             return;
         }
 
-        bool stat = false;
         bool staged = false;
         if (list.size() > 1) {
             if (list[1] == "--staged") {
                 staged = true;
             }
             if (list[1] == "-r" || list[1] == "--refresh") {
-                stat = true;
+                // read again the file in HEAD, e.g. after a commit
+                if (this->window->getEditor()->getGitGutter() != nullptr) {
+                    this->window->getEditor()->getGitGutter()->reload();
+                }
+                return;
             }
         }
-        this->window->getEditor()->getGit()->diff(staged, stat);
+        this->window->getEditor()->getGit()->diff(staged);
         return;
     }
 
@@ -284,43 +288,37 @@ void Command::execute(QString text) {
 
     Buffer* currentBuffer = this->window->getEditor()->getBuffer();
     LSP* lsp = this->window->getLSPManager()->getLSP(currentBuffer->getId());
-    int reqId = QRandomGenerator::global()->generate();
-    if (reqId < 0) { reqId *= -1; }
+    int line = this->window->getEditor()->currentLineNumber();
+    int column = this->window->getEditor()->currentColumn();
 
     if (command == ":def") {
         if (lsp == nullptr) { this->window->getStatusBar()->setMessage("No LSP server running."); return; }
-        lsp->definition(reqId, currentBuffer->getFilename(), this->window->getEditor()->currentLineNumber(), this->window->getEditor()->currentColumn());
-        this->window->getLSPManager()->setExecutedAction(reqId, LSP_ACTION_DEFINITION, currentBuffer);
+        this->window->getLSPManager()->request(currentBuffer, LSP_ACTION_DEFINITION, line, column);
     }
 
     if (command == ":dec") {
         if (lsp == nullptr) { this->window->getStatusBar()->setMessage("No LSP server running."); return; }
-        lsp->declaration(reqId, currentBuffer->getFilename(), this->window->getEditor()->currentLineNumber(), this->window->getEditor()->currentColumn());
-        this->window->getLSPManager()->setExecutedAction(reqId, LSP_ACTION_DECLARATION, currentBuffer);
+        this->window->getLSPManager()->request(currentBuffer, LSP_ACTION_DECLARATION, line, column);
     }
 
     if (command == ":sig") {
         if (lsp == nullptr) { this->window->getStatusBar()->setMessage("No LSP server running."); return; }
-        lsp->signatureHelp(reqId, currentBuffer->getFilename(), this->window->getEditor()->currentLineNumber(), this->window->getEditor()->currentColumn());
-        this->window->getLSPManager()->setExecutedAction(reqId, LSP_ACTION_SIGNATURE_HELP, currentBuffer);
+        this->window->getLSPManager()->request(currentBuffer, LSP_ACTION_SIGNATURE_HELP, line, column);
     }
 
     if (command == ":i" || command == ":info") {
         if (lsp == nullptr) { this->window->getStatusBar()->setMessage("No LSP server running."); return; }
-        lsp->hover(reqId, currentBuffer->getFilename(), this->window->getEditor()->currentLineNumber(), this->window->getEditor()->currentColumn());
-        this->window->getLSPManager()->setExecutedAction(reqId, LSP_ACTION_HOVER, currentBuffer);
+        this->window->getLSPManager()->request(currentBuffer, LSP_ACTION_HOVER, line, column);
     }
 
     if (command == ":ref") {
         if (lsp == nullptr) { this->window->getStatusBar()->setMessage("No LSP server running."); return; }
-        lsp->references(reqId, currentBuffer->getFilename(), this->window->getEditor()->currentLineNumber(), this->window->getEditor()->currentColumn());
-        this->window->getLSPManager()->setExecutedAction(reqId, LSP_ACTION_REFERENCES, currentBuffer);
+        this->window->getLSPManager()->request(currentBuffer, LSP_ACTION_REFERENCES, line, column);
     }
 
     if (command == ":com") {
         if (lsp == nullptr) { this->window->getStatusBar()->setMessage("No LSP server running."); return; }
-        lsp->completion(reqId, currentBuffer->getFilename(), this->window->getEditor()->currentLineNumber(), this->window->getEditor()->currentColumn());
-        this->window->getLSPManager()->setExecutedAction(reqId, LSP_ACTION_COMPLETION, currentBuffer);
+        this->window->getLSPManager()->request(currentBuffer, LSP_ACTION_COMPLETION, line, column);
     }
 
     if (command.startsWith(":err")) {
@@ -339,6 +337,11 @@ void Command::execute(QString text) {
 
     }
 
+    if (command == ":lspstats") {
+        this->window->getStatusBar()->setMessage(this->window->getLSPManager()->latencyReport());
+        return;
+    }
+
     if (command == ":rlsp" || command == ":reloadlsp") {
         this->window->getLSPManager()->reload(currentBuffer);
         this->window->getStatusBar()->setLspRunning(false);
@@ -379,8 +382,7 @@ void Command::execute(QString text) {
     // --------------------------------
 
     if (command == ":history") {
-        QSettings settings("mehteor", "meh");
-        auto list = settings.value("command/history").toStringList();
+        const QStringList& list = this->window->getSessionStore()->history();
         this->window->getStatusBar()->setMessage(list.join("\n"));
     }
 
@@ -0,0 +1,117 @@
+#include <algorithm>
+
+#include "diagnostics_store.h"
+
+void DiagnosticsStore::set(const QString& absFilename, const QList<LSPDiagnostic>& diagnostics) {
+    this->clear(absFilename);
+    if (diagnostics.isEmpty()) {
+        return;
+    }
+
+    QVector<Diagnostic>& list = this->files[absFilename];
+    list.reserve(diagnostics.size());
+    for (const LSPDiagnostic& diag : diagnostics) {
+        Diagnostic diagnostic;
+        diagnostic.line = diag.line;
+        diagnostic.column = diag.column;
+        diagnostic.endLine = qMax(diag.line, diag.endLine);
+        diagnostic.endColumn = diag.endColumn;
+        diagnostic.severity = diag.severity;
+        diagnostic.message = this->intern(diag.message);
+        list.append(diagnostic);
+    }
+
+    std::stable_sort(list.begin(), list.end(), [](const Diagnostic& a, const Diagnostic& b) {
+        return a.line < b.line;
+    });
+}
+
+void DiagnosticsStore::clear(const QString& absFilename) {
+    auto it = this->files.find(absFilename);
+    if (it == this->files.end()) {
+        return;
+    }
+    for (const Diagnostic& diagnostic : it.value()) {
+        this->release(diagnostic.message);
+    }
+    this->files.erase(it);
+}
+
+DiagnosticsRange DiagnosticsStore::range(const QString& absFilename, int first, int last) const {
+    auto it = this->files.constFind(absFilename);
+    if (it == this->files.constEnd() || first > last) {
+        return DiagnosticsRange(nullptr, nullptr);
+    }
+
+    const QVector<Diagnostic>& list = it.value();
+    const Diagnostic* begin = list.constData();
+    const Diagnostic* end = begin + list.size();
+    const Diagnostic* from = std::lower_bound(begin, end, first, [](const Diagnostic& d, int line) {
+        return d.line < line;
+    });
+    const Diagnostic* to = std::upper_bound(from, end, last, [](int line, const Diagnostic& d) {
+        return line < d.line;
+    });
+    return DiagnosticsRange(from, to);
+}
+
+void DiagnosticsStore::shift(const QString& absFilename, int line, int removedLines, int addedLines) {
+    if (removedLines == addedLines) {
+        return;
+    }
+
+    auto it = this->files.find(absFilename);
+    if (it == this->files.end()) {
+        return;
+    }
+
+    const int lastRemoved = line + removedLines;
+    const int delta = addedLines - removedLines;
+    auto move = [&](int l) {
+        if (l <= line) {
+            return l;
+        }
+        if (l <= lastRemoved) {
+            // the line has been removed
+            return qMin(l, line + addedLines);
+        }
+        return l + delta;
+    };
+
+    // the order is kept: lines after the edit are all moved of delta, and
+    // lines in the edit are all before them.
+    for (Diagnostic& diagnostic : it.value()) {
+        diagnostic.line = move(diagnostic.line);
+        diagnostic.endLine = move(diagnostic.endLine);
+    }
+}
+
+int DiagnosticsStore::intern(const QString& message) {
+    auto it = this->ids.constFind(message);
+    if (it != this->ids.constEnd()) {
+        this->uses[it.value()]++;
+        return it.value();
+    }
+
+    int id;
+    if (!this->freeIds.isEmpty()) {
+        id = this->freeIds.takeLast();
+        this->messages[id] = message;
+        this->uses[id] = 1;
+    } else {
+        id = this->messages.size();
+        this->messages.append(message);
+        this->uses.append(1);
+    }
+    this->ids.insert(message, id);
+    return id;
+}
+
+void DiagnosticsStore::release(int message) {
+    if (--this->uses[message] > 0) {
+        return;
+    }
+    this->ids.remove(this->messages[message]);
+    this->messages[message].clear();
+    this->freeIds.append(message);
+}
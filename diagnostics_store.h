@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// DiagnosticSeverity of the LSP, the lowest is the most severe.
+#define DIAGNOSTIC_SEVERITY_ERROR 1
+#define DIAGNOSTIC_SEVERITY_WARNING 2
+#define DIAGNOSTIC_SEVERITY_INFORMATION 3
+#define DIAGNOSTIC_SEVERITY_HINT 4
+
+// LSPDiagnostic is a diagnostic published by a LSP server.
+// Lines start with 1, columns with 0.
+typedef struct LSPDiagnostic {
+    QString absFilename;
+    QString message;
+    int line;
+    int column;
+    int endLine;
+    int endColumn;
+    // see DIAGNOSTIC_SEVERITY_*
+    int severity;
+} LSPDiagnostic;
+
+// Diagnostic is a diagnostic as it is stored, its message being interned
+// in the store.
+// Lines start with 1, columns with 0.
+typedef struct Diagnostic {
+    int line;
+    int column;
+    int endLine;
+    int endColumn;
+    int severity;
+    // index of the message in the store
+    int message;
+} Diagnostic;
+
+// DiagnosticsRange is a view on diagnostics of the store, sorted by line.
+// It is only valid until the diagnostics of its file are changed.
+class DiagnosticsRange
+{
+public:
+    DiagnosticsRange(const Diagnostic* first, const Diagnostic* last) : first(first), last(last) {}
+
+    const Diagnostic* begin() const { return this->first; }
+    const Diagnostic* end() const { return this->last; }
+    bool isEmpty() const { return this->first == this->last; }
+    int size() const { return this->last - this->first; }
+
+private:
+    const Diagnostic* first;
+    const Diagnostic* last;
+};
+
+// DiagnosticsStore stores the diagnostics published by the LSP servers,
+// per file and sorted by line, to read the ones of the visible lines
+// without copying them. Servers are repeating the same messages a lot:
+// they are stored once.
+//
+// Between two publications, the diagnostics are following the edits of
+// the lines above them.
+class DiagnosticsStore
+{
+public:
+    // set replaces the diagnostics of the given file.
+    void set(const QString& absFilename, const QList<LSPDiagnostic>& diagnostics);
+
+    // clear removes the diagnostics of the given file.
+    void clear(const QString& absFilename);
+
+    // range returns the diagnostics of the given file starting between the
+    // lines first and last included.
+    DiagnosticsRange range(const QString& absFilename, int first, int last) const;
+
+    // message returns the message of the given diagnostic.
+    const QString& message(const Diagnostic& diagnostic) const { return this->messages[diagnostic.message]; }
+
+    // shift moves the diagnostics of the file after an edit which has replaced
+    // removedLines lines after the given line by addedLines lines. The
+    // diagnostics of the removed lines are moved to the last line of the edit.
+    void shift(const QString& absFilename, int line, int removedLines, int addedLines);
+
+private:
+    // intern returns the index of the given message, storing it if needed.
+    int intern(const QString& message);
+
+    // release forgets a use of the given message.
+    void release(int message);
+
+    QHash<QString, QVector<Diagnostic>> files;
+
+    // interned messages, with how many diagnostics are using them.
+    QStringList messages;
+    QVector<int> uses;
+    QHash<QString, int> ids;
+    // indexes of the messages not used anymore, to reuse.
+    QVector<int> freeIds;
+};
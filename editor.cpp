@@ -1,10 +1,12 @@
 #include <QColor>
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QDir>
 #include <QKeyEvent>
 #include <QFileInfo>
 #include <QFont>
 #include <QFontMetrics>
+#include <QHash>
 #include <QIcon>
 #include <QImage>
 #include <QJsonArray>
@@ -17,31 +19,37 @@
 #include <QPaintEvent>
 #include <QPixmap>
 #include <QPlainTextEdit>
-#include <QRandomGenerator>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
 #include <QRegularExpressionMatchIterator>
 #include <QScrollBar>
 #include <QSet>
-#include <QSettings>
 #include <QString>
 #include <QTextBlock>
 #include <QTextCursor>
 #include <QTextEdit>
 #include <QTimer>
 
+#include <algorithm>
+#include <climits>
+
 #include "qdebug.h"
 
 #include "completer.h"
 #include "editor.h"
 #include "git.h"
+#include "git_blame.h"
+#include "git_gutter.h"
 #include "info_popup.h"
 #include "line_number_area.h"
 #include "mode.h"
+#include "occurrences.h"
 #include "references_widget.h"
+#include "save_pipeline.h"
 #include "syntax_highlighter.h"
 #include "tasks.h"
 #include "window.h"
+#include "word_index.h"
 
 const QStringList Editor::dontReinsert = { ")", "]", "}", "(", "[", "{", "<",
                                            ">", ":", ";", ",", ".", "\"", "'" };
@@ -57,9 +65,16 @@ Editor::Editor(Window* window) :
     currentCompleter(nullptr),
     window(window),
     buffer(nullptr),
+    syntax(nullptr),
+    gitGutter(nullptr),
+    gitBlame(nullptr),
     mode(MODE_NORMAL),
     tabIndex(-1),
-    highlightedLine(QColor::fromRgb(50, 50, 50)) {
+    highlightedLine(QColor::fromRgb(50, 50, 50)),
+    hugeFileFirstLine(0),
+    hugeFileLoading(false),
+    materialized(false),
+    lastShown(0) {
     Q_ASSERT(window != nullptr);
 
     // line number area
@@ -91,6 +106,7 @@ Editor::Editor(Window* window) :
     // ----------------------
 
     this->selectionTimer = new QTimer;
+    this->occurrences = new Occurrences(this);
     this->lspRefreshTimer = new QTimer;
 
     // tab space size
@@ -130,9 +146,15 @@ Editor::Editor(Window* window) :
 }
 
 Editor::~Editor() {
+    delete this->gitGutter;
+    delete this->gitBlame;
+
     if (this->buffer != nullptr) {
-        this->buffer->onLeave(); // store settings
+        if (this->materialized) {
+            this->buffer->onLeave(); // store settings
+        }
         this->buffer->onClose();
+        this->forgetLspActions();
         delete this->buffer;
     }
 
@@ -144,6 +166,13 @@ Editor::~Editor() {
     }
 }
 
+void Editor::forgetLspActions() {
+    // the requests still pending are referencing the buffer about to be deleted
+    if (this->window != nullptr && this->window->getLSPManager() != nullptr) {
+        this->window->getLSPManager()->forgetBuffer(this->buffer);
+    }
+}
+
 QFont Editor::getFont() {
     QFont font;
     #ifdef Q_OS_MAC
@@ -170,7 +199,7 @@ void Editor::onWindowResized(QResizeEvent* event) {
 void Editor::onCursorPositionChanged() {
     this->selectionTimer->start(300);
     // update the status bar with the current line number
-    this->getStatusBar()->setLineNumber(this->textCursor().blockNumber() + 1);
+    this->getStatusBar()->setLineNumber(this->currentLineNumber());
 }
 
 void Editor::onSelectionChanged() {
@@ -178,10 +207,9 @@ void Editor::onSelectionChanged() {
 }
 
 void Editor::onTriggerLspRefresh() {
-    if (this->buffer == nullptr) {
+    if (this->buffer == nullptr || this->buffer->isHuge()) {
         return;
     }
-    this->buffer->refreshData(this->window);
     this->window->getLSPManager()->manageBuffer(this->buffer);
     this->lspRefreshTimer->stop();
 }
@@ -194,27 +222,21 @@ void Editor::onTriggerSelectionHighlight() {
     // color
     // -----
 
-    // do not highlight in big files
-    if (this->document()->blockCount() > 3000) {
-        return;
-    }
     QTextCursor cursor = this->textCursor();
     QString text = cursor.selectedText();
     if (text.size() == 0) {
-        text = "\\b" + this->getWordUnderCursor() + "\\b";
-        // do not automatically highlight small words
-        if (text.size() > 0 && text.size() <= 3) {
-            return;
-        }
+        this->occurrences->setText(this->getWordUnderCursor(), true);
+    } else if (text.contains(QChar::ParagraphSeparator)) {
+        // do not highlight selections of several lines
+        this->occurrences->setText("", false);
+    } else {
+        this->occurrences->setText(text, false);
     }
-    this->highlightText(text);
     this->selectionTimer->stop();
 }
 
 void Editor::highlightText(QString text) {
-    if (this->syntax && this->syntax->setSelection(text)) {
-        this->syntax->rehighlight();
-    }
+    this->occurrences->setText(text, false);
 }
 
 void Editor::setSearchText(QString text) {
@@ -231,15 +253,46 @@ void Editor::onChange(bool changed) {
 }
 
 void Editor::onContentsChange(int position, int charsRemoved, int charsAdded) {
-    this->lspRefreshTimer->start(500);
+    if (this->buffer == nullptr || this->buffer->isHuge()) {
+        return;
+    }
+    BufferChange change;
+    if (this->buffer->onContentsChange(this->document(), position, charsRemoved, charsAdded, &change)) {
+        // until the server publishes them again, the diagnostics are following
+        // the lines they are on.
+        this->window->getLSPManager()->getDiagnostics().shift(this->buffer->getFilename(), change.startLine + 1,
+                change.endLine - change.startLine, change.text.count('\n'));
+        this->lspRefreshTimer->start(500);
+        if (this->gitGutter != nullptr) {
+            this->gitGutter->onBufferChange();
+        }
+        if (this->gitBlame != nullptr) {
+            // the blame does not follow the edits
+            this->toggleGitBlame();
+        }
+    }
 }
 
 void Editor::save() {
     if (!this->buffer) { return; }
-    this->buffer->save(this->window);
+    if (this->buffer->isHuge()) {
+        this->getStatusBar()->setMessage("Huge files are opened read-only.");
+        return;
+    }
+    this->window->getSavePipeline()->save(this->buffer);
+}
+
+void Editor::onSaved() {
+    if (this->buffer != nullptr) {
+        this->buffer->modified = false;
+    }
     this->document()->setModified(false);
-    this->getStatusBar()->setModified(false);
-    this->getGit()->diff(false, true);
+    if (this->window->getEditor() == this) {
+        this->getStatusBar()->setModified(false);
+    }
+    if (this->gitGutter != nullptr) {
+        this->gitGutter->reload();
+    }
 }
 
 void Editor::setBuffer(Buffer* buffer) {
@@ -249,24 +302,228 @@ void Editor::setBuffer(Buffer* buffer) {
 
     // if this editor is already responsible of a buffer,
     if (this->buffer != nullptr) {
-        this->buffer->onLeave();
+        if (this->materialized) {
+            this->buffer->onLeave();
+        }
         this->buffer->onClose();
+        this->forgetLspActions();
         // XXX(remy): may not be enough
         delete this->buffer;
         this->buffer = nullptr;
     }
 
+    this->materialized = true;
     buffer->onEnter();
     this->document()->setModified(buffer->modified);
-    this->window->getLSPManager()->manageBuffer(buffer);
 
     connect(this, &QPlainTextEdit::modificationChanged, this, &Editor::onChange);
     connect(this->document(), &QTextDocument::contentsChange, this, &Editor::onContentsChange);
 
     this->buffer = buffer;
+
+    delete this->gitGutter;
+    this->gitGutter = nullptr;
+    if (this->gitBlame != nullptr) {
+        this->toggleGitBlame();
+    }
+
+    if (buffer->isHuge()) {
+        this->setupHugeFile();
+        return;
+    }
+
+    this->window->getLSPManager()->manageBuffer(buffer);
+    delete this->syntax;
     this->syntax = new SyntaxHighlighter(this, this->document());
 
-    this->getGit()->diff(false, true);
+    this->gitGutter = new GitGutter(this);
+}
+
+void Editor::setLazyBuffer(Buffer* buffer) {
+    Q_ASSERT(buffer != nullptr);
+    Q_ASSERT(this->buffer == nullptr);
+    this->buffer = buffer;
+    this->materialized = false;
+}
+
+void Editor::materialize() {
+    if (this->materialized || this->buffer == nullptr) {
+        return;
+    }
+
+    Buffer* buffer = this->buffer;
+    this->buffer = nullptr;
+    this->setBuffer(buffer);
+
+    this->markShown();
+}
+
+bool Editor::hibernate() {
+    if (!this->materialized || this->buffer == nullptr || this->buffer->isHuge()) {
+        return false;
+    }
+    // the formatters may apply their output back in the document
+    if (this->window->getSavePipeline()->isSaving(this->getId())) {
+        return false;
+    }
+
+    // the LSP server must have received the last changes
+    if (this->lspRefreshTimer->isActive()) {
+        this->onTriggerLspRefresh();
+    }
+
+    // store the cursor and scroll positions
+    this->buffer->onLeave();
+
+    delete this->gitGutter;
+    this->gitGutter = nullptr;
+    if (this->gitBlame != nullptr) {
+        this->toggleGitBlame();
+    }
+    delete this->syntax;
+    this->syntax = nullptr;
+
+    disconnect(this, &QPlainTextEdit::modificationChanged, this, &Editor::onChange);
+    disconnect(this->document(), &QTextDocument::contentsChange, this, &Editor::onContentsChange);
+
+    this->buffer->hibernate();
+    // releases the blocks, their layouts and formats, and the undo stack
+    this->document()->clear();
+    this->materialized = false;
+    return true;
+}
+
+void Editor::markShown() {
+    this->lastShown = QDateTime::currentMSecsSinceEpoch();
+}
+
+void Editor::setupHugeFile() {
+    MappedFile* mappedFile = this->buffer->getMappedFile();
+    Q_ASSERT(mappedFile != nullptr);
+
+    this->setReadOnly(true);
+    // keep a visible cursor to move in the file
+    this->setTextInteractionFlags(Qt::TextSelectableByMouse | Qt::TextSelectableByKeyboard);
+    this->setLineWrapMode(QPlainTextEdit::NoWrap);
+    this->document()->setUndoRedoEnabled(false);
+
+    connect(mappedFile, &MappedFile::indexed, this, &Editor::onHugeFileIndexed);
+    connect(mappedFile, &MappedFile::found, this, &Editor::onHugeFileFound);
+    connect(this->verticalScrollBar(), &QScrollBar::valueChanged, this, &Editor::onHugeFileScroll);
+
+    this->loadHugeFileLines(0);
+    this->getStatusBar()->setMessage("Huge file: opened read-only, indexing its lines...");
+}
+
+void Editor::loadHugeFileLines(int line) {
+    MappedFile* mappedFile = this->buffer->getMappedFile();
+
+    int lineCount = mappedFile->lineCount();
+    if (lineCount > 0) {
+        line = qBound(0, line, lineCount - 1);
+    }
+    int first = qMax(0, line - EDITOR_HUGE_FILE_LINES/2);
+
+    // the cursor position in the file, to restore it after the load
+    int cursorLine = this->currentLineNumber() - 1;
+    int cursorColumn = this->currentColumn();
+
+    this->hugeFileLoading = true;
+    this->setPlainText(mappedFile->lines(first, EDITOR_HUGE_FILE_LINES));
+    this->hugeFileFirstLine = first;
+
+    QTextBlock block = this->document()->findBlockByNumber(cursorLine - first);
+    if (cursorLine < first || !block.isValid()) {
+        block = this->document()->findBlockByNumber(line - first);
+        cursorColumn = 0;
+    }
+    QTextCursor cursor = this->textCursor();
+    cursor.setPosition(block.position() + qMin(cursorColumn, block.length() - 1));
+    this->setTextCursor(cursor);
+    this->verticalScrollBar()->setValue(line - first);
+    this->hugeFileLoading = false;
+
+    this->onUpdateLineNumberAreaWidth(0);
+}
+
+void Editor::onHugeFileIndexed() {
+    if (this->buffer == nullptr || !this->buffer->isHuge()) {
+        return;
+    }
+    // the line numbers area width depends on the amount of lines
+    this->onUpdateLineNumberAreaWidth(0);
+    this->lineNumberArea->update();
+    this->getStatusBar()->setMessage(QString("Huge file: opened read-only, %1 lines.").arg(
+        this->buffer->getMappedFile()->lineCount()));
+}
+
+void Editor::onHugeFileScroll(int value) {
+    if (this->hugeFileLoading || this->buffer == nullptr || !this->buffer->isHuge()) {
+        return;
+    }
+
+    MappedFile* mappedFile = this->buffer->getMappedFile();
+    int loaded = this->document()->blockCount();
+    int lineCount = mappedFile->lineCount();
+
+    bool moreAbove = this->hugeFileFirstLine > 0;
+    bool moreBelow = lineCount == -1 ? loaded >= EDITOR_HUGE_FILE_LINES
+                                     : this->hugeFileFirstLine + loaded < lineCount;
+
+    QScrollBar* vscroll = this->verticalScrollBar();
+    if ((moreAbove && value < EDITOR_HUGE_FILE_MARGIN) ||
+        (moreBelow && value > vscroll->maximum() - EDITOR_HUGE_FILE_MARGIN)) {
+        this->loadHugeFileLines(this->hugeFileFirstLine + value);
+    }
+}
+
+qint64 Editor::hugeFileOffset(int position) {
+    MappedFile* mappedFile = this->buffer->getMappedFile();
+    QTextBlock block = this->document()->findBlock(position);
+    qint64 lineOffset = mappedFile->lineOffset(this->hugeFileFirstLine + block.blockNumber());
+    return lineOffset + block.text().left(position - block.position()).toUtf8().size();
+}
+
+void Editor::goToHugeFileOccurrence(const QString& string, bool backward) {
+    MappedFile* mappedFile = this->buffer->getMappedFile();
+    if (!mappedFile->isIndexed()) {
+        this->getStatusBar()->setMessage("The huge file is still being indexed.");
+        return;
+    }
+
+    // the file is scanned on a worker thread, onHugeFileFound jumps to the
+    // occurrence. Same as for the regular search, the search continues from
+    // the start (or the end) of the file if nothing is found in this direction.
+    QTextCursor cursor = this->textCursor();
+    this->hugeFileSearch = string;
+    this->getStatusBar()->setMessage(QString("Searching \"%1\" in the huge file...").arg(string));
+    if (backward) {
+        mappedFile->findAsync(string.toUtf8(), this->hugeFileOffset(cursor.selectionStart()) - 1, true);
+    } else {
+        mappedFile->findAsync(string.toUtf8(), this->hugeFileOffset(cursor.selectionEnd()), false);
+    }
+}
+
+void Editor::onHugeFileFound(qint64 offset) {
+    if (this->buffer == nullptr || !this->buffer->isHuge()) {
+        return;
+    }
+
+    if (offset == -1) {
+        this->getStatusBar()->setMessage(QString("No occurrence of \"%1\" in the huge file.").arg(this->hugeFileSearch));
+        return;
+    }
+    this->getStatusBar()->hideMessage();
+
+    MappedFile* mappedFile = this->buffer->getMappedFile();
+    int line = mappedFile->lineForOffset(offset);
+    int column = mappedFile->text(mappedFile->lineOffset(line), offset).size();
+    this->goToLine(line + 1);
+
+    QTextCursor cursor = this->textCursor();
+    cursor.setPosition(cursor.block().position() + column);
+    cursor.setPosition(cursor.position() + this->hugeFileSearch.size(), QTextCursor::KeepAnchor);
+    this->setTextCursor(cursor);
 }
 
 QIcon Editor::getIcon() {
@@ -290,9 +547,8 @@ bool Editor::alreadyOpened(const QString& filename) {
         return false;
     }
 
-    QSettings settings("mehteor", "meh");
     QFileInfo f(filename);
-    int pid = settings.value("buffer/"+f.canonicalFilePath()+"/opened", 0).toInt();
+    qint64 pid = this->window->getSessionStore()->fileOpenedBy(f.canonicalFilePath());
     return pid != 0 && pid != QCoreApplication::applicationPid();
 }
 
@@ -305,16 +561,14 @@ bool Editor::storeOpenedState(const QString& filename) {
         return false; // return that we didn't update this
     }
 
-    QSettings settings("mehteor", "meh");
     QFileInfo f(filename);
-    settings.setValue("buffer/"+f.canonicalFilePath()+"/opened", QCoreApplication::applicationPid());
+    this->window->getSessionStore()->setFileOpenedBy(f.canonicalFilePath(), QCoreApplication::applicationPid());
     return true;
 }
 
 void Editor::removeOpenedState(const QString& filename) {
-    QSettings settings("mehteor", "meh");
     QFileInfo f(filename);
-    settings.remove("buffer/"+f.canonicalFilePath()+"/opened");
+    this->window->getSessionStore()->setFileOpenedBy(f.canonicalFilePath(), 0);
 }
 
 void Editor::cleanOnlyWhiteSpacesLine() {
@@ -391,6 +645,14 @@ void Editor::setSubMode(int subMode) {
 }
 
 void Editor::goToLine(int lineNumber) {
+    if (this->buffer != nullptr && this->buffer->isHuge()) {
+        int line = lineNumber - 1 - this->hugeFileFirstLine;
+        if (line < 0 || line >= this->document()->blockCount()) {
+            this->loadHugeFileLines(lineNumber - 1);
+        }
+        lineNumber -= this->hugeFileFirstLine;
+    }
+
     // note that the findBlockByNumber starts with 0
     QTextBlock block = this->document()->findBlockByNumber(lineNumber - 1);
     QTextCursor cursor = this->textCursor();
@@ -430,11 +692,16 @@ void Editor::centerCursor() {
 
 void Editor::goToOccurrence(const QString& string, bool backward) {
     QString s = string;
-    QSettings settings("mehteor", "meh");
+    SessionStore* session = this->window->getSessionStore();
     if (string == "") {
-        s = settings.value("editor/last_value_go_to_occurrence", "").toString();
+        s = session->value("editor/last_value_go_to_occurrence");
     } else {
-        settings.setValue("editor/last_value_go_to_occurrence", string);
+        session->setValue("editor/last_value_go_to_occurrence", string);
+    }
+
+    if (this->buffer != nullptr && this->buffer->isHuge()) {
+        this->goToHugeFileOccurrence(s, backward);
+        return;
     }
 
     // nothing has been found in this direction
@@ -631,11 +898,8 @@ void Editor::mousePressEvent(QMouseEvent* event) {
             this->window->getStatusBar()->setMessage("No LSP server running."); return;
             return;
         }
-        int reqId = QRandomGenerator::global()->generate();
-        lsp->definition(reqId, this->buffer->getFilename(),
-                        this->currentLineNumber(),
-                        this->currentColumn());
-        this->window->getLSPManager()->setExecutedAction(reqId, LSP_ACTION_DEFINITION, this->buffer);
+        this->window->getLSPManager()->request(this->buffer, LSP_ACTION_DEFINITION,
+                                               this->currentLineNumber(), this->currentColumn());
         return;
     }
     if (event->button() == Qt::ForwardButton) {
@@ -1054,7 +1318,7 @@ QString Editor::currentLineIndent() {
 }
 
 int Editor::currentLineNumber() {
-    return this->textCursor().blockNumber() + 1;
+    return this->textCursor().blockNumber() + 1 + this->hugeFileFirstLine;
 }
 
 int Editor::currentColumn() {
@@ -1177,42 +1441,61 @@ void Editor::lspAutocomplete() {
         return;
     }
 
-    LSP* lsp = manager->getLSP(this->getId());
-    int reqId = QRandomGenerator::global()->generate();
-    if (reqId < 0) { reqId *= -1; }
-
-    if (lsp == nullptr) {
+    if (manager->request(this->buffer, LSP_ACTION_COMPLETION, this->currentLineNumber(), this->currentColumn()) == 0) {
         this->window->getStatusBar()->setMessage("No LSP server running for this buffer.");
-        return;
     }
-
-    lsp->completion(reqId, this->buffer->getFilename(), this->currentLineNumber(), this->currentColumn());
-    manager->setExecutedAction(reqId, LSP_ACTION_COMPLETION, this->buffer);
 }
 
 void Editor::autocomplete() {
     const QString& base = this->getWordUnderCursor();
 
-    QRegularExpression rx = QRegularExpression("("+base + "\\w+)");
-
-    QStringList list;
-
-    QRegularExpressionMatchIterator it = rx.globalMatch(this->document()->toPlainText());
-    while (it.hasNext()) {
-        QRegularExpressionMatch match = it.next();
-        list << match.captured();
-    }
+    // the words starting with base in all the buffers, with how many times
+    // they are used.
+    QHash<QString, int> counts;
 
+    // the current editor is part of the editors list
     QList<Editor*> editors = this->window->getEditors();
     for (int i = 0; i < editors.size(); i++) {
-        QRegularExpressionMatchIterator it = rx.globalMatch(editors[i]->getBuffer()->getData());
-        while (it.hasNext()) {
-            QRegularExpressionMatch match = it.next();
-            list << match.captured();
-        }
+        editors[i]->getBuffer()->getWordIndex().complete(base, &counts);
     }
 
-    list.removeDuplicates();
+    // how far from the cursor the words used around it are, in lines
+    QHash<QString, int> distances;
+    QTextBlock up = this->textCursor().block();
+    QTextBlock down = up;
+    for (int distance = 0; distance <= EDITOR_AUTOCOMPLETE_PROXIMITY && (up.isValid() || down.isValid()); distance++) {
+        for (const QTextBlock& block : { up, down }) {
+            if (!block.isValid()) {
+                continue;
+            }
+            const QString text = block.text();
+            WordIndex::forEachWord(text, [&counts, &distances, distance](QStringView word) {
+                QString w = word.toString();
+                if (counts.contains(w) && !distances.contains(w)) {
+                    distances.insert(w, distance);
+                }
+            });
+        }
+        up = up.previous();
+        down = down.next();
+    }
+
+    // the words used around the cursor first, the closest ones first, then
+    // the most used ones.
+    QStringList list = counts.keys();
+    std::sort(list.begin(), list.end(), [&counts, &distances](const QString& a, const QString& b) {
+        int da = distances.value(a, INT_MAX);
+        int db = distances.value(b, INT_MAX);
+        if (da != db) {
+            return da < db;
+        }
+        int ca = counts.value(a);
+        int cb = counts.value(b);
+        if (ca != cb) {
+            return ca > cb;
+        }
+        return a < b;
+    });
 
     if (list.size() == 1) {
         this->applyAutocomplete("", base, list[0], "");
@@ -1288,16 +1571,6 @@ StatusBar* Editor::getStatusBar() {
     return this->window->getStatusBar();
 }
 
-const QString Editor::getOneLine(const QString filename, int line) {
-    QFile file(filename);
-    QString rv;
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        for (int i = 0; i < line-1 && !file.atEnd(); i++) { file.readLine(); }
-        rv = file.readLine().trimmed();
-    }
-    return rv;
-}
-
 // line area
 // ---------
 
@@ -1317,6 +1590,20 @@ void Editor::onUpdateLineNumberArea(const QRect &rect, int dy) {
     }
 }
 
+void Editor::visibleBlocks(int* first, int* last) const {
+    QTextBlock block = this->firstVisibleBlock();
+    *first = block.blockNumber();
+    *last = *first;
+
+    qreal top = this->blockBoundingGeometry(block).translated(this->contentOffset()).top();
+    const int height = this->viewport()->height();
+    while (block.isValid() && top <= height) {
+        *last = block.blockNumber();
+        top += this->blockBoundingRect(block).height();
+        block = block.next();
+    }
+}
+
 void Editor::update() {
     // FIXME(remy): trick to have the line area number redrawn
     this->onWindowResized(nullptr);
@@ -1333,28 +1620,50 @@ void Editor::lineNumberAreaPaintEvent(QPaintEvent *event) {
     painter.fillRect(event->rect(), QColor::fromRgb(30, 30, 30));
 
     QTextBlock block = firstVisibleBlock();
-    int blockNumber = block.blockNumber();
+    // blockNumber is the line number in the file (starting with 0)
+    int blockNumber = block.blockNumber() + this->hugeFileFirstLine;
     int top = qRound(blockBoundingGeometry(block).translated(contentOffset()).top());
     int bottom = top + qRound(blockBoundingRect(block).height());
 
-    QMap<int, QList<LSPDiagnostic>> diags = this->window->getLSPManager()->getDiagnostics(this->buffer->getFilename());
+    // diagnostics of the visible lines, sorted by line
+    int firstVisible = 0, lastVisible = 0;
+    this->visibleBlocks(&firstVisible, &lastVisible);
+    DiagnosticsRange diags = this->window->getLSPManager()->getDiagnostics().range(this->buffer->getFilename(),
+            firstVisible + this->hugeFileFirstLine + 1, lastVisible + this->hugeFileFirstLine + 1);
+    const Diagnostic* diag = diags.begin();
 
     int currentLine = this->currentLineNumber();
+    int blameWidth = this->gitBlameWidth();
 
     while (block.isValid() && top <= event->rect().bottom()) {
+        // most severe diagnostic of the line, 0 if none
+        int severity = 0;
+        while (diag != diags.end() && diag->line <= blockNumber + 1) {
+            if (diag->line == blockNumber + 1 && (severity == 0 || diag->severity < severity)) {
+                severity = diag->severity;
+            }
+            ++diag;
+        }
+
         if (block.isVisible() && bottom >= event->rect().top()) {
             QString number = QString::number(blockNumber + 1);
 
-            // background (neutral or error from lsp)
-            // -------------------------------------
+            // background (neutral or diagnostic from lsp)
+            // -------------------------------------------
 
-            if (diags.contains(blockNumber + 1)) {
+            if (severity == DIAGNOSTIC_SEVERITY_ERROR) {
               // use differents red if it's on the current line or not
               if (currentLine == blockNumber+1) {
                 painter.fillRect(0, top, lineNumberArea->width(), fontMetrics().height(), QColor(100,30,30));
               } else {
                 painter.fillRect(0, top, lineNumberArea->width(), fontMetrics().height(), QColor(70,30,30));
               }
+            } else if (severity != 0) {
+              if (currentLine == blockNumber+1) {
+                painter.fillRect(0, top, lineNumberArea->width(), fontMetrics().height(), QColor(100,80,30));
+              } else {
+                painter.fillRect(0, top, lineNumberArea->width(), fontMetrics().height(), QColor(70,55,30));
+              }
             } else if (currentLine == blockNumber+1) {
                 painter.fillRect(0, top, lineNumberArea->width(), fontMetrics().height(), this->highlightedLine);
             }
@@ -1382,7 +1691,7 @@ void Editor::lineNumberAreaPaintEvent(QPaintEvent *event) {
             // foreground
             // ----------
 
-            if (diags.contains(blockNumber + 1)) {
+            if (severity != 0) {
                 painter.setPen(QColor::fromRgb(150, 150, 150));
             } else if (currentLine == blockNumber+1) {
                 painter.setPen(QColor::fromRgb(200, 200, 200));
@@ -1391,7 +1700,15 @@ void Editor::lineNumberAreaPaintEvent(QPaintEvent *event) {
             }
 
             painter.setFont(Editor::getFont());
-            painter.drawText(0, top, lineNumberArea->width()-2, fontMetrics().height(), Qt::AlignCenter, number);
+            painter.drawText(blameWidth, top, lineNumberArea->width()-blameWidth-2, fontMetrics().height(), Qt::AlignCenter, number);
+
+            // blame
+            // -----
+
+            if (this->gitBlame != nullptr) {
+                painter.setPen(QColor::fromRgb(110, 110, 110));
+                painter.drawText(4, top, blameWidth-4, fontMetrics().height(), Qt::AlignLeft, this->gitBlame->text(blockNumber + 1));
+            }
         }
 
         block = block.next();
@@ -1404,6 +1721,9 @@ void Editor::lineNumberAreaPaintEvent(QPaintEvent *event) {
 int Editor::lineNumberAreaWidth() {
     int digits = 1;
     int max = qMax(1, blockCount());
+    if (this->buffer != nullptr && this->buffer->isHuge()) {
+        max = qMax(max, this->buffer->getMappedFile()->lineCount());
+    }
     while (max >= 10) {
         max /= 10;
         ++digits;
@@ -1412,7 +1732,36 @@ int Editor::lineNumberAreaWidth() {
     if (digits < 5) { digits = 5; }
 
     int space = 5 + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits;
-    return space;
+    return this->gitBlameWidth() + space;
+}
+
+int Editor::gitBlameWidth() {
+    if (this->gitBlame == nullptr) {
+        return 0;
+    }
+    return fontMetrics().horizontalAdvance(QLatin1Char('9')) * GIT_BLAME_CHARS;
+}
+
+void Editor::toggleGitBlame() {
+    if (this->gitBlame != nullptr) {
+        delete this->gitBlame;
+        this->gitBlame = nullptr;
+    } else {
+        if (this->buffer == nullptr || this->buffer->isHuge() || this->buffer->getFilename().isEmpty()) {
+            return;
+        }
+        GitRepository* repository = this->window->getGitRepository(this->buffer->getFilename());
+        if (repository == nullptr) {
+            this->getStatusBar()->setMessage("Not in a git repository.");
+            return;
+        }
+        this->gitBlame = new GitBlame(this, repository);
+        this->gitBlame->start();
+    }
+
+    this->onUpdateLineNumberAreaWidth(0);
+    this->onWindowResized(nullptr);
+    this->lineNumberArea->update();
 }
 
 int Editor::lineNumberAtY(int y) {
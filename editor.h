@@ -33,9 +33,21 @@
 #include "tasks.h"
 
 class Git;
+class GitBlame;
+class GitGutter;
+class Occurrences;
 class LineNumberArea;
 class Window;
 
+// amount of lines of a huge file materialized in the editor at once.
+#define EDITOR_HUGE_FILE_LINES 4000
+// when the view gets closer than this to an edge of the materialized lines,
+// another part of the file is loaded.
+#define EDITOR_HUGE_FILE_MARGIN 200
+// the words used up to this many lines around the cursor are proposed first
+// by the autocomplete.
+#define EDITOR_AUTOCOMPLETE_PROXIMITY 100
+
 class Editor : public QPlainTextEdit
 {
     Q_OBJECT
@@ -59,9 +71,37 @@ public:
     Buffer* getBuffer() { return this->buffer; }
     void setBuffer(Buffer* buffer);
 
-    // saves the currently opened buffer
+    // setLazyBuffer sets the buffer of the editor without reading it: the
+    // file is read, highlighted and sent to the LSP server only when the
+    // editor is materialized, e.g. when its tab is shown for the first time.
+    void setLazyBuffer(Buffer* buffer);
+
+    // materialize sets up the buffer given to setLazyBuffer, if not done yet.
+    void materialize();
+
+    // isMaterialized returns true if the buffer of the editor has been
+    // set up and is in its document.
+    bool isMaterialized() { return this->materialized; }
+
+    // hibernate releases the document of the editor, its highlighter and
+    // its git gutter, the text of the buffer being kept compressed. It is
+    // materialized again the next time its tab is shown. The undo history
+    // is lost. Returns false if the editor can't be hibernated.
+    bool hibernate();
+
+    // markShown stores that the editor is being shown, see getLastShown.
+    void markShown();
+
+    // getLastShown returns when the editor has been shown for the last time,
+    // in ms since epoch.
+    qint64 getLastShown() { return this->lastShown; }
+
+    // saves the currently opened buffer, in the background.
     void save();
 
+    // onSaved is called when the buffer has been saved.
+    void onSaved();
+
     QString getId() {
         Q_ASSERT(this->buffer != nullptr);
         return this->buffer->getId();
@@ -107,6 +147,8 @@ public:
     // the indentation
     void moveToFirstWord(QTextCursor* cursor);
 
+    // currentLineNumber returns the line number (starting with 1) of the
+    // cursor in the file, even if only a part of a huge file is displayed.
     int currentLineNumber();
     int currentColumn();
 
@@ -138,17 +180,14 @@ public:
     // insertIndentation adds one level of indentation on the line of the given cursor.
     void insertIndentation(QTextCursor cursor);
 
-    // highlightText highlights the given text in the editor.
+    // highlightText highlights the occurrences of the given text in the
+    // editor, an empty text removes them. See Occurrences.
     void highlightText(QString text);
 
     // setSearchText sets the pattern to highlight because
     // of a search
     void setSearchText(QString text);
 
-    // getOneLine returns the given line in the given file.
-    // It returns the last line of the file if line doesn't exist.
-    const QString getOneLine(const QString filename, int line);
-
     // open state of buffers
     // ---------------------
 
@@ -193,6 +232,10 @@ public:
 
     QTextBlock getFirstVisibleBlock() const { return this->firstVisibleBlock(); }
 
+    // visibleBlocks stores the numbers of the first and of the last blocks
+    // visible in the viewport.
+    void visibleBlocks(int* first, int* last) const;
+
     void lineNumberAreaPaintEvent(QPaintEvent *event);
 
     int lineNumberAreaWidth();
@@ -208,6 +251,20 @@ public:
     // getGit returns the Git instance.
     Git* getGit() { return this->git; }
 
+    // getGitGutter returns the GitGutter computing the git flags of the
+    // lines, nullptr if none.
+    GitGutter* getGitGutter() { return this->gitGutter; }
+
+    // toggleGitBlame shows or hides the blame of the buffer in the gutter.
+    void toggleGitBlame();
+
+    // getGitBlame returns the blame shown in the gutter, nullptr if none.
+    GitBlame* getGitBlame() { return this->gitBlame; }
+
+    // gitBlameWidth returns the width of the blame part of the gutter, 0 if
+    // it is not shown.
+    int gitBlameWidth();
+
     LineNumberArea* lineNumberArea;
 
 public slots:
@@ -238,6 +295,9 @@ private slots:
     void onMenuRg();
     void onMenuRgFuncs();
     void onMenuRgCalls();
+    void onHugeFileIndexed();
+    void onHugeFileScroll(int value);
+    void onHugeFileFound(qint64 offset);
 
 private:
     // keyPressEventNormal handles this event in normal mode.
@@ -304,6 +364,31 @@ private:
     // getStatusBar is a convenient method returns the Window's StatusBar instance.
     StatusBar* getStatusBar();
 
+    // huge files
+    // ----------------------
+
+    // setupHugeFile prepares the editor to display a huge file: read-only, no
+    // highlighting, and only a window of lines materialized in the document.
+    void setupHugeFile();
+
+    // loadHugeFileLines materializes the lines of the huge file around the
+    // given line (starting with 0), keeping the cursor on the same line
+    // of the file if it is still in the loaded lines.
+    void loadHugeFileLines(int line);
+
+    // forgetLspActions cancels the LSP requests still pending for the buffer
+    // before it is deleted.
+    void forgetLspActions();
+
+    // goToHugeFileOccurrence starts searching string in the whole huge file,
+    // not only in the lines currently loaded. The cursor is moved when the
+    // search is done.
+    void goToHugeFileOccurrence(const QString& string, bool backward);
+
+    // hugeFileOffset returns the offset in the huge file of the given position
+    // in the document.
+    qint64 hugeFileOffset(int position);
+
     // ----------------------
 
     TasksPlugin *tasksPlugin;
@@ -316,7 +401,10 @@ private:
 
     Window* window;
     SyntaxHighlighter* syntax;
+    Occurrences* occurrences;
     Git* git;
+    GitGutter* gitGutter;
+    GitBlame* gitBlame;
 
     // mode is the currently used mode. See mode.h
     int mode;
@@ -336,4 +424,23 @@ private:
     // visualLineBlockStart is the block at which has been started the visual
     // line mode.
     QTextBlock visualLineBlockStart;
+
+    // hugeFileFirstLine is the line of the file (starting with 0) displayed in
+    // the first block of the document. Always 0 for a regular buffer.
+    int hugeFileFirstLine;
+
+    // hugeFileLoading is true while lines of a huge file are being loaded
+    // in the document, to not react on the scroll it generates.
+    bool hugeFileLoading;
+
+    // hugeFileSearch is the string searched by the last goToHugeFileOccurrence.
+    QString hugeFileSearch;
+
+    // materialized is false while the buffer given to setLazyBuffer has
+    // not been read, see materialize.
+    bool materialized;
+
+    // lastShown is when the editor has been shown for the last time, in ms
+    // since epoch.
+    qint64 lastShown;
 };
@@ -72,31 +72,9 @@ void Editor::menuGetLineAndColumn(int* line, int* column) {
 }
 
 void Editor::onMenuLspCall(int lspAction) {
-    LSP* lsp = this->window->getLSPManager()->getLSP(this->buffer->getId());
-    if (lsp == nullptr) {
-        return;
-    }
-
     int line, column;
     this->menuGetLineAndColumn(&line, &column);
-
-    int reqId = this->window->getLSPManager()->randomId();
-    switch (lspAction) {
-        case LSP_ACTION_HOVER:
-        case LSP_ACTION_HOVER_MOUSE:
-            lsp->hover(reqId, buffer->getFilename(), line, column);
-            break;
-        case LSP_ACTION_REFERENCES:
-            lsp->references(reqId, buffer->getFilename(), line, column);
-            break;
-        case LSP_ACTION_DEFINITION:
-            lsp->definition(reqId, buffer->getFilename(), line, column);
-            break;
-        default:
-            Q_UNREACHABLE();
-            break;
-    }
-    this->window->getLSPManager()->setExecutedAction(reqId, lspAction, this->buffer);
+    this->window->getLSPManager()->request(this->buffer, lspAction, line, column);
 }
 
 void Editor::onMenuReferences() {
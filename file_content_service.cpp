@@ -0,0 +1,91 @@
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QTextBlock>
+
+#include "file_content_service.h"
+#include "mapped_file.h"
+
+FileContentService::FileContentService() {
+}
+
+FileContentService::~FileContentService() {
+    for (const Entry& entry : this->files) {
+        delete entry.mapped;
+    }
+}
+
+void FileContentService::resolve(QVector<FileLine>* lines) {
+    Q_ASSERT(lines != nullptr);
+
+    // the lines of a same file are read together, with the same mapping
+    QHash<QString, QVector<int>> perFile;
+    for (int i = 0; i < lines->size(); i++) {
+        perFile[(*lines)[i].file].append(i);
+    }
+
+    QMutexLocker locker(&this->mutex);
+    for (auto it = perFile.constBegin(); it != perFile.constEnd(); ++it) {
+        MappedFile* mapped = this->map(it.key());
+        if (mapped == nullptr) {
+            continue;
+        }
+        for (int i : it.value()) {
+            FileLine& line = (*lines)[i];
+            line.text = mapped->line(line.line - 1).trimmed();
+        }
+    }
+}
+
+MappedFile* FileContentService::map(const QString& file) {
+    QFileInfo fi(file);
+    if (!fi.isFile()) {
+        return nullptr;
+    }
+
+    auto it = this->files.find(file);
+    if (it != this->files.end()) {
+        this->lru.removeOne(file);
+        if (it.value().lastModified == fi.lastModified() && it.value().size == fi.size()) {
+            this->lru.append(file);
+            return it.value().mapped;
+        }
+        // changed on disk
+        delete it.value().mapped;
+        this->files.erase(it);
+    }
+
+    MappedFile* mapped = new MappedFile(file);
+    if (!mapped->open()) {
+        delete mapped;
+        return nullptr;
+    }
+    mapped->buildIndexSync();
+
+    Entry entry;
+    entry.mapped = mapped;
+    entry.lastModified = fi.lastModified();
+    entry.size = fi.size();
+    this->files.insert(file, entry);
+    this->lru.append(file);
+
+    while (this->lru.size() > FILE_CONTENT_MAX_FILES) {
+        delete this->files.take(this->lru.takeFirst()).mapped;
+    }
+    return mapped;
+}
+
+void FileContentService::resolveFromDocument(const QString& file, const QTextDocument* document, QVector<FileLine>* lines) {
+    Q_ASSERT(document != nullptr);
+    Q_ASSERT(lines != nullptr);
+
+    for (int i = 0; i < lines->size(); i++) {
+        FileLine& line = (*lines)[i];
+        if (line.file != file) {
+            continue;
+        }
+        QTextBlock block = document->findBlockByNumber(line.line - 1);
+        if (block.isValid()) {
+            line.text = block.text().trimmed();
+        }
+    }
+}
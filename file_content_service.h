@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QTextDocument>
+#include <QVector>
+
+// files kept mapped in memory by the FileContentService.
+#define FILE_CONTENT_MAX_FILES 32
+
+class MappedFile;
+
+// FileLine is a line of a file, e.g. a location returned by a LSP server,
+// with its text once resolved.
+typedef struct FileLine {
+    QString file;
+    // line number, starting with 1
+    int line;
+    QString text;
+} FileLine;
+
+// FileContentService reads the lines of files to preview locations in them.
+// The most recently read files are kept memory mapped, the offsets of their
+// lines being indexed the first time they are read: a line is then read
+// without going through the file again.
+//
+// resolve can be called from any thread.
+class FileContentService
+{
+public:
+    FileContentService();
+    ~FileContentService();
+
+    // resolve sets the text of the given lines, trimmed, going through every
+    // file once.
+    void resolve(QVector<FileLine>* lines);
+
+    // resolveFromDocument sets the text of the lines of the given file from
+    // the document showing it, more recent than the file on disk.
+    // Must be called on the thread of the document.
+    static void resolveFromDocument(const QString& file, const QTextDocument* document, QVector<FileLine>* lines);
+
+private:
+    typedef struct Entry {
+        MappedFile* mapped;
+        // to map the file again when it has changed on disk
+        QDateTime lastModified;
+        qint64 size;
+    } Entry;
+
+    // map returns the mapped file, mapping it if needed, nullptr if the file
+    // can't be read. The mutex must be locked.
+    MappedFile* map(const QString& file);
+
+    QMutex mutex;
+    QHash<QString, Entry> files;
+    // least recently used first
+    QList<QString> lru;
+};
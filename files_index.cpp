@@ -0,0 +1,291 @@
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QPair>
+
+#include "files_index.h"
+
+#include "qdebug.h"
+
+FilesIndex::FilesIndex(QObject* parent) :
+    QObject(parent),
+    ready(false),
+    revision(0),
+    cancelled(false),
+    generation(0) {
+    this->pool.setMaxThreadCount(1);
+
+    this->watcher = new QFileSystemWatcher(this);
+    this->rescanTimer = new QTimer(this);
+    this->rescanTimer->setSingleShot(true);
+
+    connect(this->watcher, &QFileSystemWatcher::directoryChanged, this, &FilesIndex::onDirectoryChanged);
+    connect(this->rescanTimer, &QTimer::timeout, this, &FilesIndex::onRescan);
+}
+
+FilesIndex::~FilesIndex() {
+    this->cancelled = true;
+    this->pool.waitForDone();
+}
+
+void FilesIndex::setRoot(const QString& root) {
+    QString dir = root;
+    if (!dir.endsWith("/")) {
+        dir += "/";
+    }
+    if (dir == this->root) {
+        return;
+    }
+
+    // stop any running scan of the previous root
+    this->cancelled = true;
+    this->pool.waitForDone();
+    this->cancelled = false;
+
+    this->generation++;
+    this->root = dir;
+    this->ready = false;
+    this->tree.clear();
+    this->files.clear();
+    this->revision++;
+    this->changedDirs.clear();
+    this->rescanTimer->stop();
+    if (!this->watcher->directories().isEmpty()) {
+        this->watcher->removePaths(this->watcher->directories());
+    }
+
+    int generation = this->generation;
+    this->pool.start([this, dir, generation]() {
+        FilesIndexTree result = FilesIndex::scan(dir, "", QSet<QString>(), this->cancelled);
+        if (this->cancelled) {
+            return;
+        }
+        QMetaObject::invokeMethod(this, [this, generation, result]() {
+            this->merge(generation, QStringList() << "", result);
+        }, Qt::QueuedConnection);
+    });
+}
+
+QList<GitIgnore> FilesIndex::ignoresFor(const QString& root, const QString& dir) {
+    QList<GitIgnore> rv;
+
+    GitIgnore exclude("", root + ".git/info/exclude");
+    if (!exclude.isEmpty()) {
+        rv.append(exclude);
+    }
+
+    // every .gitignore from the root to the directory
+    int idx = 0;
+    while (idx != -1) {
+        QString current = dir.left(idx);
+        GitIgnore ignore(current, root + current + ".gitignore");
+        if (!ignore.isEmpty()) {
+            rv.append(ignore);
+        }
+        idx = dir.indexOf('/', idx);
+        if (idx != -1) {
+            idx++;
+        }
+    }
+    return rv;
+}
+
+FilesIndexTree FilesIndex::scan(const QString& root, const QString& dir, const QSet<QString>& known,
+                                const std::atomic<bool>& cancelled) {
+    FilesIndexTree rv;
+    int count = 0;
+
+    QList<QPair<QString, QList<GitIgnore>>> stack;
+    stack.append(qMakePair(dir, FilesIndex::ignoresFor(root, dir)));
+
+    while (!stack.isEmpty() && !cancelled) {
+        QPair<QString, QList<GitIgnore>> current = stack.takeLast();
+        const QString& path = current.first;
+        const QList<GitIgnore>& ignores = current.second;
+
+        // removed in the meantime
+        if (!QFileInfo(root + path).isDir()) {
+            continue;
+        }
+
+        FilesIndexDir entry;
+        QDirIterator it(root + path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden);
+        while (it.hasNext()) {
+            it.next();
+            QFileInfo info = it.fileInfo();
+            QString name = it.fileName();
+            QString relative = path + name;
+
+            if (info.isDir()) {
+                // do not follow the links to directories, they could loop
+                if (name == ".git" || info.isSymLink()) {
+                    continue;
+                }
+                QString sub = relative + "/";
+                if (GitIgnore::isIgnored(ignores, relative, true)) {
+                    continue;
+                }
+                entry.dirs.append(sub);
+                if (known.contains(sub)) {
+                    continue;
+                }
+                QList<GitIgnore> subIgnores = ignores;
+                GitIgnore ignore(sub, root + sub + ".gitignore");
+                if (!ignore.isEmpty()) {
+                    subIgnores.append(ignore);
+                }
+                stack.append(qMakePair(sub, subIgnores));
+                continue;
+            }
+
+            if (GitIgnore::isIgnored(ignores, relative, false)) {
+                continue;
+            }
+            entry.files.append(relative);
+            count++;
+        }
+        rv.insert(path, entry);
+
+        if (count > FILES_INDEX_MAX_FILES) {
+            qWarning() << "FilesIndex::scan: more than" << FILES_INDEX_MAX_FILES << "files in" << root << ", stopping";
+            break;
+        }
+    }
+
+    return rv;
+}
+
+// watchedPath returns the path of the given directory as used by the watcher.
+static QString watchedPath(const QString& root, const QString& dir) {
+    QString rv = root + dir;
+    rv.chop(1); // no trailing slash
+    return rv;
+}
+
+void FilesIndex::merge(int generation, const QStringList& dirs, const FilesIndexTree& result) {
+    if (generation != this->generation) {
+        // the root has changed since
+        return;
+    }
+
+    // remove what has disappeared from the scanned directories
+    for (const QString& dir : dirs) {
+        if (!result.contains(dir)) {
+            this->removeDir(dir);
+            continue;
+        }
+        if (!this->tree.contains(dir)) {
+            continue;
+        }
+        const QStringList scanned = result.value(dir).dirs;
+        const QStringList previous = this->tree[dir].dirs;
+        for (const QString& sub : previous) {
+            if (!scanned.contains(sub)) {
+                this->removeDir(sub);
+            }
+        }
+    }
+
+    QStringList toWatch;
+    for (auto it = result.constBegin(); it != result.constEnd(); ++it) {
+        if (!this->tree.contains(it.key())) {
+            toWatch.append(watchedPath(this->root, it.key()));
+        }
+        this->tree.insert(it.key(), it.value());
+    }
+
+    int available = FILES_INDEX_MAX_WATCHED_DIRS - this->watcher->directories().size();
+    if (toWatch.size() > available) {
+        qWarning() << "FilesIndex::merge: too many directories to watch, changes in" << (toWatch.size() - available)
+                   << "of them won't be seen";
+        toWatch = toWatch.mid(0, qMax(0, available));
+    }
+    if (!toWatch.isEmpty()) {
+        this->watcher->addPaths(toWatch);
+    }
+
+    this->rebuildFiles();
+    this->ready = true;
+    emit updated();
+}
+
+void FilesIndex::removeDir(const QString& dir) {
+    if (!this->tree.contains(dir)) {
+        return;
+    }
+    const QStringList subs = this->tree[dir].dirs;
+    for (const QString& sub : subs) {
+        this->removeDir(sub);
+    }
+    this->tree.remove(dir);
+    this->watcher->removePath(watchedPath(this->root, dir));
+}
+
+void FilesIndex::rebuildFiles() {
+    QStringList files;
+    files.reserve(this->files.size());
+    for (auto it = this->tree.constBegin(); it != this->tree.constEnd(); ++it) {
+        files.append(it.value().files);
+    }
+    this->files = files;
+    this->revision++;
+}
+
+void FilesIndex::onDirectoryChanged(const QString& path) {
+    // the watcher is reporting paths without their trailing slash
+    QString dir = path.mid(this->root.size());
+    if (!dir.isEmpty()) {
+        dir += "/";
+    }
+    this->changedDirs.insert(dir);
+    // wait for things to settle, e.g. a checkout changing thousands of files
+    this->rescanTimer->start(FILES_INDEX_RESCAN_DELAY_MS);
+}
+
+void FilesIndex::onRescan() {
+    if (this->changedDirs.isEmpty()) {
+        return;
+    }
+
+    QList<QPair<QString, QSet<QString>>> scans;
+    QStringList dirs;
+    for (const QString& dir : this->changedDirs) {
+        // the subdirectories already indexed don't need to be scanned again
+        QStringList known = this->tree.value(dir).dirs;
+        scans.append(qMakePair(dir, QSet<QString>(known.begin(), known.end())));
+        dirs.append(dir);
+    }
+    this->changedDirs.clear();
+
+    QString root = this->root;
+    int generation = this->generation;
+    this->pool.start([this, root, generation, scans, dirs]() {
+        FilesIndexTree result;
+        for (const QPair<QString, QSet<QString>>& scan : scans) {
+            FilesIndexTree tree = FilesIndex::scan(root, scan.first, scan.second, this->cancelled);
+            for (auto it = tree.constBegin(); it != tree.constEnd(); ++it) {
+                result.insert(it.key(), it.value());
+            }
+        }
+        if (this->cancelled) {
+            return;
+        }
+        QMetaObject::invokeMethod(this, [this, generation, dirs, result]() {
+            this->merge(generation, dirs, result);
+        }, Qt::QueuedConnection);
+    });
+}
+
+QStringList FilesIndex::filesIn(const QString& dir) const {
+    if (dir.isEmpty()) {
+        return this->files;
+    }
+    QStringList rv;
+    for (const QString& file : this->files) {
+        if (file.startsWith(dir)) {
+            rv.append(file.mid(dir.size()));
+        }
+    }
+    return rv;
+}
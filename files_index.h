@@ -0,0 +1,110 @@
+#pragma once
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <atomic>
+
+#include "gitignore.h"
+
+// stop indexing after this many files.
+#define FILES_INDEX_MAX_FILES 1000000
+// inotify watches are limited, do not watch more directories than this.
+#define FILES_INDEX_MAX_WATCHED_DIRS 8192
+// changes on disk are applied after this delay without other changes.
+#define FILES_INDEX_RESCAN_DELAY_MS 200
+
+// FilesIndexDir is the content of one indexed directory.
+// All the paths are relative to the root of the index.
+typedef struct FilesIndexDir {
+    QStringList files;
+    QStringList dirs;
+} FilesIndexDir;
+
+// FilesIndexTree is all the indexed directories, per relative path
+// (empty for the root, ending with a '/' otherwise).
+typedef QHash<QString, FilesIndexDir> FilesIndexTree;
+
+// FilesIndex is a recursive index of all the files of a directory, built on
+// a worker thread. The .gitignore rules are respected and the index is kept
+// up-to-date by watching the indexed directories.
+class FilesIndex : public QObject
+{
+    Q_OBJECT
+public:
+    FilesIndex(QObject* parent);
+    ~FilesIndex();
+
+    // setRoot starts indexing the given directory in the background.
+    void setRoot(const QString& root);
+
+    // getRoot returns the indexed directory, always ending with a '/'.
+    const QString& getRoot() const { return this->root; }
+
+    // isReady returns true when the first indexing is done.
+    bool isReady() const { return this->ready; }
+
+    // getFiles returns all the indexed files, relative to the root.
+    const QStringList& getFiles() const { return this->files; }
+
+    // getRevision returns a number incremented every time the list of files changes.
+    int getRevision() const { return this->revision; }
+
+    // filesIn returns the files under the given directory (relative to the
+    // root), relative to this directory.
+    QStringList filesIn(const QString& dir) const;
+
+    // ignoresFor loads the .gitignore files from the root (ending with a '/')
+    // to the given directory (relative to the root).
+    static QList<GitIgnore> ignoresFor(const QString& root, const QString& dir);
+
+signals:
+    // updated is emitted every time the list of files has changed.
+    void updated();
+
+private slots:
+    void onDirectoryChanged(const QString& path);
+    void onRescan();
+
+private:
+    // scan scans the given directory (relative to root) on the worker, and
+    // recursively the subdirectories which are not part of known.
+    // It is called from the worker thread.
+    static FilesIndexTree scan(const QString& root, const QString& dir, const QSet<QString>& known,
+                               const std::atomic<bool>& cancelled);
+
+    // merge applies the result of a scan of the given directories.
+    void merge(int generation, const QStringList& dirs, const FilesIndexTree& result);
+
+    // removeDir removes the given directory and its subdirectories from the index.
+    void removeDir(const QString& dir);
+
+    // rebuildFiles rebuilds the flat list of files from the tree.
+    void rebuildFiles();
+
+    QString root;
+    bool ready;
+
+    FilesIndexTree tree;
+    QStringList files;
+    int revision;
+
+    QFileSystemWatcher* watcher;
+    QTimer* rescanTimer;
+    // directories changed on disk, waiting to be scanned again.
+    QSet<QString> changedDirs;
+
+    // a single worker: the scans are applied in order.
+    QThreadPool pool;
+    std::atomic<bool> cancelled;
+    // generation is incremented every time the root changes, results
+    // of scans of an older generation are dropped.
+    int generation;
+};
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <QCoreApplication>
 #include <QDir>
 #include <QFileInfo>
@@ -8,7 +10,7 @@
 #include <QLabel>
 #include <QLineEdit>
 #include <QList>
-#include <QListWidgetItem>
+#include <QSet>
 
 #include "qdebug.h"
 
@@ -19,13 +21,19 @@
 
 FilesLookup::FilesLookup(Window* window) :
     QFrame(window),
-    window(window) {
+    window(window),
+    indexRevision(-1),
+    useIndex(false) {
     Q_ASSERT(window != nullptr);
 
     this->edit = new QLineEdit(this);
     this->label = new QLabel(this);
-    this->list = new QListWidget(this);
-    this->list->setSortingEnabled(true);
+    this->model = new FilesLookupModel(this);
+    this->list = new QListView(this);
+    this->list->setModel(this->model);
+    // only the visible rows are laid out and rendered
+    this->list->setUniformItemSizes(true);
+    this->list->setEditTriggers(QAbstractItemView::NoEditTriggers);
     this->edit->setFont(Editor::getFont());
     this->label->setFont(Editor::getFont());
     this->list->setFont(Editor::getFont());
@@ -41,15 +49,20 @@ FilesLookup::FilesLookup(Window* window) :
     this->setLayout(layout);
 
     connect(this->edit, &QLineEdit::textChanged, this, &FilesLookup::onEditChanged);
-    connect(this->list, &QListWidget::itemDoubleClicked, this, &FilesLookup::onItemDoubleClicked);
-
+    connect(this->list, &QListView::doubleClicked, this, &FilesLookup::onItemDoubleClicked);
+    connect(this->window->getFilesIndex(), &FilesIndex::updated, this, &FilesLookup::onIndexUpdated);
 }
 
 void FilesLookup::onEditChanged() {
-    this->resetFiltered();
     this->filter();
     this->refreshList();
-    this->list->setCurrentRow(0);
+}
+
+void FilesLookup::onIndexUpdated() {
+    // refresh the results with the new files
+    if (this->isVisible() && this->useIndex && !this->edit->text().isEmpty()) {
+        this->onEditChanged();
+    }
 }
 
 void FilesLookup::onItemDoubleClicked() {
@@ -72,7 +85,6 @@ void FilesLookup::showBuffers() {
     this->base = this->window->getBaseDir();
     this->edit->setText("");
     this->lookupBuffers();
-    this->list->setSortingEnabled(false);
     this->show();
 }
 
@@ -85,6 +97,12 @@ void FilesLookup::show() {
     this->resize(popupWidth, popupHeight);
     this->move(winWidth / 2 - (winWidth/3), 120);
 
+    QSet<QString> ids;
+    for (Editor* editor : this->window->getEditors()) {
+        ids.insert(editor->getId());
+    }
+    this->model->setOpenBuffers(ids);
+
     this->refreshList();
     this->edit->setFocus();
     QWidget::show();
@@ -97,13 +115,9 @@ void FilesLookup::hide() {
 
 void FilesLookup::lookupBuffers() {
     this->filenames.clear();
-    this->filteredFiles.clear();
     this->directories.clear();
-    this->filteredDirs.clear();
     this->buffers.clear();
-    this->filteredBuffers.clear();
-
-    this->list->setSortingEnabled(false);
+    this->useIndex = false;
 
     QList<Editor*> editors = this->window->getEditors();
     for (int i = 0; i < editors.size(); i++) {
@@ -120,23 +134,20 @@ void FilesLookup::lookupBuffers() {
 
         if (buffer->getType() == BUFFER_TYPE_FILE) {
             this->filenames.append(value);
-            this->filteredFiles.append(value);
         } else {
             this->buffers.append(value);
-            this->filteredBuffers.append(value);
         }
     }
+
+    this->model->clearCache();
+    this->resetMatchers();
 }
 
 void FilesLookup::lookupDir(QString filepath) {
     this->filenames.clear();
-    this->filteredFiles.clear();
     this->directories.clear();
-    this->filteredDirs.clear();
     this->buffers.clear();
-    this->filteredBuffers.clear();
-
-    this->list->setSortingEnabled(true);
+    this->useIndex = true;
 
     if (filepath.endsWith("/")) {
         this->base += filepath;
@@ -152,50 +163,52 @@ void FilesLookup::lookupDir(QString filepath) {
             QString filename = info.fileName();
             if (filename == ".") { continue; }
             this->directories.append(filename);
-            this->filteredDirs.append(filename);
         } else {
             this->filenames.append(info.fileName());
-            this->filteredFiles.append(info.fileName());
         }
     }
+
+    std::sort(this->directories.begin(), this->directories.end());
+    std::sort(this->filenames.begin(), this->filenames.end());
+    this->model->clearCache();
+    this->resetMatchers();
 }
 
 void FilesLookup::showList(QList<QString> files) {
     this->base = this->window->getBaseDir();
 
     this->filenames.clear();
-    this->filteredFiles.clear();
     this->directories.clear();
-    this->filteredDirs.clear();
     this->buffers.clear();
-    this->filteredBuffers.clear();
-
-    this->list->setSortingEnabled(true);
+    this->useIndex = false;
 
     for (QString file : files) {
         QFileInfo info = QFileInfo(file);
         if (info.isDir()) {
             this->directories.append(file);
-            this->filteredDirs.append(file);
         } else {
             this->filenames.append(file);
-            this->filteredFiles.append(file);
         }
     }
 
+    std::sort(this->directories.begin(), this->directories.end());
+    std::sort(this->filenames.begin(), this->filenames.end());
+    this->model->clearCache();
+    this->resetMatchers();
+
     this->show();
     this->edit->setText("");
 }
 
 bool FilesLookup::openSelection() {
-    QListWidgetItem* item = this->list->currentItem();
-    if (item == nullptr) {
-        qDebug() << "item == nullptr in FilesLookup::keyPressEvent";
+    QModelIndex index = this->list->currentIndex();
+    if (!index.isValid()) {
+        qDebug() << "invalid index in FilesLookup::openSelection";
         return false;
     }
 
-    QString id = item->data(FILESLOOKUP_DATA_ID).toString();
-    QString type = item->data(FILESLOOKUP_DATA_TYPE).toString();
+    QString id = index.data(FILESLOOKUP_DATA_ID).toString();
+    QString type = index.data(FILESLOOKUP_DATA_TYPE).toString();
 
     if (type == "file") {
         this->window->saveCheckpoint();
@@ -234,20 +247,20 @@ void FilesLookup::keyPressEvent(QKeyEvent* event) {
 
         case Qt::Key_N:
             if (ctrl) {
-                if (this->list->currentRow() == this->list->count() - 1) {
-                    this->list->setCurrentRow(0);
+                if (this->list->currentIndex().row() == this->model->rowCount() - 1) {
+                    this->setCurrentRow(0);
                 } else {
-                    this->list->setCurrentRow(this->list->currentRow() + 1);
+                    this->setCurrentRow(this->list->currentIndex().row() + 1);
                 }
             }
             return;
 
         case Qt::Key_P:
             if (ctrl) {
-                if (this->list->currentRow() <= 0) {
-                    this->list->setCurrentRow(this->list->count() - 1);
+                if (this->list->currentIndex().row() <= 0) {
+                    this->setCurrentRow(this->model->rowCount() - 1);
                 } else {
-                    this->list->setCurrentRow(this->list->currentRow() - 1);
+                    this->setCurrentRow(this->list->currentIndex().row() - 1);
                 }
             }
             return;
@@ -261,7 +274,7 @@ void FilesLookup::keyPressEvent(QKeyEvent* event) {
                     this->label->setText(this->edit->text());
                     return;
                 }
-                if (this->list->currentItem() == nullptr) {
+                if (!this->list->currentIndex().isValid()) {
                     return;
                 }
                 bool close = this->openSelection();
@@ -274,98 +287,72 @@ void FilesLookup::keyPressEvent(QKeyEvent* event) {
 }
 
 void FilesLookup::resetFiltered() {
-    this->filteredDirs.clear();
-    this->filteredFiles.clear();
-    this->filteredBuffers.clear();
-
-    for (QString it : this->directories) {
-        this->filteredDirs.append(it);
-    }
+    // implicitly shared, no copies of the entries
+    this->filteredDirs = this->directories;
+    this->filteredFiles = this->filenames;
+    this->filteredBuffers = this->buffers;
+}
 
-    for (QString it : this->filenames) {
-        this->filteredFiles.append(it);
-    }
+void FilesLookup::resetMatchers() {
+    this->dirsMatcher.setEntries(this->directories);
+    this->filesMatcher.setEntries(this->filenames);
+    this->buffersMatcher.setEntries(this->buffers);
+    this->resetFiltered();
+}
 
-    for (QString it : this->buffers) {
-        this->filteredBuffers.append(it);
+// matches returns the entries of the matcher matching the query, best first.
+static QList<QString> matches(FuzzyMatcher& matcher, const QString& query) {
+    QList<QString> rv;
+    const QStringList& entries = matcher.getEntries();
+    for (const FuzzyMatch& match : matcher.match(query, FILESLOOKUP_MAX_RESULTS)) {
+        rv.append(entries.at(match.index));
     }
+    return rv;
 }
 
 void FilesLookup::filter() {
     QString string = this->edit->text();
-    auto it = this->filteredDirs.constBegin();
-    while (it != this->filteredDirs.constEnd()) {
-        if (!(it->contains(QRegularExpression(string)))) {
-            it = this->filteredDirs.erase(it);
-        } else {
-            ++it;
-        }
+    if (string.isEmpty()) {
+        this->resetFiltered();
+        return;
     }
 
-    it = this->filteredFiles.begin();
-    while (it != this->filteredFiles.end()) {
-        if (!it->contains(QRegularExpression(string))) {
-            it = this->filteredFiles.erase(it);
-        } else {
-            ++it;
+    this->filteredDirs = matches(this->dirsMatcher, string);
+
+    // look for the files in the whole tree when possible
+    FilesIndex* index = this->window->getFilesIndex();
+    QString base = QDir::cleanPath(this->base) + "/";
+    if (this->useIndex && index->isReady() && base.startsWith(index->getRoot())) {
+        QString dir = base.mid(index->getRoot().size());
+        if (dir != this->indexDir || index->getRevision() != this->indexRevision) {
+            this->indexMatcher.setEntries(index->filesIn(dir));
+            this->indexDir = dir;
+            this->indexRevision = index->getRevision();
         }
+        this->filteredFiles = matches(this->indexMatcher, string);
+    } else {
+        this->filteredFiles = matches(this->filesMatcher, string);
     }
 
-    it = this->filteredBuffers.begin();
-    while (it != this->filteredBuffers.end()) {
-        if (!it->contains(QRegularExpression(string))) {
-            it = this->filteredBuffers.erase(it);
-        } else {
-            ++it;
-        }
-    }
+    this->filteredBuffers = matches(this->buffersMatcher, string);
 }
 
-// TODO(remy): a performance improvements would be to not empty it and refill it
-// every time but just removing the filtered entries.
 void FilesLookup::refreshList() {
-    this->list->clear();
-    for (QString it : this->filteredDirs) {
-        QIcon icon = QIcon(":/res/directory-in.png");
-        if (it == "..") {
-            icon = QIcon(":/res/directory-out.png");
-        }
-        QListWidgetItem* item = new QListWidgetItem(icon, it, this->list);
-        item->setData(FILESLOOKUP_DATA_TYPE, "directory");
-        item->setData(FILESLOOKUP_DATA_ID, it);
-        item->setText(it);
-    }
-    for (QString it : this->filteredFiles) {
-        QString fullPath = it;
-        if (!(it.startsWith("/"))) {
-            fullPath = this->base + it;
-        }
-        QFileInfo fi(fullPath);
-        fullPath = fi.canonicalFilePath();
-        QIcon icon = QIcon(":/res/plus.png");
-        if (this->window->hasBuffer(fullPath)) {
-            icon = QIcon(":/res/edit.png");
-        }
-        QListWidgetItem* item = new QListWidgetItem(icon, it, this->list);
-        item->setData(FILESLOOKUP_DATA_TYPE, "file");
-        item->setData(FILESLOOKUP_DATA_ID, fullPath);
-        item->setText(it);
-    }
-    for (QString it : this->filteredBuffers) {
-        QListWidgetItem* item = new QListWidgetItem(QIcon(":/res/edit.png"), it, this->list);
-        item->setData(FILESLOOKUP_DATA_TYPE, "buffer");
-        item->setData(FILESLOOKUP_DATA_ID, it);
-        item->setText(it);
-    }
+    this->model->setEntries(this->base, this->filteredDirs, this->filteredFiles, this->filteredBuffers);
 
     // now, select the first entry which is not ..
-    if (this->list->count() > 1) {
-        if (this->list->item(0)->text() == "..") {
-            this->list->item(1)->setSelected(true);
-            this->list->setCurrentRow(1);
-        } else {
-            this->list->item(0)->setSelected(true);
-            this->list->setCurrentRow(0);
-        }
+    if (this->model->rowCount() > 1 && this->model->label(0) == "..") {
+        this->setCurrentRow(1);
+    } else {
+        this->setCurrentRow(0);
+    }
+}
+
+void FilesLookup::setCurrentRow(int row) {
+    QModelIndex index = this->model->index(row);
+    if (!index.isValid()) {
+        return;
     }
+    this->list->setCurrentIndex(index);
+    this->list->scrollTo(index);
 }
@@ -7,15 +7,17 @@
 #include <QKeyEvent>
 #include <QLabel>
 #include <QLineEdit>
-#include <QListWidget>
+#include <QListView>
 #include <QObject>
 #include <QProcess>
 #include <QString>
 #include <QWidget>
 
-#define FILESLOOKUP_DATA_LABEL 0 << 2 // label to display
-#define FILESLOOKUP_DATA_ID    1 << 2 // id in the list of buffers
-#define FILESLOOKUP_DATA_TYPE  2 << 2 // possible values: directory, file, buffer
+#include "fileslookup_model.h"
+#include "fuzzy_matcher.h"
+
+// maximum amount of entries per category listed while filtering
+#define FILESLOOKUP_MAX_RESULTS 100000
 
 class Window;
 
@@ -37,6 +39,10 @@ public:
     // resetFiltered resets the list with filtered results: they again contain all entries.
     void resetFiltered();
 
+    // resetMatchers gives the entries to the matchers, to call after having
+    // changed the lists of entries.
+    void resetMatchers();
+
     // refreshList refreshes the content of the list.
     void refreshList();
 
@@ -46,7 +52,11 @@ public:
     // Returns true if we're done and we can close the FilesLookup.
     bool openSelection();
 
-    // TODO(remy): comment me
+    // setCurrentRow selects the given row of the list.
+    void setCurrentRow(int row);
+
+    // filter fills the filtered lists with the entries matching the text
+    // of the edit, best matches first.
     void filter();
 
     void show();
@@ -58,6 +68,7 @@ public:
 public slots:
     void onEditChanged();
     void onItemDoubleClicked();
+    void onIndexUpdated();
 
 protected:
     void keyPressEvent(QKeyEvent* event);
@@ -69,7 +80,8 @@ private:
 
     QLineEdit* edit;
     QLabel* label;
-    QListWidget* list;
+    QListView* list;
+    FilesLookupModel* model;
     QGridLayout* layout;
 
     QList<QString> directories;
@@ -78,4 +90,18 @@ private:
     QList<QString> filteredFiles;
     QList<QString> buffers;
     QList<QString> filteredBuffers;
+
+    FuzzyMatcher dirsMatcher;
+    FuzzyMatcher filesMatcher;
+    FuzzyMatcher buffersMatcher;
+
+    // indexMatcher matches the files of the index under indexDir, it is
+    // refreshed when the index revision has changed.
+    FuzzyMatcher indexMatcher;
+    QString indexDir;
+    int indexRevision;
+
+    // useIndex is true when looking for files in a directory: while filtering,
+    // the files of all its subdirectories are looked up in the FilesIndex.
+    bool useIndex;
 };
@@ -0,0 +1,118 @@
+#include <QFileInfo>
+
+#include "fileslookup_model.h"
+
+FilesLookupModel::FilesLookupModel(QObject* parent) :
+    QAbstractListModel(parent),
+    dirInIcon(":/res/directory-in.png"),
+    dirOutIcon(":/res/directory-out.png"),
+    fileIcon(":/res/plus.png"),
+    openedIcon(":/res/edit.png") {
+}
+
+void FilesLookupModel::setEntries(const QString& base, const QList<QString>& dirs, const QList<QString>& files,
+                                  const QList<QString>& buffers) {
+    this->beginResetModel();
+    this->base = base;
+    this->dirs = dirs;
+    this->files = files;
+    this->buffers = buffers;
+    this->endResetModel();
+}
+
+void FilesLookupModel::setOpenBuffers(const QSet<QString>& ids) {
+    this->openBuffers = ids;
+    if (!this->files.isEmpty()) {
+        emit dataChanged(this->index(this->dirs.size()), this->index(this->dirs.size() + this->files.size() - 1),
+                         QList<int>() << Qt::DecorationRole);
+    }
+}
+
+int FilesLookupModel::rowCount(const QModelIndex& parent) const {
+    if (parent.isValid()) {
+        return 0;
+    }
+    return this->dirs.size() + this->files.size() + this->buffers.size();
+}
+
+QString FilesLookupModel::label(int row) const {
+    if (row < 0) {
+        return "";
+    }
+    if (row < this->dirs.size()) {
+        return this->dirs.at(row);
+    }
+    row -= this->dirs.size();
+    if (row < this->files.size()) {
+        return this->files.at(row);
+    }
+    row -= this->files.size();
+    if (row < this->buffers.size()) {
+        return this->buffers.at(row);
+    }
+    return "";
+}
+
+QString FilesLookupModel::canonicalPath(const QString& file) const {
+    QString fullPath = file;
+    if (!file.startsWith("/")) {
+        fullPath = this->base + file;
+    }
+    auto it = this->canonicalPaths.constFind(fullPath);
+    if (it != this->canonicalPaths.constEnd()) {
+        return it.value();
+    }
+    QString canonical = QFileInfo(fullPath).canonicalFilePath();
+    this->canonicalPaths.insert(fullPath, canonical);
+    return canonical;
+}
+
+QVariant FilesLookupModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= this->rowCount()) {
+        return QVariant();
+    }
+
+    int row = index.row();
+    if (row < this->dirs.size()) {
+        const QString& dir = this->dirs.at(row);
+        switch (role) {
+            case FILESLOOKUP_DATA_LABEL:
+            case FILESLOOKUP_DATA_ID:
+                return dir;
+            case FILESLOOKUP_DATA_TYPE:
+                return QString("directory");
+            case Qt::DecorationRole:
+                return dir == ".." ? this->dirOutIcon : this->dirInIcon;
+        }
+        return QVariant();
+    }
+
+    row -= this->dirs.size();
+    if (row < this->files.size()) {
+        const QString& file = this->files.at(row);
+        switch (role) {
+            case FILESLOOKUP_DATA_LABEL:
+                return file;
+            case FILESLOOKUP_DATA_ID:
+                return this->canonicalPath(file);
+            case FILESLOOKUP_DATA_TYPE:
+                return QString("file");
+            case Qt::DecorationRole:
+                return this->openBuffers.contains(this->canonicalPath(file)) ? this->openedIcon : this->fileIcon;
+        }
+        return QVariant();
+    }
+
+    row -= this->files.size();
+    const QString& buffer = this->buffers.at(row);
+    switch (role) {
+        case FILESLOOKUP_DATA_LABEL:
+        case FILESLOOKUP_DATA_ID:
+            return buffer;
+        case FILESLOOKUP_DATA_TYPE:
+            return QString("buffer");
+        case Qt::DecorationRole:
+            return this->openedIcon;
+    }
+    return QVariant();
+}
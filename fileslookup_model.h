@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QIcon>
+#include <QList>
+#include <QModelIndex>
+#include <QSet>
+#include <QString>
+#include <QVariant>
+
+#define FILESLOOKUP_DATA_LABEL Qt::DisplayRole // label to display
+#define FILESLOOKUP_DATA_ID    (Qt::UserRole + 1) // id in the list of buffers
+#define FILESLOOKUP_DATA_TYPE  (Qt::UserRole + 2) // possible values: directory, file, buffer
+
+// FilesLookupModel is the list of entries displayed by the FilesLookup:
+// directories first, then files and buffers.
+//
+// Nothing is computed for the entries not displayed: the canonical paths of
+// the files and their icons are resolved when a row is rendered, and cached.
+class FilesLookupModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    FilesLookupModel(QObject* parent);
+
+    // setEntries replaces all the entries of the list. The files not starting
+    // with a '/' are relative to base.
+    void setEntries(const QString& base, const QList<QString>& dirs, const QList<QString>& files,
+                    const QList<QString>& buffers);
+
+    // setOpenBuffers sets the ids of the opened buffers, files already
+    // opened are displayed with a different icon.
+    void setOpenBuffers(const QSet<QString>& ids);
+
+    // clearCache drops the canonical paths resolved so far, to call when
+    // files may have been created or removed.
+    void clearCache() { this->canonicalPaths.clear(); }
+
+    // label returns the text displayed for the given row.
+    QString label(int row) const;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+private:
+    // canonicalPath returns the canonical path of the given file entry.
+    QString canonicalPath(const QString& file) const;
+
+    QString base;
+    QList<QString> dirs;
+    QList<QString> files;
+    QList<QString> buffers;
+
+    QSet<QString> openBuffers;
+
+    // full path -> canonical path, the resolution is a syscall.
+    mutable QHash<QString, QString> canonicalPaths;
+
+    QIcon dirInIcon;
+    QIcon dirOutIcon;
+    QIcon fileIcon;
+    QIcon openedIcon;
+};
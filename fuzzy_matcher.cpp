@@ -0,0 +1,260 @@
+#include <algorithm>
+
+#include "fuzzy_matcher.h"
+
+// scores, similar to the ones used by fzf.
+#define FUZZY_SCORE_MATCH 16
+#define FUZZY_SCORE_GAP_START -3
+#define FUZZY_SCORE_GAP_EXTENSION -1
+// bonus for a char after a path separator.
+#define FUZZY_BONUS_BOUNDARY_DELIMITER 9
+// bonus for a char at the start of a word.
+#define FUZZY_BONUS_BOUNDARY 8
+#define FUZZY_BONUS_NON_WORD 8
+// bonus for a camelCase hump or the first digit of a number.
+#define FUZZY_BONUS_CAMEL_123 7
+// minimum bonus for consecutive chars.
+#define FUZZY_BONUS_CONSECUTIVE 4
+// the bonus of the first char of the query counts more.
+#define FUZZY_BONUS_FIRST_CHAR_MULTIPLIER 2
+
+enum CharClass {
+    CharWhite,
+    CharNonWord,
+    CharDelimiter,
+    CharLower,
+    CharUpper,
+    CharLetter,
+    CharNumber,
+};
+
+static inline CharClass charClass(QChar c) {
+    ushort u = c.unicode();
+    if (u >= 'a' && u <= 'z') { return CharLower; }
+    if (u >= 'A' && u <= 'Z') { return CharUpper; }
+    if (u >= '0' && u <= '9') { return CharNumber; }
+    if (u == '/' || u == '\\') { return CharDelimiter; }
+    if (u == ' ' || u == '\t') { return CharWhite; }
+    if (u < 128) { return CharNonWord; }
+    if (c.isLower()) { return CharLower; }
+    if (c.isUpper()) { return CharUpper; }
+    if (c.isLetter()) { return CharLetter; }
+    if (c.isNumber()) { return CharNumber; }
+    if (c.isSpace()) { return CharWhite; }
+    return CharNonWord;
+}
+
+static inline ushort fold(QChar c, bool caseSensitive) {
+    ushort u = c.unicode();
+    if (caseSensitive) {
+        return u;
+    }
+    if (u >= 'A' && u <= 'Z') {
+        return u + ('a' - 'A');
+    }
+    if (u < 128) {
+        return u;
+    }
+    return c.toLower().unicode();
+}
+
+static inline int bonusFor(CharClass previous, CharClass current) {
+    if (current >= CharLower) {
+        if (previous == CharDelimiter) {
+            return FUZZY_BONUS_BOUNDARY_DELIMITER;
+        }
+        if (previous == CharWhite || previous == CharNonWord) {
+            return FUZZY_BONUS_BOUNDARY;
+        }
+        if ((previous == CharLower && current == CharUpper) ||
+                (previous != CharNumber && current == CharNumber)) {
+            return FUZZY_BONUS_CAMEL_123;
+        }
+        return 0;
+    }
+    if (current == CharNonWord || current == CharDelimiter) {
+        return FUZZY_BONUS_NON_WORD;
+    }
+    return 0;
+}
+
+FuzzyMatcher::FuzzyMatcher() {
+}
+
+quint64 FuzzyMatcher::charsMask(QStringView text) {
+    // one bit per letter (case insensitive) and digit, the other chars share
+    // the remaining bits.
+    quint64 mask = 0;
+    for (QChar c : text) {
+        ushort u = fold(c, false);
+        if (u >= 'a' && u <= 'z') {
+            mask |= quint64(1) << (u - 'a');
+        } else if (u >= '0' && u <= '9') {
+            mask |= quint64(1) << (26 + u - '0');
+        } else {
+            mask |= quint64(1) << (36 + u % 28);
+        }
+    }
+    return mask;
+}
+
+void FuzzyMatcher::setEntries(const QStringList& entries) {
+    this->entries = entries;
+    this->masks.resize(entries.size());
+    for (int i = 0; i < entries.size(); i++) {
+        this->masks[i] = FuzzyMatcher::charsMask(entries.at(i));
+    }
+    this->lastQuery.clear();
+    this->lastMatches.clear();
+}
+
+int FuzzyMatcher::score(QStringView text, QStringView query, bool caseSensitive) {
+    if (query.isEmpty()) {
+        return 0;
+    }
+
+    // look for the first occurrence of the query chars
+    int idx = 0;
+    int start = -1;
+    int end = -1;
+    for (int i = 0; i < text.size(); i++) {
+        if (fold(text[i], caseSensitive) == fold(query[idx], caseSensitive)) {
+            if (start == -1) {
+                start = i;
+            }
+            if (++idx == query.size()) {
+                end = i + 1;
+                break;
+            }
+        }
+    }
+    if (end == -1) {
+        return -1;
+    }
+
+    // from its end, go backward to find the shortest match
+    idx = query.size() - 1;
+    for (int i = end - 1; i >= start; i--) {
+        if (fold(text[i], caseSensitive) == fold(query[idx], caseSensitive)) {
+            if (--idx < 0) {
+                start = i;
+                break;
+            }
+        }
+    }
+
+    int score = 0;
+    int consecutive = 0;
+    int firstBonus = 0;
+    bool inGap = false;
+    idx = 0;
+    CharClass previous = start > 0 ? charClass(text[start - 1]) : CharDelimiter;
+    for (int i = start; i < end; i++) {
+        QChar c = text[i];
+        CharClass current = charClass(c);
+        if (idx < query.size() && fold(c, caseSensitive) == fold(query[idx], caseSensitive)) {
+            score += FUZZY_SCORE_MATCH;
+            int bonus = bonusFor(previous, current);
+            if (consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                // a run of chars keeps the bonus of its start
+                if (bonus >= FUZZY_BONUS_BOUNDARY && bonus > firstBonus) {
+                    firstBonus = bonus;
+                }
+                bonus = std::max(std::max(bonus, firstBonus), FUZZY_BONUS_CONSECUTIVE);
+            }
+            if (idx == 0) {
+                score += bonus * FUZZY_BONUS_FIRST_CHAR_MULTIPLIER;
+            } else {
+                score += bonus;
+            }
+            inGap = false;
+            consecutive++;
+            idx++;
+        } else {
+            score += inGap ? FUZZY_SCORE_GAP_EXTENSION : FUZZY_SCORE_GAP_START;
+            inGap = true;
+            consecutive = 0;
+            firstBonus = 0;
+        }
+        previous = current;
+    }
+
+    return score;
+}
+
+QList<FuzzyMatch> FuzzyMatcher::match(const QString& query, int limit) {
+    QList<FuzzyMatch> rv;
+
+    if (query.isEmpty()) {
+        this->lastQuery.clear();
+        this->lastMatches.clear();
+        int count = limit < 0 ? this->entries.size() : qMin(limit, int(this->entries.size()));
+        rv.reserve(count);
+        for (int i = 0; i < count; i++) {
+            rv.append(FuzzyMatch{i, 0});
+        }
+        return rv;
+    }
+
+    bool caseSensitive = false;
+    for (QChar c : query) {
+        if (c.isUpper()) {
+            caseSensitive = true;
+            break;
+        }
+    }
+
+    // what matches the query is matching any of its prefixes as well, only
+    // look in the previous matches when the query has been extended.
+    bool narrow = !this->lastQuery.isEmpty() && query.startsWith(this->lastQuery);
+    int candidates = narrow ? this->lastMatches.size() : this->entries.size();
+
+    quint64 queryMask = FuzzyMatcher::charsMask(query);
+    QVector<int> matches;
+    QVector<FuzzyMatch> scored;
+
+    for (int i = 0; i < candidates; i++) {
+        int index = narrow ? this->lastMatches.at(i) : i;
+        // quickly discard the entries not containing all the chars of the query
+        if ((this->masks.at(index) & queryMask) != queryMask) {
+            continue;
+        }
+        int score = FuzzyMatcher::score(this->entries.at(index), query, caseSensitive);
+        if (score < 0) {
+            continue;
+        }
+        matches.append(index);
+        scored.append(FuzzyMatch{index, score});
+    }
+
+    this->lastQuery = query;
+    this->lastMatches = matches;
+
+    // best score first, then the shortest entries
+    auto better = [this](const FuzzyMatch& a, const FuzzyMatch& b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        int aSize = this->entries.at(a.index).size();
+        int bSize = this->entries.at(b.index).size();
+        if (aSize != bSize) {
+            return aSize < bSize;
+        }
+        return a.index < b.index;
+    };
+
+    if (limit >= 0 && limit < scored.size()) {
+        std::partial_sort(scored.begin(), scored.begin() + limit, scored.end(), better);
+        scored.resize(limit);
+    } else {
+        std::sort(scored.begin(), scored.end(), better);
+    }
+
+    rv.reserve(scored.size());
+    for (const FuzzyMatch& m : scored) {
+        rv.append(m);
+    }
+    return rv;
+}
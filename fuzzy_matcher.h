@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVector>
+
+// FuzzyMatch is an entry matching a query.
+typedef struct FuzzyMatch {
+    // index of the entry in the list of entries of the matcher
+    int index;
+    int score;
+} FuzzyMatch;
+
+// FuzzyMatcher looks for the entries containing all the chars of a query, in
+// order but not necessarily consecutive, and ranks them with a score favoring
+// matches at the start of words, after path separators, on camelCase humps
+// and consecutive chars (similar to what fzf does).
+//
+// The matching is case insensitive unless the query contains an uppercase letter.
+class FuzzyMatcher
+{
+public:
+    FuzzyMatcher();
+
+    // setEntries sets the entries in which to look for.
+    void setEntries(const QStringList& entries);
+
+    const QStringList& getEntries() const { return this->entries; }
+
+    // match returns the entries matching the query, best score first, up to
+    // limit entries (-1 for no limit). When the query is an extension of the
+    // previous one, only the entries which were matching are tested again.
+    // An empty query matches all entries, in their order.
+    QList<FuzzyMatch> match(const QString& query, int limit = -1);
+
+    // score returns the score of the text for the given query, -1 if the
+    // text is not matching.
+    static int score(QStringView text, QStringView query, bool caseSensitive);
+
+private:
+    // charsMask returns a mask of the chars present in the text, used to
+    // quickly discard entries not containing all the chars of a query.
+    static quint64 charsMask(QStringView text);
+
+    QStringList entries;
+    // masks of the chars of every entry, see charsMask.
+    QVector<quint64> masks;
+
+    // lastQuery and lastMatches are kept to narrow the next query.
+    QString lastQuery;
+    QVector<int> lastMatches;
+};
@@ -3,7 +3,7 @@
 #include "buffer.h"
 #include "editor.h"
 #include "git.h"
-#include "line_number_area.h"
+#include "git_repository.h"
 #include "window.h"
 
 Git::Git(Editor* editor) : editor(editor), command(GIT_UNKNOWN), bufferName("") {
@@ -18,7 +18,7 @@ void Git::onResults() {
 
 void Git::onErrorOccurred() {
     if (this->process) {
-        this->editor->getWindow()->getStatusBar()->setMessage("An error occurred while running git blame.");
+        this->editor->getWindow()->getStatusBar()->setMessage("An error occurred while running git diff.");
         delete this->process;
         this->process = nullptr;
         this->editor = nullptr;
@@ -31,27 +31,7 @@ void Git::onFinished() {
         this->process = nullptr;
     }
 
-    int lineNumber = this->editor->currentLineNumber();
-
     switch (this->command) {
-        case GIT_BLAME:
-            {
-                QString str = this->data;
-                str = str.replace(QRegularExpression("\\)\\s*\n"), ")\n");
-                Editor* newEditor = this->editor->getWindow()->newEditor(this->bufferName, str.toUtf8());
-                newEditor->getBuffer()->setType(BUFFER_TYPE_GIT_BLAME);
-                newEditor->goToLine(lineNumber);
-            }
-            break;
-        case GIT_SHOW:
-            {
-                QString str = this->data;
-                str = str.replace(QRegularExpression("\n\\s*\n"), "\n\n");
-                Editor* newEditor = this->editor->getWindow()->newEditor(this->bufferName, str.toUtf8());
-                newEditor->getBuffer()->setType(BUFFER_TYPE_GIT_SHOW);
-                newEditor->goToLine(0);
-            }
-            break;
         case GIT_DIFF:
             {
                 QString str = this->data;
@@ -61,13 +41,6 @@ void Git::onFinished() {
                 newEditor->goToLine(0);
             }
             break;
-        case GIT_DIFF_STAT:
-            {
-                QString diff = this->data;
-                this->processDiff(diff);
-                this->editor->update();
-            }
-            break;
     }
 
     // we've finished, clean-up
@@ -75,111 +48,32 @@ void Git::onFinished() {
     this->command = GIT_UNKNOWN;
 }
 
-void Git::processDiff(const QString& diff) {
-    // TODO(remy): limit the processing to a maximum size here?
-    this->editor->lineNumberArea->clearGitFlags();
-
-    QRegularExpression rx(QStringLiteral("@@ -(\\d*),(\\d*) \\+(\\d*),(\\d*) @@"));
-    QStringList lines = diff.split("\n");
-    int oldCounter = 0;
-    int newCounter = 0;
-    bool parsing = false;
-    for (QString line : lines) {
-        if (line.contains(rx)) {
-            QRegularExpressionMatchIterator it = rx.globalMatch(line);
-            if (it.hasNext()) {
-                QRegularExpressionMatch match = it.next();
-//                int oldStartLine = match.captured(1).toInt() + 3;
-//                int oldEndLine = oldStartLine + match.captured(2).toInt()-6;
-
-//                int newStartLine = match.captured(3).toInt() + 3;
-//                int newEndLine = newStartLine + match.captured(4).toInt()-6;
-//
-//                for (int i = oldStartLine; i < oldEndLine; i++) {
-//                    this->statEditor->lineNumberArea->setGitFlag(i, GIT_FLAG_REMOVED);
-//                }
-//                for (int i = newStartLine; i < newEndLine; i++) {
-//                    this->statEditor->lineNumberArea->setGitFlag(i, GIT_FLAG_ADDED);
-//                }
-                oldCounter = match.captured(1).toInt();
-                newCounter = match.captured(3).toInt();
-            }
-            parsing = true;
-            continue;
-        }
-
-        if (!parsing) {
-            continue;
-        }
-
-        if (line.startsWith("-")) {
-            this->editor->lineNumberArea->setGitFlag(newCounter, GIT_FLAG_REMOVED);
-            continue;
-        }
-
-        if (line.startsWith("+")) {
-            this->editor->lineNumberArea->setGitFlag(newCounter, GIT_FLAG_ADDED);
-        }
-
-        newCounter++;
-    }
-}
-
-void Git::blame() {
+void Git::show(const QString& path, const QString& checksum) {
     Q_ASSERT(this->editor != nullptr);
-    Q_ASSERT(this->editor->getBuffer() != nullptr);
-
-    // TODO(remy): runGit(QStringList args, int command) command
-
-    const QString& filename = this->editor->getBuffer()->getFilename();
-    this->data.clear(); // clear the data read from the process before starting the blame
 
-    // create and init the process
-    this->process = new QProcess(this);
-    QFileInfo fi(filename);
-
-    this->process->setWorkingDirectory(fi.canonicalPath());
-
-    // run git blame <filename>
-    QStringList args; args << "blame" << fi.fileName();
-    this->process->start("git", args);
-
-    this->command = GIT_BLAME;
-    this->bufferName = fi.fileName();
-
-    // connect the events
-    connect(this->process, &QProcess::readyReadStandardOutput, this, &Git::onResults);
-    connect(this->process, &QProcess::errorOccurred, this, &Git::onErrorOccurred);
-    connect(this->process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &Git::onFinished);
-}
-
-void Git::show(const QString& workDir, const QString& checksum) {
-    Q_ASSERT(this->editor != nullptr);
-    Q_ASSERT(this->editor->getBuffer() != nullptr);
-
-    this->data.clear(); // clear the data read from the process before starting the show
-
-    // TODO(remy): runGit(QStringList args, int command) command
-
-    // create and init the process
-    this->process = new QProcess(this);
-    QFileInfo fi(workDir);
-    this->process->setWorkingDirectory(fi.canonicalPath());
-
-    // run git show <checksum>
-    QStringList args; args << "show" << checksum;
-    this->process->start("git", args);
-
-    this->command = GIT_SHOW;
-    this->bufferName = checksum;
+    Window* window = this->editor->getWindow();
+    GitRepository* repository = window->getGitRepository(path);
+    if (repository == nullptr) {
+        window->getStatusBar()->setMessage("Not in a git repository.");
+        return;
+    }
 
-    // connect the events
-    connect(this->process, &QProcess::readyReadStandardOutput, this, &Git::onResults);
-    connect(this->process, &QProcess::errorOccurred, this, &Git::onErrorOccurred);
-    connect(this->process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &Git::onFinished);
+    // the output is cached by the repository, showing a commit again is
+    // immediate.
+    repository->show(checksum, [window, checksum](bool ok, const QString&, const QByteArray& text) {
+        if (!ok) {
+            window->getStatusBar()->setMessage("Can't show the commit " + checksum + ".");
+            return;
+        }
+        QString str = QString::fromUtf8(text);
+        str = str.replace(QRegularExpression("\n\\s*\n"), "\n\n");
+        Editor* newEditor = window->newEditor(checksum, str.toUtf8());
+        newEditor->getBuffer()->setType(BUFFER_TYPE_GIT_SHOW);
+        newEditor->goToLine(0);
+    });
 }
 
-void Git::diff(bool staged, bool stat) {
+void Git::diff(bool staged) {
     Q_ASSERT(this->editor != nullptr);
     Q_ASSERT(this->editor->getBuffer() != nullptr);
 
@@ -204,11 +98,7 @@ void Git::diff(bool staged, bool stat) {
     args << buffer->getFilename();
     this->process->start("git", args);
 
-    if (stat) {
-        this->command = GIT_DIFF_STAT;
-    } else {
-        this->command = GIT_DIFF;
-    }
+    this->command = GIT_DIFF;
 
     this->bufferName = QString("DIFF - ") + QFileInfo(buffer->getFilename()).fileName();
 
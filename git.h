@@ -5,10 +5,7 @@
 #include <QString>
 
 #define GIT_UNKNOWN		0
-#define GIT_BLAME	 		1
-#define GIT_SHOW 			2
 #define GIT_DIFF			3
-#define GIT_DIFF_STAT 	4
 
 class Buffer;
 class Editor;
@@ -19,14 +16,11 @@ class Git : public QObject {
 public:
     Git(Editor* editor);
 
-    // blame is running git blame on the buffer file, and his opening the result
-    // in a new buffer.
-    void blame();
+    // show is showing the given git commit with this checksum, in the
+    // repository containing path.
+    void show(const QString& path, const QString& checksum);
 
-    // show is showing the given git commit with this checksum
-    void show(const QString& baseDir, const QString& checksum);
-
-    void diff(bool staged, bool stat = false);
+    void diff(bool staged);
 
     static bool isGitTempFile(const QString& filename);
     static bool isGitFile(const QString& filename);
@@ -47,6 +41,4 @@ private:
 
     // command contains the last command started
     int command;
-
-    void processDiff(const QString& diff);
 };
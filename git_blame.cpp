@@ -0,0 +1,150 @@
+#include <QDateTime>
+#include <QPointer>
+
+#include "buffer.h"
+#include "editor.h"
+#include "git_blame.h"
+#include "line_number_area.h"
+
+#include "qdebug.h"
+
+GitBlame::GitBlame(Editor* editor, GitRepository* repository) :
+    QObject(editor),
+    editor(editor),
+    repository(repository),
+    process(nullptr) {
+    Q_ASSERT(editor != nullptr);
+    Q_ASSERT(repository != nullptr);
+}
+
+GitBlame::~GitBlame() {
+    if (this->process != nullptr) {
+        this->process->disconnect(this);
+        this->process->kill();
+        this->process->waitForFinished(500);
+    }
+}
+
+void GitBlame::start() {
+    Buffer* buffer = this->editor->getBuffer();
+    Q_ASSERT(buffer != nullptr);
+
+    // the blame of the text of the editor, saved or not
+    const QByteArray content = buffer->snapshot().toString().toUtf8();
+    this->lines = QVector<QString>(this->editor->document()->blockCount());
+
+    QPointer<GitBlame> self(this);
+    this->repository->catFile("HEAD", [self, content](const GitObject& head) {
+        if (self.isNull()) {
+            return;
+        }
+        self->key = self->repository->relativePath(self->editor->getBuffer()->getFilename()) + ":" +
+                    head.oid + ":" + QString::number(qHash(content));
+        if (self->repository->blame(self->key, &self->lines)) {
+            self->editor->lineNumberArea->update();
+            return;
+        }
+        self->run(content);
+    });
+}
+
+void GitBlame::run(const QByteArray& content) {
+    this->process = new QProcess(this);
+    this->process->setWorkingDirectory(this->repository->getRoot());
+    connect(this->process, &QProcess::readyReadStandardOutput, this, &GitBlame::onReadyRead);
+    connect(this->process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &GitBlame::onFinished);
+    connect(this->process, &QProcess::errorOccurred, this, &GitBlame::onErrorOccurred);
+
+    const QString filename = this->repository->relativePath(this->editor->getBuffer()->getFilename());
+    this->process->start("git", QStringList() << "blame" << "--incremental" << "--contents" << "-" << "--" << filename);
+    this->process->write(content);
+    this->process->closeWriteChannel();
+}
+
+bool GitBlame::commit(int line, GitCommit* commit) const {
+    if (line < 1 || line > this->lines.size() || this->lines[line - 1].isEmpty()) {
+        return false;
+    }
+    return this->repository->commit(this->lines[line - 1], commit);
+}
+
+QString GitBlame::text(int line) const {
+    GitCommit commit;
+    if (!this->commit(line, &commit)) {
+        return QString();
+    }
+    // not committed yet
+    if (commit.oid.count('0') == commit.oid.size()) {
+        return QString();
+    }
+    const QString date = QDateTime::fromSecsSinceEpoch(commit.authorTime).toString("yyyy-MM-dd");
+    return (commit.oid.left(8) + " " + date + " " + commit.author).left(GIT_BLAME_CHARS - 1);
+}
+
+void GitBlame::onReadyRead() {
+    this->buffer.append(this->process->readAllStandardOutput());
+    int start = 0;
+    int lr = 0;
+    while ((lr = this->buffer.indexOf('\n', start)) != -1) {
+        this->readLine(this->buffer.mid(start, lr - start));
+        start = lr + 1;
+    }
+    this->buffer.remove(0, start);
+    this->editor->lineNumberArea->update();
+}
+
+void GitBlame::readLine(const QByteArray& line) {
+    // an entry starts with "<oid> <source line> <line> <lines count>", is
+    // followed by the metadata of the commit the first time it is seen, and
+    // ends with "filename <filename>".
+    if (this->current.oid.isEmpty()) {
+        const QList<QByteArray> fields = line.split(' ');
+        if (fields.size() != 4) {
+            return;
+        }
+        this->current.oid = QString::fromLatin1(fields[0]);
+        int first = fields[2].toInt();
+        int count = fields[3].toInt();
+        for (int i = first; i < first + count && i <= this->lines.size(); i++) {
+            if (i >= 1) {
+                this->lines[i - 1] = this->current.oid;
+            }
+        }
+        return;
+    }
+
+    if (line.startsWith("author ")) {
+        this->current.author = QString::fromUtf8(line.mid(7));
+    } else if (line.startsWith("author-time ")) {
+        this->current.authorTime = line.mid(12).toLongLong();
+    } else if (line.startsWith("summary ")) {
+        this->current.summary = QString::fromUtf8(line.mid(8));
+    } else if (line.startsWith("filename ")) {
+        if (!this->current.author.isEmpty()) {
+            this->repository->cacheCommit(this->current);
+        }
+        this->current = GitCommit();
+    }
+}
+
+void GitBlame::onFinished(int exitCode, QProcess::ExitStatus status) {
+    this->process->deleteLater();
+    this->process = nullptr;
+
+    if (status != QProcess::NormalExit || exitCode != 0) {
+        this->editor->getStatusBar()->setMessage("An error occurred while running git blame.");
+        return;
+    }
+    this->repository->cacheBlame(this->key, this->lines);
+    this->editor->lineNumberArea->update();
+}
+
+void GitBlame::onErrorOccurred(QProcess::ProcessError error) {
+    if (error != QProcess::FailedToStart) {
+        // followed by finished
+        return;
+    }
+    this->process->deleteLater();
+    this->process = nullptr;
+    this->editor->getStatusBar()->setMessage("Can't start git blame.");
+}
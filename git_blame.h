@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QByteArray>
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QVector>
+
+#include "git_repository.h"
+
+// width of the blame gutter, in characters.
+#define GIT_BLAME_CHARS 32
+
+class Editor;
+
+// GitBlame shows the blame of the buffer of an editor in its gutter. It is
+// read from `git blame --incremental` and the gutter is filled while the
+// lines are received. The blame of a given text at a given HEAD is kept by
+// the repository, blaming it again is immediate.
+// The blame does not follow the edits: it is closed by the editor when its
+// text changes.
+class GitBlame : public QObject
+{
+    Q_OBJECT
+public:
+    GitBlame(Editor* editor, GitRepository* repository);
+    ~GitBlame();
+
+    // start blames the current text of the buffer.
+    void start();
+
+    // commit returns in commit the metadata of the commit of the given line
+    // (starting with 1), false if not known yet.
+    bool commit(int line, GitCommit* commit) const;
+
+    // text returns what is shown in the gutter for the given line.
+    QString text(int line) const;
+
+private slots:
+    void onReadyRead();
+    void onFinished(int exitCode, QProcess::ExitStatus status);
+    void onErrorOccurred(QProcess::ProcessError error);
+
+private:
+    // run starts the blame process, once HEAD is known.
+    void run(const QByteArray& content);
+
+    // readLine interprets one line of the incremental output.
+    void readLine(const QByteArray& line);
+
+    Editor* editor;
+    GitRepository* repository;
+    QProcess* process;
+
+    // key of the blame in the repository cache.
+    QString key;
+
+    // oid of the commit of each line.
+    QVector<QString> lines;
+
+    // what has been read from the process and not consumed yet.
+    QByteArray buffer;
+    // commit of the entry being read, its metadata are following the line
+    // of the entry the first time the commit is seen.
+    GitCommit current;
+};
@@ -0,0 +1,271 @@
+#include <QPointer>
+#include <QStringView>
+
+#include <algorithm>
+#include <atomic>
+
+#include "buffer.h"
+#include "editor.h"
+#include "git_gutter.h"
+#include "git_repository.h"
+#include "line_number_area.h"
+#include "window.h"
+
+// GitGutterJob is the diff of a snapshot of the buffer, on the worker.
+struct GitGutterJob {
+    PieceTable text;
+    QVector<size_t> head;
+
+    std::atomic<bool> cancelled;
+
+    QMap<int, int> flags;
+
+    GitGutterJob(const PieceTable& text, const QVector<size_t>& head) :
+        text(text), head(head), cancelled(false) {}
+};
+
+GitGutter::GitGutter(Editor* editor) :
+    QObject(editor),
+    editor(editor),
+    tracked(false) {
+    Q_ASSERT(editor != nullptr);
+
+    this->pool.setMaxThreadCount(1);
+
+    this->refreshTimer = new QTimer(this);
+    this->refreshTimer->setSingleShot(true);
+    this->refreshTimer->setInterval(GIT_GUTTER_DELAY_MS);
+    connect(this->refreshTimer, &QTimer::timeout, this, &GitGutter::refresh);
+
+    // flags of the previous buffer of the editor
+    this->editor->lineNumberArea->clearGitFlags();
+
+    this->reload();
+}
+
+GitGutter::~GitGutter() {
+    this->cancel();
+    this->pool.waitForDone();
+}
+
+void GitGutter::reload() {
+    Buffer* buffer = this->editor->getBuffer();
+    if (buffer == nullptr || buffer->getFilename().isEmpty()) {
+        return;
+    }
+
+    GitRepository* repository = this->editor->getWindow()->getGitRepository(buffer->getFilename());
+    if (repository == nullptr) {
+        return;
+    }
+
+    QPointer<GitGutter> self(this);
+    repository->headBlob(buffer->getFilename(), [self](bool found, const QByteArray& content) {
+        if (self.isNull()) {
+            return;
+        }
+        self->tracked = found;
+        self->head = found ? GitGutter::hashLines(QString::fromUtf8(content)) : QVector<size_t>();
+        self->refresh();
+    });
+}
+
+void GitGutter::onBufferChange() {
+    if (this->tracked) {
+        this->refreshTimer->start();
+    }
+}
+
+void GitGutter::cancel() {
+    if (this->job != nullptr) {
+        this->job->cancelled = true;
+        this->job = nullptr;
+    }
+}
+
+void GitGutter::refresh() {
+    this->cancel();
+
+    Buffer* buffer = this->editor->getBuffer();
+    if (buffer == nullptr || !this->tracked) {
+        if (!this->editor->lineNumberArea->gitFlags.isEmpty()) {
+            this->editor->lineNumberArea->clearGitFlags();
+            this->editor->lineNumberArea->update();
+        }
+        return;
+    }
+
+    std::shared_ptr<GitGutterJob> job = std::make_shared<GitGutterJob>(buffer->snapshot(), this->head);
+    this->job = job;
+    this->pool.start([this, job]() {
+        const QVector<size_t> lines = GitGutter::hashLines(job->text.toString());
+        if (job->cancelled) {
+            return;
+        }
+        job->flags = GitGutter::diff(job->head, lines);
+        if (!job->cancelled) {
+            QMetaObject::invokeMethod(this, [this, job]() { this->onWorkDone(job); }, Qt::QueuedConnection);
+        }
+    });
+}
+
+void GitGutter::onWorkDone(std::shared_ptr<GitGutterJob> job) {
+    if (job != this->job) {
+        // cancelled in the meantime
+        return;
+    }
+    this->job = nullptr;
+
+    this->editor->lineNumberArea->gitFlags = job->flags;
+    this->editor->lineNumberArea->update();
+}
+
+// diff
+// ----------------------
+
+QVector<size_t> GitGutter::hashLines(const QString& text) {
+    QVector<size_t> rv;
+    QStringView view(text);
+    int start = 0;
+    while (true) {
+        int lr = view.indexOf('\n', start);
+        QStringView line = view.mid(start, lr == -1 ? -1 : lr - start);
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        rv.append(qHash(line));
+        if (lr == -1) {
+            break;
+        }
+        start = lr + 1;
+    }
+    return rv;
+}
+
+// GitDiffOp are the operations of the script editing a into b.
+enum GitDiffOp {
+    GitDiffEqual,
+    GitDiffInsert,
+    GitDiffDelete,
+};
+
+QMap<int, int> GitGutter::diff(const QVector<size_t>& a, const QVector<size_t>& b) {
+    QMap<int, int> flags;
+
+    // most of the time only a few lines in the middle have changed
+    int prefix = 0;
+    while (prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix]) {
+        prefix++;
+    }
+    int suffix = 0;
+    while (suffix < a.size() - prefix && suffix < b.size() - prefix &&
+           a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) {
+        suffix++;
+    }
+
+    const size_t* x = a.constData() + prefix;
+    const size_t* y = b.constData() + prefix;
+    const int n = a.size() - prefix - suffix;
+    const int m = b.size() - prefix - suffix;
+    if (n == 0 && m == 0) {
+        return flags;
+    }
+
+    // Myers: v[k] is the furthest x reached on the diagonal k, trace[d] the
+    // diagonals -d-1 to d+1 of v before the step d, to backtrack.
+    const int max = n + m;
+    QVector<int> v(2 * max + 3, 0);
+    QVector<QVector<int>> trace;
+    int d = 0;
+    bool found = false;
+    for (; d <= max && d <= GIT_GUTTER_MAX_EDITS && !found; d++) {
+        trace.append(QVector<int>(v.constBegin() + max + 1 - d - 1, v.constBegin() + max + 1 + d + 2));
+        for (int k = -d; k <= d; k += 2) {
+            int i = max + 1 + k;
+            int px = (k == -d || (k != d && v[i - 1] < v[i + 1])) ? v[i + 1] : v[i - 1] + 1;
+            int py = px - k;
+            while (px < n && py < m && x[px] == y[py]) {
+                px++;
+                py++;
+            }
+            v[i] = px;
+            if (px >= n && py >= m) {
+                found = true;
+                break;
+            }
+        }
+    }
+
+    if (!found) {
+        // too many changes, everything in between is modified
+        for (int line = 0; line < m; line++) {
+            flags[prefix + line + 1] = GIT_FLAG_BOTH;
+        }
+        if (m == 0) {
+            flags[qBound(1, prefix + 1, qMax(1, b.size()))] = GIT_FLAG_REMOVED;
+        }
+        return flags;
+    }
+
+    // backtrack from the end to the start
+    QVector<GitDiffOp> ops;
+    QVector<int> positions; // line of b where the operation applies
+    int px = n, py = m;
+    for (int step = trace.size() - 1; step >= 0; step--) {
+        const QVector<int>& tv = trace[step];
+        auto at = [&tv, step](int k) { return tv[k + step + 1]; };
+        int k = px - py;
+        int prevK = (k == -step || (k != step && at(k - 1) < at(k + 1))) ? k + 1 : k - 1;
+        int prevX = at(prevK);
+        int prevY = prevX - prevK;
+        while (px > prevX && py > prevY) {
+            px--;
+            py--;
+            ops.append(GitDiffEqual);
+            positions.append(py);
+        }
+        if (step > 0) {
+            if (px == prevX) {
+                ops.append(GitDiffInsert);
+                positions.append(prevY);
+            } else {
+                ops.append(GitDiffDelete);
+                positions.append(prevY);
+            }
+        }
+        px = prevX;
+        py = prevY;
+    }
+    std::reverse(ops.begin(), ops.end());
+    std::reverse(positions.begin(), positions.end());
+
+    // group the operations by hunk
+    int i = 0;
+    while (i < ops.size()) {
+        if (ops[i] == GitDiffEqual) {
+            i++;
+            continue;
+        }
+        int deleted = 0;
+        int at = positions[i];
+        QVector<int> inserted;
+        while (i < ops.size() && ops[i] != GitDiffEqual) {
+            if (ops[i] == GitDiffDelete) {
+                deleted++;
+            } else {
+                inserted.append(positions[i]);
+            }
+            i++;
+        }
+        if (inserted.isEmpty()) {
+            // on the line following the removed ones
+            flags[qBound(1, prefix + at + 1, qMax(1, b.size()))] = GIT_FLAG_REMOVED;
+            continue;
+        }
+        for (int line : inserted) {
+            flags[prefix + line + 1] = deleted > 0 ? GIT_FLAG_BOTH : GIT_FLAG_ADDED;
+        }
+    }
+
+    return flags;
+}
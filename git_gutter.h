@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QMap>
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+#include <memory>
+
+// delay after an edit before computing the diff again.
+#define GIT_GUTTER_DELAY_MS 300
+// past this many edits, the lines between the first and the last changed
+// ones are all considered modified.
+#define GIT_GUTTER_MAX_EDITS 1000
+
+class Editor;
+class Window;
+
+struct GitGutterJob;
+
+// GitGutter computes the git flags of the line number area of an editor:
+// the lines of the buffer are compared with the ones of the file in HEAD,
+// read once from the repository. The diff is computed again on a worker
+// thread after the edits, the flags are then including what has not been
+// saved yet.
+class GitGutter : public QObject
+{
+    Q_OBJECT
+public:
+    GitGutter(Editor* editor);
+    ~GitGutter();
+
+    // reload reads again the file in HEAD, e.g. after a commit, and computes
+    // the flags.
+    void reload();
+
+    // onBufferChange computes the flags again a bit after the last change of
+    // the buffer.
+    void onBufferChange();
+
+    // diff returns the flags (see GIT_FLAG_*) of the lines of b, starting
+    // with 1, b being a edited version of a. The lines are compared through
+    // their hash.
+    static QMap<int, int> diff(const QVector<size_t>& a, const QVector<size_t>& b);
+
+    // hashLines returns the hashes of the lines of the given text.
+    static QVector<size_t> hashLines(const QString& text);
+
+private slots:
+    void refresh();
+
+private:
+    void cancel();
+    void onWorkDone(std::shared_ptr<GitGutterJob> job);
+
+    Editor* editor;
+
+    // hashes of the lines of the file in HEAD, only meaningful if tracked.
+    QVector<size_t> head;
+    bool tracked;
+
+    QTimer* refreshTimer;
+    QThreadPool pool;
+    std::shared_ptr<GitGutterJob> job;
+};
@@ -0,0 +1,260 @@
+#include <QDir>
+#include <QFileInfo>
+
+#include "git_repository.h"
+
+#include "qdebug.h"
+
+GitRepository::GitRepository(const QString& root, QObject* parent) :
+    QObject(parent),
+    root(root),
+    catFileProcess(nullptr),
+    contentSize(-1) {
+}
+
+GitRepository::~GitRepository() {
+    if (this->catFileProcess != nullptr) {
+        this->catFileProcess->disconnect(this);
+        this->catFileProcess->closeWriteChannel();
+        if (!this->catFileProcess->waitForFinished(500)) {
+            this->catFileProcess->kill();
+            this->catFileProcess->waitForFinished(500);
+        }
+    }
+}
+
+QString GitRepository::findRoot(const QString& filename) {
+    QFileInfo fi(filename);
+    QDir dir(fi.isDir() ? fi.canonicalFilePath() : fi.canonicalPath());
+    if (!dir.exists()) {
+        return QString();
+    }
+    do {
+        // .git is a file in the worktrees and submodules
+        if (QFileInfo::exists(dir.filePath(".git"))) {
+            return dir.canonicalPath();
+        }
+    } while (dir.cdUp());
+    return QString();
+}
+
+QString GitRepository::relativePath(const QString& filename) const {
+    return QDir(this->root).relativeFilePath(QFileInfo(filename).canonicalFilePath());
+}
+
+void GitRepository::start() {
+    if (this->catFileProcess != nullptr && this->catFileProcess->state() != QProcess::NotRunning) {
+        return;
+    }
+
+    if (this->catFileProcess != nullptr) {
+        // may be called from one of its signals
+        this->catFileProcess->disconnect(this);
+        this->catFileProcess->deleteLater();
+    }
+    this->catFileProcess = new QProcess(this);
+    this->catFileProcess->setWorkingDirectory(this->root);
+    connect(this->catFileProcess, &QProcess::readyReadStandardOutput, this, &GitRepository::onReadyRead);
+    connect(this->catFileProcess, &QProcess::errorOccurred, this, &GitRepository::onErrorOccurred);
+
+    this->buffer.clear();
+    this->contentSize = -1;
+    this->catFileProcess->start("git", QStringList() << "cat-file" << "--batch");
+}
+
+void GitRepository::catFile(const QString& object, std::function<void(const GitObject& object)> callback) {
+    if (object.contains('\n')) {
+        GitObject missing;
+        missing.found = false;
+        callback(missing);
+        return;
+    }
+    this->start();
+
+    CatFileRequest request;
+    request.object = object;
+    request.callback = callback;
+    this->pending.append(request);
+    this->catFileProcess->write(object.toUtf8() + '\n');
+}
+
+void GitRepository::headBlob(const QString& filename, std::function<void(bool found, const QByteArray& content)> callback) {
+    this->catFile("HEAD:" + this->relativePath(filename), [callback](const GitObject& object) {
+        callback(object.found && object.type == "blob", object.content);
+    });
+}
+
+void GitRepository::onReadyRead() {
+    this->buffer.append(this->catFileProcess->readAllStandardOutput());
+
+    while (!this->pending.isEmpty()) {
+        if (this->contentSize == -1) {
+            // header: "<oid> <type> <size>" or "<object> missing"
+            int lr = this->buffer.indexOf('\n');
+            if (lr == -1) {
+                return;
+            }
+            const QByteArray header = this->buffer.left(lr);
+            this->buffer.remove(0, lr + 1);
+
+            const QList<QByteArray> fields = header.split(' ');
+            if (fields.size() != 3 || header.endsWith(" missing")) {
+                // missing or ambiguous
+                CatFileRequest request = this->pending.takeFirst();
+                GitObject missing;
+                missing.found = false;
+                request.callback(missing);
+                continue;
+            }
+            this->current.found = true;
+            this->current.oid = QString::fromLatin1(fields[0]);
+            this->current.type = QString::fromLatin1(fields[1]);
+            this->contentSize = fields[2].toLongLong();
+        }
+
+        // the content is followed by a line return
+        if (this->buffer.size() < this->contentSize + 1) {
+            return;
+        }
+        GitObject object = this->current;
+        object.content = this->buffer.left(this->contentSize);
+        this->buffer.remove(0, this->contentSize + 1);
+        this->contentSize = -1;
+
+        CatFileRequest request = this->pending.takeFirst();
+        request.callback(object);
+    }
+}
+
+void GitRepository::onErrorOccurred(QProcess::ProcessError error) {
+    qWarning() << "GitRepository::onErrorOccurred:" << this->root << error;
+    // started again on the next request
+    this->failAll();
+}
+
+void GitRepository::failAll() {
+    QList<CatFileRequest> requests = this->pending;
+    this->pending.clear();
+    this->buffer.clear();
+    this->contentSize = -1;
+    GitObject missing;
+    missing.found = false;
+    for (const CatFileRequest& request : requests) {
+        request.callback(missing);
+    }
+}
+
+// commits
+// ----------------------
+
+void GitRepository::show(const QString& revision, std::function<void(bool ok, const QString& oid, const QByteArray& text)> callback) {
+    this->catFile(revision + "^{commit}", [this, callback](const GitObject& object) {
+        if (!object.found || object.type != "commit") {
+            callback(false, QString(), QByteArray());
+            return;
+        }
+        this->cacheCommit(GitRepository::parseCommit(object.oid, object.content));
+
+        for (int i = 0; i < this->shows.size(); i++) {
+            if (this->shows[i].first == object.oid) {
+                callback(true, object.oid, this->shows[i].second);
+                return;
+            }
+        }
+
+        const QString oid = object.oid;
+        QProcess* process = new QProcess(this);
+        process->setWorkingDirectory(this->root);
+        connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, process, oid, callback](int exitCode, QProcess::ExitStatus status) {
+            const QByteArray text = process->readAllStandardOutput();
+            process->deleteLater();
+            if (status != QProcess::NormalExit || exitCode != 0) {
+                callback(false, oid, QByteArray());
+                return;
+            }
+            this->shows.append(qMakePair(oid, text));
+            while (this->shows.size() > GIT_SHOW_CACHE_SIZE) {
+                this->shows.removeFirst();
+            }
+            callback(true, oid, text);
+        });
+        connect(process, &QProcess::errorOccurred, this, [process, oid, callback](QProcess::ProcessError error) {
+            // the other errors are followed by finished
+            if (error == QProcess::FailedToStart) {
+                process->deleteLater();
+                callback(false, oid, QByteArray());
+            }
+        });
+        process->start("git", QStringList() << "show" << oid);
+    });
+}
+
+bool GitRepository::commit(const QString& oid, GitCommit* commit) const {
+    Q_ASSERT(commit != nullptr);
+    auto it = this->commits.constFind(oid);
+    if (it == this->commits.constEnd()) {
+        return false;
+    }
+    *commit = it.value();
+    return true;
+}
+
+void GitRepository::cacheCommit(const GitCommit& commit) {
+    this->commits[commit.oid] = commit;
+}
+
+GitCommit GitRepository::parseCommit(const QString& oid, const QByteArray& content) {
+    GitCommit commit;
+    commit.oid = oid;
+    commit.authorTime = 0;
+
+    // headers, an empty line, then the message
+    int start = 0;
+    while (start < content.size()) {
+        int lr = content.indexOf('\n', start);
+        if (lr == -1) {
+            lr = content.size();
+        }
+        const QByteArray line = content.mid(start, lr - start);
+        start = lr + 1;
+        if (line.isEmpty()) {
+            break;
+        }
+        if (line.startsWith("author ")) {
+            // author Name <mail> time tz
+            int mail = line.lastIndexOf('<');
+            int end = line.lastIndexOf('>');
+            if (mail > 7 && end > mail) {
+                commit.author = QString::fromUtf8(line.mid(7, mail - 7)).trimmed();
+                commit.authorTime = line.mid(end + 1).trimmed().split(' ').first().toLongLong();
+            }
+        }
+    }
+    int lr = content.indexOf('\n', start);
+    commit.summary = QString::fromUtf8(content.mid(start, lr == -1 ? -1 : lr - start)).trimmed();
+    return commit;
+}
+
+bool GitRepository::blame(const QString& key, QVector<QString>* lines) const {
+    Q_ASSERT(lines != nullptr);
+    for (int i = 0; i < this->blames.size(); i++) {
+        if (this->blames[i].first == key) {
+            *lines = this->blames[i].second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void GitRepository::cacheBlame(const QString& key, const QVector<QString>& lines) {
+    for (int i = 0; i < this->blames.size(); i++) {
+        if (this->blames[i].first == key) {
+            this->blames.removeAt(i);
+            break;
+        }
+    }
+    this->blames.append(qMakePair(key, lines));
+    while (this->blames.size() > GIT_BLAME_CACHE_SIZE) {
+        this->blames.removeFirst();
+    }
+}
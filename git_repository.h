@@ -0,0 +1,122 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QProcess>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+// amount of `git show` outputs kept in memory.
+#define GIT_SHOW_CACHE_SIZE 16
+// amount of blames kept in memory.
+#define GIT_BLAME_CACHE_SIZE 8
+
+// GitObject is an object read from the repository.
+typedef struct GitObject {
+    bool found;
+    QString oid;
+    QString type;
+    QByteArray content;
+} GitObject;
+
+// GitCommit is the metadata of a commit.
+typedef struct GitCommit {
+    QString oid;
+    QString author;
+    // seconds since epoch
+    qint64 authorTime;
+    QString summary;
+} GitCommit;
+
+// GitRepository reads the objects of a git repository through a single
+// `git cat-file --batch` process, started on the first read and kept
+// running: reading an object does not cost a new process.
+// The commits being immutable, their metadata, their `git show` and the
+// blames computed at a given HEAD are cached.
+class GitRepository : public QObject
+{
+    Q_OBJECT
+public:
+    GitRepository(const QString& root, QObject* parent);
+    ~GitRepository();
+
+    // findRoot returns the root of the repository containing the given file,
+    // an empty string if it is not in a repository.
+    static QString findRoot(const QString& filename);
+
+    const QString& getRoot() const { return this->root; }
+
+    // relativePath returns the path of the given file in the repository.
+    QString relativePath(const QString& filename) const;
+
+    // catFile reads the given object, e.g. "HEAD:path/to/file", and calls
+    // callback with it once it has been read. The object is not found if it
+    // does not exist or can't be read.
+    void catFile(const QString& object, std::function<void(const GitObject& object)> callback);
+
+    // headBlob reads the version of the given file in HEAD.
+    void headBlob(const QString& filename, std::function<void(bool found, const QByteArray& content)> callback);
+
+    // show calls callback with the output of `git show` for the given
+    // revision, ran only the first time the commit is shown.
+    void show(const QString& revision, std::function<void(bool ok, const QString& oid, const QByteArray& text)> callback);
+
+    // commit returns in commit the metadata of the given commit, if already
+    // known.
+    bool commit(const QString& oid, GitCommit* commit) const;
+
+    // cacheCommit stores the metadata of a commit.
+    void cacheCommit(const GitCommit& commit);
+
+    // parseCommit reads the metadata of a commit object.
+    static GitCommit parseCommit(const QString& oid, const QByteArray& content);
+
+    // blame returns in lines the blame stored with the given key, if any.
+    bool blame(const QString& key, QVector<QString>* lines) const;
+
+    // cacheBlame stores the commit of each line of a blame.
+    void cacheBlame(const QString& key, const QVector<QString>& lines);
+
+private slots:
+    void onReadyRead();
+    void onErrorOccurred(QProcess::ProcessError error);
+
+private:
+    typedef struct CatFileRequest {
+        QString object;
+        std::function<void(const GitObject& object)> callback;
+    } CatFileRequest;
+
+    // start starts the cat-file process if it is not running.
+    void start();
+
+    // failAll calls the callbacks of all the pending requests as failed.
+    void failAll();
+
+    QString root;
+
+    QProcess* catFileProcess;
+    // requests written to the process, in order, waiting for their object.
+    QList<CatFileRequest> pending;
+    // what has been read from the process and not consumed yet.
+    QByteArray buffer;
+    // size of the content of the object being read, -1 while its header
+    // has not been read.
+    qint64 contentSize;
+    // header of the object being read.
+    GitObject current;
+
+    // metadata of the commits seen, they are small and never change.
+    QHash<QString, GitCommit> commits;
+
+    // outputs of `git show` by commit, the oldest first.
+    QList<QPair<QString, QByteArray>> shows;
+
+    // blames by key, the oldest first.
+    QList<QPair<QString, QVector<QString>>> blames;
+};
@@ -0,0 +1,132 @@
+#include <QFile>
+
+#include "gitignore.h"
+
+GitIgnore::GitIgnore() {
+}
+
+GitIgnore::GitIgnore(const QString& dir, const QString& filepath) :
+    dir(dir) {
+    QFile file(filepath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine());
+        // trailing spaces are ignored unless escaped, leading ones are part of the pattern
+        while (line.endsWith('\n') || line.endsWith('\r') ||
+                (line.endsWith(' ') && !line.endsWith("\\ "))) {
+            line.chop(1);
+        }
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        Rule rule;
+        rule.negate = false;
+        rule.dirOnly = false;
+
+        if (line.startsWith('!')) {
+            rule.negate = true;
+            line.remove(0, 1);
+        } else if (line.startsWith("\\!") || line.startsWith("\\#")) {
+            line.remove(0, 1);
+        }
+
+        if (line.endsWith('/')) {
+            rule.dirOnly = true;
+            line.chop(1);
+        }
+
+        // a pattern without any slash matches the name at any level,
+        // otherwise it is relative to the directory of the .gitignore.
+        rule.basename = !line.contains('/');
+        if (line.startsWith('/')) {
+            line.remove(0, 1);
+        }
+
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        rule.rx = QRegularExpression("^" + GitIgnore::toRegularExpression(line) + "$");
+        if (!rule.rx.isValid()) {
+            continue;
+        }
+        this->rules.append(rule);
+    }
+}
+
+QString GitIgnore::toRegularExpression(const QString& pattern) {
+    QString rv;
+    for (int i = 0; i < pattern.size(); i++) {
+        QChar c = pattern.at(i);
+        if (c == '*') {
+            if (i + 1 < pattern.size() && pattern.at(i + 1) == '*') {
+                // "**/" matches any amount of directories, "**" anything
+                if (i + 2 < pattern.size() && pattern.at(i + 2) == '/') {
+                    rv += "(?:.*/)?";
+                    i += 2;
+                } else {
+                    rv += ".*";
+                    i += 1;
+                }
+            } else {
+                rv += "[^/]*";
+            }
+        } else if (c == '?') {
+            rv += "[^/]";
+        } else if (c == '[') {
+            int end = pattern.indexOf(']', i + 1);
+            if (end == -1) {
+                rv += "\\[";
+                continue;
+            }
+            QString set = pattern.mid(i + 1, end - i - 1);
+            if (set.startsWith('!')) {
+                set[0] = '^';
+            }
+            rv += "[" + set + "]";
+            i = end;
+        } else if (c == '\\' && i + 1 < pattern.size()) {
+            rv += QRegularExpression::escape(QString(pattern.at(i + 1)));
+            i++;
+        } else {
+            rv += QRegularExpression::escape(QString(c));
+        }
+    }
+    return rv;
+}
+
+int GitIgnore::match(const QString& path, bool isDir) const {
+    if (!path.startsWith(this->dir)) {
+        return 0;
+    }
+
+    QString relative = path.mid(this->dir.size());
+    QString name = relative.mid(relative.lastIndexOf('/') + 1);
+
+    // the last matching rule decides
+    for (int i = this->rules.size() - 1; i >= 0; i--) {
+        const Rule& rule = this->rules.at(i);
+        if (rule.dirOnly && !isDir) {
+            continue;
+        }
+        if (rule.rx.match(rule.basename ? name : relative).hasMatch()) {
+            return rule.negate ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+bool GitIgnore::isIgnored(const QList<GitIgnore>& ignores, const QString& path, bool isDir) {
+    // rules of the deepest files have the precedence
+    for (int i = ignores.size() - 1; i >= 0; i--) {
+        int rv = ignores.at(i).match(path, isDir);
+        if (rv != 0) {
+            return rv > 0;
+        }
+    }
+    return false;
+}
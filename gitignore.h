@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+
+// GitIgnore contains the rules of one .gitignore file.
+class GitIgnore
+{
+public:
+    GitIgnore();
+
+    // GitIgnore reads the rules of the given file. dir is the directory
+    // containing this file, relative to the root of the repository, it
+    // is empty for the root directory or ends with a '/'.
+    GitIgnore(const QString& dir, const QString& filepath);
+
+    bool isEmpty() const { return this->rules.isEmpty(); }
+
+    // match returns 1 if the given path (relative to the root of the
+    // repository) is ignored by these rules, -1 if a negated rule explicitly
+    // includes it and 0 if no rule is concerning this path.
+    int match(const QString& path, bool isDir) const;
+
+    // isIgnored looks in the given list of GitIgnore, ordered from the root to
+    // the deepest directory, whether the path is ignored.
+    static bool isIgnored(const QList<GitIgnore>& ignores, const QString& path, bool isDir);
+
+private:
+    typedef struct Rule {
+        QRegularExpression rx;
+        bool negate;
+        // dirOnly is true when the rule is only matching directories.
+        bool dirOnly;
+        // basename is true when the rule is matching the name of the entry
+        // at any level, false when it is matching its path from dir.
+        bool basename;
+    } Rule;
+
+    // toRegularExpression converts a glob pattern to a regular expression.
+    static QString toRegularExpression(const QString& pattern);
+
+    QString dir;
+    QList<Rule> rules;
+};
@@ -1,5 +1,8 @@
 #include <QByteArray>
+#include <QDir>
 #include <QGridLayout>
+#include <QHash>
+#include <QSettings>
 
 #include "grep.h"
 #include "window.h"
@@ -12,7 +15,11 @@ Grep::Grep(Window* window) :
     Q_ASSERT(window != nullptr);
 
     this->process = nullptr;
+    this->engine = new GrepEngine(this);
     this->setFont(Editor::getFont());
+
+    connect(this->engine, &GrepEngine::results, this, &Grep::onEngineResults);
+    connect(this->engine, &GrepEngine::finished, this, &Grep::onEngineFinished);
 }
 
 void Grep::show() {
@@ -35,7 +42,7 @@ void Grep::hide() {
         delete this->process;
         this->process = nullptr;
     }
-    this->resultsCount = 0;
+    this->engine->cancel();
     this->window->getRefWidget()->hide();
     QWidget::hide();
 }
@@ -45,12 +52,9 @@ void Grep::onResults() {
         buff.append(data);
         if (buff.endsWith("\n")) {
             this->readAndAppendResult(buff);
-            this->resultsCount++;
             buff.clear();
         }
     }
-
-    this->window->getRefWidget()->setLabelText(" " + QString::number(this->resultsCount) + " results");
 }
 
 void Grep::onErrorOccurred() {
@@ -66,8 +70,21 @@ void Grep::onFinished() {
         this->process = nullptr;
     }
 
+    this->showResults();
+}
+
+void Grep::onEngineResults(const QList<GrepMatch>& matches) {
+    for (const GrepMatch& match : matches) {
+        this->window->getRefWidget()->insert(match.file, QString::number(match.line), match.text.trimmed());
+    }
+}
+
+void Grep::onEngineFinished() {
+    this->showResults();
+}
+
+void Grep::showResults() {
     this->window->getRefWidget()->fitContent();
-    this->window->getRefWidget()->sort(0, Qt::AscendingOrder);
     this->window->getRefWidget()->selectFirst();
 }
 
@@ -76,21 +93,30 @@ void Grep::keyPressEvent(QKeyEvent* event) {
 }
 
 void Grep::readAndAppendResult(const QString& result) {
-    // first two are the file and the line number
-    QStringList parts = result.split(":").mid(0, 2);
-    // the rest is the result
-    QString line = result.section(":", 2);
-    parts << line.trimmed();
-
-    if (parts[0].startsWith("./")) {
-        parts[0] = parts[0].remove(0, 2);
+    // the file is followed by a NUL byte (--null), then the line number and
+    // the line: the file and the line can both contain ':'
+    int nul = result.indexOf(QChar('\0'));
+    if (nul == -1) {
+        return;
     }
+    int colon = result.indexOf(':', nul + 1);
+    if (colon == -1) {
+        return;
+    }
+
+    QString file = result.left(nul);
+    QString lineNumber = result.mid(nul + 1, colon - nul - 1);
+    QString line = result.mid(colon + 1).trimmed();
 
-    if (!parts[0].startsWith(this->window->getBaseDir())) {
-        parts[0] = this->window->getBaseDir() + parts[0];
+    if (file.startsWith("./")) {
+        file = file.remove(0, 2);
     }
 
-    this->window->getRefWidget()->insert(parts[0], parts[1], parts[2]);
+    if (!file.startsWith(this->window->getBaseDir())) {
+        file = this->window->getBaseDir() + file;
+    }
+
+    this->window->getRefWidget()->insert(file, lineNumber, line);
 }
 
 int Grep::grep(const QString& string, const QString& baseDir) {
@@ -99,6 +125,11 @@ int Grep::grep(const QString& string, const QString& baseDir) {
     return rv;
 }
 
+bool Grep::useRg() {
+    QSettings* settings = this->window->getProjectSettings();
+    return settings != nullptr && settings->value("grep").toString() == "rg";
+}
+
 // TODO(remy): support case insensitive
 int Grep::grep(const QString& string, const QString& baseDir, const QString& target) {
     if (this->process != nullptr) {
@@ -106,6 +137,7 @@ int Grep::grep(const QString& string, const QString& baseDir, const QString& tar
         delete this->process;
         this->process = nullptr;
     }
+    this->engine->cancel();
 
     if (string.size() == 0 || string.trimmed().size() == 0) {
         this->window->getStatusBar()->setMessage("can't start a search with an empty string.");
@@ -113,9 +145,39 @@ int Grep::grep(const QString& string, const QString& baseDir, const QString& tar
     }
 
     // reinit
-    this->resultsCount = 0;
     this->window->getRefWidget()->clear();
 
+    if (this->useRg()) {
+        return this->startRg(string, baseDir, target);
+    }
+
+    // the modified buffers are searched instead of their files
+    QHash<QString, PieceTable> buffers;
+    for (Editor* editor : this->window->getEditors()) {
+        Buffer* buffer = editor->getBuffer();
+        if (buffer->modified && buffer->getType() == BUFFER_TYPE_FILE && !buffer->isHuge()) {
+            buffers.insert(buffer->getId(), buffer->snapshot());
+        }
+    }
+
+    // the files of the base dir are already known by the index
+    FilesIndex* index = this->window->getFilesIndex();
+    QStringList files;
+    QString dir = baseDir;
+    if (target.isEmpty() && index->isReady() && QDir::cleanPath(baseDir) + "/" == index->getRoot()) {
+        files = index->getFiles();
+        dir = index->getRoot();
+    }
+
+    if (!this->engine->start(string, dir, target, files, buffers)) {
+        this->window->getStatusBar()->setMessage("invalid regular expression: " + string);
+        return -1;
+    }
+
+    return 0;
+}
+
+int Grep::startRg(const QString& string, const QString& baseDir, const QString& target) {
     // create and init the process
     this->process = new QProcess(this);
     QFileInfo baseDirInfo(baseDir);
@@ -125,7 +187,7 @@ int Grep::grep(const QString& string, const QString& baseDir, const QString& tar
     QString t = target;
     if (t.size() == 0) { t = "."; }
     QStringList list;
-    list << "--with-filename" << "--line-number" << string << t;
+    list << "--with-filename" << "--null" << "--line-number" << string << t;
 
     // run ripgrep
     this->process->start("rg", list);
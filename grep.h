@@ -7,6 +7,7 @@
 #include <QString>
 #include <QWidget>
 
+#include "grep_engine.h"
 #include "references_widget.h"
 
 class Window;
@@ -18,7 +19,9 @@ public:
     Grep(Window* window);
 
     // baseDir is the directory from which the command is run.
-    // target is the target in which ripgrep should look for matches.
+    // target is the target in which to look for matches.
+    // The search is done by the GrepEngine, or by ripgrep if the project
+    // has the setting grep=rg.
     // Returns 0 if a grep has been started, -1 otherwise.
     int grep(const QString& string, const QString& baseDir, const QString& target);
     int grep(const QString& string, const QString& baseDir);
@@ -26,7 +29,7 @@ public:
     // openSelection opens the needed buffer as the proper line.
     void openSelection();
 
-    // TODO(remy): comment me
+    // readAndAppendResult parses a line of ripgrep output and adds it to the results.
     void readAndAppendResult(const QString& result);
 
     void show();
@@ -37,17 +40,28 @@ public slots:
     void onErrorOccurred();
     void onResults();
     void onFinished();
+    void onEngineResults(const QList<GrepMatch>& matches);
+    void onEngineFinished();
 
 protected:
     void keyPressEvent(QKeyEvent* event);
 
 private:
+    // useRg returns true if ripgrep should be used instead of the GrepEngine.
+    bool useRg();
+
+    // startRg starts ripgrep, see grep.
+    int startRg(const QString& string, const QString& baseDir, const QString& target);
+
+    // showResults is called when the search is done.
+    void showResults();
+
     Window* window;
 
     ReferencesWidget *refWidget;
     QGridLayout *layout;
 
+    GrepEngine* engine;
     QProcess* process;
     QString buff;
-    int resultsCount;
 };
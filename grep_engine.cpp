@@ -0,0 +1,439 @@
+#include <QByteArrayMatcher>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QRegularExpression>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <cstring>
+
+#include "files_index.h"
+#include "gitignore.h"
+#include "grep_engine.h"
+
+#include "qdebug.h"
+
+// GrepDir is a directory to walk (relative to the root of the search) with
+// the .gitignore rules applying to it.
+typedef QPair<QString, QList<GitIgnore>> GrepDir;
+
+// GrepSearch is the state of a search shared by the workers.
+struct GrepSearch {
+    // root of the search, ending with a '/'
+    QString root;
+    QRegularExpression rx;
+    // literal part of the pattern which has to be in a line for it to match
+    QByteArray literal;
+    QByteArrayMatcher matcher;
+    QHash<QString, PieceTable> buffers;
+    std::atomic<bool> cancelled;
+
+    // everything below is protected by the mutex.
+    QMutex mutex;
+    QWaitCondition wakeUp;
+    QList<GrepDir> dirs;
+    // files to search, relative to the root
+    QStringList files;
+    // workers currently walking a directory or searching files
+    int busy;
+    // workers not done yet
+    int workers;
+    // matches not sent yet
+    QList<GrepMatch> results;
+    int count;
+};
+
+GrepEngine::GrepEngine(QObject* parent) :
+    QObject(parent) {
+    this->pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+
+    this->flushTimer = new QTimer(this);
+    this->flushTimer->setInterval(GREP_ENGINE_FLUSH_INTERVAL_MS);
+    connect(this->flushTimer, &QTimer::timeout, this, &GrepEngine::onFlush);
+}
+
+GrepEngine::~GrepEngine() {
+    this->cancel();
+    this->pool.waitForDone();
+}
+
+void GrepEngine::cancel() {
+    if (this->search == nullptr) {
+        return;
+    }
+    QMutexLocker locker(&this->search->mutex);
+    this->search->cancelled = true;
+    this->search->wakeUp.wakeAll();
+    locker.unlock();
+    this->search = nullptr;
+    this->flushTimer->stop();
+}
+
+QString GrepEngine::requiredLiteral(const QString& pattern) {
+    // flags, lookarounds, etc. could make the literal irrelevant
+    if (pattern.contains("(?")) {
+        return "";
+    }
+
+    QString best;
+    QString current;
+    int depth = 0;
+
+    auto flush = [&best, &current]() {
+        if (current.size() > best.size()) {
+            best = current;
+        }
+        current.clear();
+    };
+
+    for (int i = 0; i < pattern.size(); i++) {
+        QChar c = pattern.at(i);
+        if (c == '\\') {
+            if (i + 1 < pattern.size() && !pattern.at(i + 1).isLetterOrNumber()) {
+                // escaped punctuation is a literal
+                if (depth == 0) {
+                    current += pattern.at(i + 1);
+                }
+            } else {
+                // classes of chars, anchors, backreferences...
+                flush();
+            }
+            i++;
+            continue;
+        }
+        if (c == '[') {
+            flush();
+            // skip the whole class, a ']' right after the '[' is part of it
+            int j = i + 1;
+            if (j < pattern.size() && pattern.at(j) == '^') { j++; }
+            if (j < pattern.size() && pattern.at(j) == ']') { j++; }
+            while (j < pattern.size() && pattern.at(j) != ']') {
+                if (pattern.at(j) == '\\') { j++; }
+                j++;
+            }
+            i = j;
+            continue;
+        }
+        if (c == '(') {
+            // groups may be optional or repeated, their content is ignored
+            flush();
+            depth++;
+            continue;
+        }
+        if (c == ')') {
+            depth = qMax(0, depth - 1);
+            continue;
+        }
+        if (c == '|') {
+            if (depth == 0) {
+                // none of the alternatives is required
+                return "";
+            }
+            continue;
+        }
+        if (c == '?' || c == '*' || c == '{') {
+            // the previous char is optional
+            if (!current.isEmpty()) {
+                current.chop(1);
+            }
+            flush();
+            if (c == '{') {
+                int end = pattern.indexOf('}', i);
+                if (end != -1) {
+                    i = end;
+                }
+            }
+            continue;
+        }
+        if (c == '+' || c == '.' || c == '^' || c == '$') {
+            flush();
+            continue;
+        }
+        if (depth == 0) {
+            current += c;
+        }
+    }
+    flush();
+
+    return best;
+}
+
+bool GrepEngine::start(const QString& pattern, const QString& dir, const QString& target,
+                       const QStringList& files, const QHash<QString, PieceTable>& buffers) {
+    this->cancel();
+
+    QRegularExpression rx(pattern);
+    if (!rx.isValid()) {
+        return false;
+    }
+
+    std::shared_ptr<GrepSearch> search = std::make_shared<GrepSearch>();
+    search->root = QFileInfo(dir).canonicalFilePath();
+    if (!search->root.endsWith("/")) {
+        search->root += "/";
+    }
+    search->rx = rx;
+    search->literal = GrepEngine::requiredLiteral(pattern).toUtf8();
+    search->matcher.setPattern(search->literal);
+    search->buffers = buffers;
+    search->cancelled = false;
+    search->busy = 0;
+    search->count = 0;
+
+    if (!target.isEmpty()) {
+        QFileInfo info(target.startsWith("/") ? target : search->root + target);
+        QString path = info.canonicalFilePath();
+        if (path.startsWith(search->root)) {
+            path = path.mid(search->root.size());
+        } else {
+            // outside of the directory, search it from the filesystem root
+            search->root = "/";
+            path = path.mid(1);
+        }
+        if (info.isDir()) {
+            QString sub = path.isEmpty() ? "" : path + "/";
+            search->dirs.append(qMakePair(sub, FilesIndex::ignoresFor(search->root, sub)));
+        } else {
+            search->files.append(path);
+        }
+    } else if (!files.isEmpty()) {
+        search->files = files;
+    } else {
+        search->dirs.append(qMakePair(QString(""), FilesIndex::ignoresFor(search->root, "")));
+    }
+
+    this->search = search;
+
+    int workers = this->pool.maxThreadCount();
+    search->workers = workers;
+    for (int i = 0; i < workers; i++) {
+        this->pool.start([this, search]() { this->work(search); });
+    }
+    this->flushTimer->start();
+
+    return true;
+}
+
+// walk lists the files and the subdirectories of the directory.
+static void walk(const QString& root, const GrepDir& dir, QStringList* files, QList<GrepDir>* dirs) {
+    const QList<GitIgnore>& ignores = dir.second;
+    QDirIterator it(root + dir.first, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        QString name = it.fileName();
+        QString relative = dir.first + name;
+
+        if (info.isDir()) {
+            // do not follow the links to directories, they could loop
+            if (name == ".git" || info.isSymLink()) {
+                continue;
+            }
+            if (GitIgnore::isIgnored(ignores, relative, true)) {
+                continue;
+            }
+            QString sub = relative + "/";
+            QList<GitIgnore> subIgnores = ignores;
+            GitIgnore ignore(sub, root + sub + ".gitignore");
+            if (!ignore.isEmpty()) {
+                subIgnores.append(ignore);
+            }
+            dirs->append(qMakePair(sub, subIgnores));
+            continue;
+        }
+
+        if (GitIgnore::isIgnored(ignores, relative, false)) {
+            continue;
+        }
+        files->append(relative);
+    }
+}
+
+void GrepEngine::work(std::shared_ptr<GrepSearch> search) {
+    QMutexLocker locker(&search->mutex);
+
+    // the workers share the directories to walk and the files to search: a
+    // worker walking a directory gives the files and directories found to
+    // the others, the ones without anything to do wait for new work.
+    while (!search->cancelled) {
+        if (!search->files.isEmpty()) {
+            int count = qMin(int(search->files.size()), GREP_ENGINE_FILES_CHUNK);
+            QStringList chunk = search->files.mid(search->files.size() - count);
+            search->files.remove(search->files.size() - count, count);
+            search->busy++;
+            locker.unlock();
+
+            QList<GrepMatch> matches;
+            for (const QString& file : chunk) {
+                if (search->cancelled) {
+                    break;
+                }
+                GrepEngine::searchFile(*search, file, &matches);
+            }
+
+            locker.relock();
+            search->busy--;
+            search->results.append(matches);
+            search->count += matches.size();
+            continue;
+        }
+
+        if (!search->dirs.isEmpty()) {
+            GrepDir dir = search->dirs.takeLast();
+            search->busy++;
+            locker.unlock();
+
+            QStringList files;
+            QList<GrepDir> dirs;
+            walk(search->root, dir, &files, &dirs);
+
+            locker.relock();
+            search->busy--;
+            search->files.append(files);
+            search->dirs.append(dirs);
+            search->wakeUp.wakeAll();
+            continue;
+        }
+
+        if (search->busy == 0) {
+            // nothing left and nobody to add more
+            break;
+        }
+        search->wakeUp.wait(&search->mutex);
+    }
+
+    search->wakeUp.wakeAll();
+    search->workers--;
+    if (search->workers == 0) {
+        locker.unlock();
+        QMetaObject::invokeMethod(this, [this, search]() { this->onWorkerDone(search); }, Qt::QueuedConnection);
+    }
+}
+
+void GrepEngine::searchFile(GrepSearch& search, const QString& file, QList<GrepMatch>* matches) {
+    QString path = search.root + file;
+
+    // an opened buffer is searched instead of its file
+    auto it = search.buffers.constFind(path);
+    if (it != search.buffers.constEnd()) {
+        QByteArray content = it.value().toUtf8();
+        GrepEngine::searchData(search, path, content.constData(), content.size(), matches);
+        return;
+    }
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    qint64 size = f.size();
+    if (size == 0) {
+        return;
+    }
+
+    uchar* mapped = f.map(0, size);
+    if (mapped != nullptr) {
+        GrepEngine::searchData(search, path, reinterpret_cast<const char*>(mapped), size, matches);
+        f.unmap(mapped);
+        return;
+    }
+
+    // e.g. special files which can't be mapped
+    QByteArray content = f.readAll();
+    GrepEngine::searchData(search, path, content.constData(), content.size(), matches);
+}
+
+void GrepEngine::searchData(GrepSearch& search, const QString& path, const char* data, qint64 size,
+                            QList<GrepMatch>* matches) {
+    if (std::memchr(data, '\0', qMin(size, qint64(GREP_ENGINE_BINARY_PROBE_SIZE))) != nullptr) {
+        return;
+    }
+
+    int lineNumber = 1;
+    qint64 counted = 0; // lines are counted up to this position
+    qint64 pos = 0;
+
+    while (pos < size) {
+        if (search.cancelled) {
+            return;
+        }
+
+        qint64 lineStart = pos;
+        if (!search.literal.isEmpty()) {
+            // jump to the next line containing the literal
+            qint64 found = search.matcher.indexIn(data, size, pos);
+            if (found == -1) {
+                return;
+            }
+            lineStart = found;
+            while (lineStart > pos && data[lineStart - 1] != '\n') {
+                lineStart--;
+            }
+        }
+
+        const char* newline = static_cast<const char*>(std::memchr(data + lineStart, '\n', size - lineStart));
+        qint64 lineEnd = newline != nullptr ? newline - data : size;
+
+        for (const char* c = data + counted; c < data + lineStart; c++) {
+            c = static_cast<const char*>(std::memchr(c, '\n', data + lineStart - c));
+            if (c == nullptr) {
+                break;
+            }
+            lineNumber++;
+        }
+        counted = lineStart;
+
+        qint64 length = lineEnd - lineStart;
+        if (length > 0 && data[lineEnd - 1] == '\r') {
+            length--;
+        }
+        QString line = QString::fromUtf8(data + lineStart, length);
+        QRegularExpressionMatch match = search.rx.match(line);
+        if (match.hasMatch()) {
+            GrepMatch m;
+            m.file = path;
+            m.line = lineNumber;
+            m.column = match.capturedStart();
+            m.length = match.capturedLength();
+            m.text = line.left(GREP_ENGINE_MAX_LINE_LENGTH);
+            matches->append(m);
+        }
+
+        pos = lineEnd + 1;
+    }
+}
+
+void GrepEngine::onFlush() {
+    if (this->search == nullptr) {
+        this->flushTimer->stop();
+        return;
+    }
+
+    QMutexLocker locker(&this->search->mutex);
+    if (this->search->results.isEmpty()) {
+        return;
+    }
+    QList<GrepMatch> matches;
+    matches.swap(this->search->results);
+    locker.unlock();
+
+    emit results(matches);
+}
+
+void GrepEngine::onWorkerDone(std::shared_ptr<GrepSearch> search) {
+    if (search != this->search) {
+        // cancelled in the meantime
+        return;
+    }
+
+    this->onFlush();
+    this->flushTimer->stop();
+    int count = search->count;
+    this->search = nullptr;
+    emit finished(count);
+}
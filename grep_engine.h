@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <memory>
+
+#include "piece_table.h"
+
+// files with a NUL byte in their first bytes are binary and are not searched.
+#define GREP_ENGINE_BINARY_PROBE_SIZE 8192
+// files are taken by the workers by chunks of this size.
+#define GREP_ENGINE_FILES_CHUNK 32
+// matches are sent at most this often while searching.
+#define GREP_ENGINE_FLUSH_INTERVAL_MS 30
+// the text of a matching line is cut after this many chars.
+#define GREP_ENGINE_MAX_LINE_LENGTH 512
+
+// GrepMatch is a line matching the searched pattern.
+typedef struct GrepMatch {
+    // absolute path of the file
+    QString file;
+    // line number, starting with 1
+    int line;
+    // column and length of the first match in the line, in QChar
+    int column;
+    int length;
+    // text of the line
+    QString text;
+} GrepMatch;
+
+struct GrepSearch;
+
+// GrepEngine searches a regular expression in all the files of a directory
+// with several workers, the .gitignore rules being respected. The files are
+// memory mapped and only the lines containing the literal part of the
+// pattern (if any) are tested with the regular expression.
+//
+// The content of the given buffers is searched instead of the one of the
+// file on disk.
+class GrepEngine : public QObject
+{
+    Q_OBJECT
+public:
+    GrepEngine(QObject* parent);
+    ~GrepEngine();
+
+    // start cancels any running search and starts looking for the pattern
+    // in the files of dir, or only in target if not empty (a file or a
+    // directory). When files is not empty, these files (relative to dir) are
+    // searched instead of walking the directory.
+    // buffers are the contents to use for files opened in the editor, per
+    // absolute path.
+    // Returns false if the pattern is invalid.
+    bool start(const QString& pattern, const QString& dir, const QString& target,
+               const QStringList& files, const QHash<QString, PieceTable>& buffers);
+
+    // cancel stops the running search, if any.
+    void cancel();
+
+    bool isRunning() const { return this->search != nullptr; }
+
+    // requiredLiteral returns the longest string which has to be part of any
+    // match of the given pattern, empty if there is none.
+    static QString requiredLiteral(const QString& pattern);
+
+signals:
+    // results is emitted with the matches found since the last emit.
+    void results(const QList<GrepMatch>& matches);
+
+    // finished is emitted when all the files have been searched.
+    void finished(int count);
+
+private slots:
+    void onFlush();
+
+private:
+    // work is the loop of a worker, taking directories to walk and files to
+    // search until there is nothing left. It runs on a worker thread.
+    void work(std::shared_ptr<GrepSearch> search);
+
+    // onWorkerDone is called when a worker has nothing more to do.
+    void onWorkerDone(std::shared_ptr<GrepSearch> search);
+
+    // searchFile searches the file (relative to the root of the search).
+    static void searchFile(GrepSearch& search, const QString& file, QList<GrepMatch>* matches);
+
+    // searchData searches the content of a file.
+    static void searchData(GrepSearch& search, const QString& path, const char* data, qint64 size,
+                           QList<GrepMatch>* matches);
+
+    QThreadPool pool;
+    QTimer* flushTimer;
+    std::shared_ptr<GrepSearch> search;
+};
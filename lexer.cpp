@@ -0,0 +1,486 @@
+#include "lexer.h"
+
+// keywords
+// ----------------------
+
+#define LEXER_KEYWORDS(name, ...) \
+    static constexpr const char* name##Words[] = { __VA_ARGS__ }; \
+    static constexpr KeywordTable name = makeKeywordTable(name##Words); \
+    static_assert(name.ok, "no perfect hash found for the keywords " #name);
+
+LEXER_KEYWORDS(goKeywords,
+    "break", "case", "chan", "const", "continue", "default", "defer", "else",
+    "fallthrough", "for", "func", "go", "goto", "if", "import", "interface",
+    "map", "package", "range", "return", "select", "struct", "switch", "type",
+    "var", "true", "false", "nil", "iota", "any", "bool", "byte", "error",
+    "int", "int8", "int16", "int32", "int64", "uint", "uint8", "uint16",
+    "uint32", "uint64", "uintptr", "float32", "float64", "rune", "string")
+
+LEXER_KEYWORDS(cppKeywords,
+    "auto", "bool", "break", "case", "catch", "char", "class", "const",
+    "constexpr", "continue", "default", "delete", "do", "double", "else",
+    "enum", "explicit", "extern", "false", "float", "for", "friend", "goto",
+    "if", "inline", "int", "long", "namespace", "new", "nullptr", "operator",
+    "override", "private", "protected", "public", "return", "short", "signed",
+    "signals", "sizeof", "slots", "static", "struct", "switch", "template",
+    "this", "throw", "true", "try", "typedef", "typename", "union",
+    "unsigned", "using", "virtual", "void", "volatile", "while", "NULL")
+
+LEXER_KEYWORDS(javaKeywords,
+    "abstract", "boolean", "break", "byte", "case", "catch", "char", "class",
+    "const", "continue", "default", "do", "double", "else", "enum", "extends",
+    "false", "final", "finally", "float", "for", "if", "implements", "import",
+    "instanceof", "int", "interface", "long", "new", "null", "package",
+    "private", "protected", "public", "return", "short", "static", "super",
+    "switch", "synchronized", "this", "throw", "throws", "true", "try", "var",
+    "void", "volatile", "while")
+
+LEXER_KEYWORDS(pythonKeywords,
+    "and", "as", "assert", "async", "await", "break", "class", "continue",
+    "def", "del", "elif", "else", "except", "False", "finally", "for", "from",
+    "global", "if", "import", "in", "is", "lambda", "None", "nonlocal", "not",
+    "or", "pass", "raise", "return", "self", "True", "try", "while", "with",
+    "yield")
+
+LEXER_KEYWORDS(rustKeywords,
+    "as", "async", "await", "bool", "break", "const", "continue", "crate",
+    "dyn", "else", "enum", "Err", "extern", "false", "f32", "f64", "fn", "for",
+    "i8", "i16", "i32", "i64", "if", "impl", "in", "isize", "let", "loop",
+    "match", "mod", "move", "mut", "None", "Ok", "Option", "pub", "ref",
+    "return", "self", "Self", "Some", "static", "str", "String", "struct",
+    "super", "trait", "true", "type", "u8", "u16", "u32", "u64", "unsafe",
+    "use", "usize", "Vec", "where", "while")
+
+LEXER_KEYWORDS(rubyKeywords,
+    "alias", "and", "begin", "break", "case", "class", "def", "defined",
+    "do", "else", "elsif", "end", "ensure", "false", "for", "if", "in",
+    "module", "next", "nil", "not", "or", "redo", "require", "rescue",
+    "retry", "return", "self", "super", "then", "true", "undef", "unless",
+    "until", "when", "while", "yield")
+
+LEXER_KEYWORDS(zigKeywords,
+    "and", "anytype", "bool", "break", "catch", "comptime", "const",
+    "continue", "defer", "else", "enum", "errdefer", "error", "false", "fn",
+    "for", "i32", "i64", "if", "inline", "isize", "null", "or", "orelse",
+    "pub", "return", "struct", "switch", "test", "true", "try", "type", "u8",
+    "u32", "u64", "undefined", "union", "usize", "var", "void", "while")
+
+LEXER_KEYWORDS(scalaKeywords,
+    "abstract", "case", "catch", "class", "def", "do", "else", "extends",
+    "false", "final", "finally", "for", "if", "implicit", "import", "lazy",
+    "match", "new", "null", "object", "override", "package", "private",
+    "protected", "return", "sealed", "super", "this", "throw", "trait",
+    "true", "try", "type", "val", "var", "while", "with", "yield")
+
+LEXER_KEYWORDS(jsKeywords,
+    "async", "await", "break", "case", "catch", "class", "const", "continue",
+    "debugger", "default", "delete", "do", "else", "export", "extends",
+    "false", "finally", "for", "function", "if", "import", "in",
+    "instanceof", "let", "new", "null", "of", "return", "super", "switch",
+    "this", "throw", "true", "try", "typeof", "undefined", "var", "void",
+    "while", "yield")
+
+LEXER_KEYWORDS(csharpKeywords,
+    "abstract", "as", "async", "await", "base", "bool", "break", "byte",
+    "case", "catch", "char", "class", "const", "continue", "decimal",
+    "default", "delegate", "do", "double", "else", "enum", "event",
+    "explicit", "extern", "false", "finally", "fixed", "float", "for",
+    "foreach", "if", "implicit", "in", "int", "interface", "internal", "is",
+    "lock", "long", "namespace", "new", "null", "object", "operator", "out",
+    "override", "params", "private", "protected", "public", "readonly",
+    "ref", "return", "sealed", "short", "sizeof", "static", "string",
+    "struct", "switch", "this", "throw", "true", "try", "typeof", "uint",
+    "ulong", "unsafe", "using", "var", "virtual", "void", "volatile", "while")
+
+// languages
+// ----------------------
+
+// keywords, //, #, "# ", #include, /* */, `, """, heredocs
+static const LexerLanguage goLanguage      = { &goKeywords,     true,  false, false, false, true,  true,  false, false };
+static const LexerLanguage cppLanguage     = { &cppKeywords,    true,  false, false, true,  true,  false, false, false };
+static const LexerLanguage javaLanguage    = { &javaKeywords,   true,  false, false, false, true,  false, false, false };
+static const LexerLanguage pythonLanguage  = { &pythonKeywords, false, true,  false, false, false, false, true,  false };
+static const LexerLanguage rustLanguage    = { &rustKeywords,   true,  false, false, false, true,  false, false, false };
+static const LexerLanguage rubyLanguage    = { &rubyKeywords,   false, true,  false, false, false, false, false, true  };
+static const LexerLanguage zigLanguage     = { &zigKeywords,    true,  false, false, false, false, false, false, false };
+static const LexerLanguage scalaLanguage   = { &scalaKeywords,  true,  false, false, false, true,  false, true,  false };
+static const LexerLanguage jsLanguage      = { &jsKeywords,     true,  false, false, false, true,  true,  false, false };
+static const LexerLanguage csharpLanguage  = { &csharpKeywords, true,  false, false, true,  true,  false, false, false };
+static const LexerLanguage genericLanguage = { nullptr,         true,  true,  true,  false, false, false, false, false };
+
+typedef struct LexerExtension {
+    const char* extension;
+    const LexerLanguage* language;
+} LexerExtension;
+
+static const LexerExtension extensions[] = {
+    { ".go", &goLanguage },
+    { ".c", &cppLanguage }, { ".h", &cppLanguage }, { ".cpp", &cppLanguage },
+    { ".hpp", &cppLanguage }, { ".cc", &cppLanguage }, { ".hh", &cppLanguage },
+    { ".java", &javaLanguage },
+    { ".py", &pythonLanguage },
+    { ".rs", &rustLanguage },
+    { ".rb", &rubyLanguage },
+    { ".zig", &zigLanguage },
+    { ".scala", &scalaLanguage },
+    { ".js", &jsLanguage }, { ".ts", &jsLanguage },
+    { ".cs", &csharpLanguage },
+};
+
+const LexerLanguage* Lexer::languageFor(const QString& filename) {
+    for (const LexerExtension& ext : extensions) {
+        if (filename.endsWith(QLatin1String(ext.extension))) {
+            return ext.language;
+        }
+    }
+    return &genericLanguage;
+}
+
+// chars
+// ----------------------
+
+enum LexerCharClass : unsigned char {
+    LexerCharOther,
+    LexerCharWord,
+    LexerCharQuote,
+    LexerCharBracket,
+    LexerCharSlash,
+    LexerCharHash,
+    LexerCharLess,
+};
+
+static constexpr unsigned char classOfAscii(int c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_') {
+        return LexerCharWord;
+    }
+    switch (c) {
+        case '"': case '\'': case '`':
+            return LexerCharQuote;
+        case '(': case ')': case '{': case '}': case '[': case ']':
+            return LexerCharBracket;
+        case '/':
+            return LexerCharSlash;
+        case '#':
+            return LexerCharHash;
+        case '<':
+            return LexerCharLess;
+    }
+    return LexerCharOther;
+}
+
+struct LexerCharClasses {
+    unsigned char classes[128];
+};
+
+static constexpr LexerCharClasses makeCharClasses() {
+    LexerCharClasses rv{};
+    for (int c = 0; c < 128; c++) {
+        rv.classes[c] = classOfAscii(c);
+    }
+    return rv;
+}
+
+static constexpr LexerCharClasses charClasses = makeCharClasses();
+
+static inline unsigned char classOf(QChar c) {
+    ushort u = c.unicode();
+    if (u < 128) {
+        return charClasses.classes[u];
+    }
+    return c.isLetterOrNumber() ? LexerCharWord : LexerCharOther;
+}
+
+// lexer
+// ----------------------
+
+Lexer::Lexer(const QString& filename) :
+    language(Lexer::languageFor(filename)) {
+}
+
+void Lexer::lexComment(QStringView line, int start, int end, QVector<LexerToken>* tokens) const {
+    if (end <= start) {
+        return;
+    }
+    tokens->append(LexerToken{start, end - start, LexerComment});
+
+    static const QLatin1String markers[] = {
+        QLatin1String("TODO"), QLatin1String("NOTE"), QLatin1String("FIXME"), QLatin1String("XXX"),
+    };
+    QStringView comment = line.mid(start, end - start);
+    for (const QLatin1String& marker : markers) {
+        for (qsizetype idx = comment.indexOf(marker); idx != -1; idx = comment.indexOf(marker, idx + marker.size())) {
+            tokens->append(LexerToken{start + int(idx), int(marker.size()), LexerTodo});
+        }
+    }
+}
+
+int Lexer::heredocState(QStringView terminator, bool indented) {
+    // FNV-1a
+    unsigned int h = 2166136261u;
+    for (QChar c : terminator) {
+        h ^= c.unicode();
+        h *= 16777619u;
+    }
+    return LexerStateHeredoc | (indented ? LEXER_STATE_INDENTED : 0) |
+        int((h & LEXER_STATE_HASH_MASK) << LEXER_STATE_HASH_SHIFT);
+}
+
+int Lexer::lexHeredoc(QStringView line, int i, int* end) const {
+    const int size = line.size();
+    int j = i + 2;
+    if (j > size || line[i + 1] != '<') {
+        return LexerStateDefault;
+    }
+
+    bool indented = false;
+    if (j < size && (line[j] == '~' || line[j] == '-')) {
+        indented = true;
+        j++;
+    }
+
+    QChar quote = '\0';
+    if (j < size && (line[j] == '\'' || line[j] == '"')) {
+        quote = line[j];
+        j++;
+    }
+
+    // terminators are uppercase words, not to take a << operator for a heredoc
+    int start = j;
+    if (j >= size || !(line[j].isUpper() || line[j] == '_')) {
+        return LexerStateDefault;
+    }
+    while (j < size && classOf(line[j]) == LexerCharWord) {
+        j++;
+    }
+    int length = j - start;
+
+    if (quote != '\0') {
+        if (j >= size || line[j] != quote) {
+            return LexerStateDefault;
+        }
+        j++;
+    }
+
+    *end = j;
+    return Lexer::heredocState(line.mid(start, length), indented);
+}
+
+int Lexer::lexContinuation(QStringView line, int* state, QVector<LexerToken>* tokens) const {
+    const int size = line.size();
+
+    switch (*state & LEXER_STATE_MASK) {
+        case LexerStateBlockComment:
+            {
+                int end = line.indexOf(QLatin1String("*/"));
+                if (end == -1) {
+                    this->lexComment(line, 0, size, tokens);
+                    return size;
+                }
+                this->lexComment(line, 0, end + 2, tokens);
+                *state = LexerStateDefault;
+                return end + 2;
+            }
+
+        case LexerStateBeginEnd:
+            this->lexComment(line, 0, size, tokens);
+            if (line.startsWith(QLatin1String("=end"))) {
+                *state = LexerStateDefault;
+            }
+            return size;
+
+        case LexerStateRawString:
+        case LexerStateTripleDouble:
+        case LexerStateTripleSingle:
+            {
+                QLatin1String delimiter("`");
+                if ((*state & LEXER_STATE_MASK) == LexerStateTripleDouble) {
+                    delimiter = QLatin1String("\"\"\"");
+                } else if ((*state & LEXER_STATE_MASK) == LexerStateTripleSingle) {
+                    delimiter = QLatin1String("'''");
+                }
+                int end = line.indexOf(delimiter);
+                if (end == -1) {
+                    if (size > 0) {
+                        tokens->append(LexerToken{0, size, LexerQuote});
+                    }
+                    return size;
+                }
+                end += delimiter.size();
+                tokens->append(LexerToken{0, end, LexerQuote});
+                *state = LexerStateDefault;
+                return end;
+            }
+
+        case LexerStateHeredoc:
+            {
+                if (size > 0) {
+                    tokens->append(LexerToken{0, size, LexerQuote});
+                }
+                bool indented = (*state & LEXER_STATE_INDENTED) != 0;
+                QStringView terminator = indented ? line.trimmed() : line;
+                bool word = !terminator.isEmpty();
+                for (QChar c : terminator) {
+                    word = word && classOf(c) == LexerCharWord;
+                }
+                if (word && Lexer::heredocState(terminator, indented) == *state) {
+                    *state = LexerStateDefault;
+                }
+                return size;
+            }
+    }
+
+    // unknown state, e.g. set while the file had another name
+    *state = LexerStateDefault;
+    return 0;
+}
+
+int Lexer::lex(QStringView line, int state, QVector<LexerToken>* tokens) const {
+    tokens->clear();
+
+    const int size = line.size();
+    int i = 0;
+
+    if (state > LexerStateDefault) {
+        i = this->lexContinuation(line, &state, tokens);
+        if (state != LexerStateDefault) {
+            return state;
+        }
+    } else {
+        // =begin =end comments
+        if (this->language->heredocs && line.startsWith(QLatin1String("=begin"))) {
+            this->lexComment(line, 0, size, tokens);
+            return LexerStateBeginEnd;
+        }
+
+        // preprocessor directives, e.g. #include
+        if (this->language->preprocessor) {
+            while (i < size && line[i].isSpace()) {
+                i++;
+            }
+            if (i < size && line[i] == '#') {
+                int end = i + 1;
+                while (end < size && classOf(line[end]) == LexerCharWord) {
+                    end++;
+                }
+                if (end > i + 1) {
+                    tokens->append(LexerToken{i, end - i, LexerKeyword});
+                }
+                i = end;
+            }
+        }
+    }
+
+    // the content of a heredoc starts on the next line
+    int heredoc = LexerStateDefault;
+
+    while (i < size) {
+        QChar c = line[i];
+        switch (classOf(c)) {
+            case LexerCharWord:
+                {
+                    int start = i;
+                    while (i < size && classOf(line[i]) == LexerCharWord) {
+                        i++;
+                    }
+                    if ((i < size && line[i] == '(') || (start > 0 && line[start - 1] == '.')) {
+                        tokens->append(LexerToken{start, i - start, LexerFunctionCall});
+                    } else if (i - start >= 2 && this->language->keywords != nullptr &&
+                            this->language->keywords->contains(line.mid(start, i - start))) {
+                        tokens->append(LexerToken{start, i - start, LexerKeyword});
+                    }
+                }
+                continue;
+
+            case LexerCharQuote:
+                {
+                    int start = i;
+
+                    if (this->language->tripleQuotes && c != '`' && i + 2 < size &&
+                            line[i + 1] == c && line[i + 2] == c) {
+                        QLatin1String delimiter(c == '"' ? "\"\"\"" : "'''");
+                        int end = line.indexOf(delimiter, i + 3);
+                        if (end == -1) {
+                            tokens->append(LexerToken{start, size - start, LexerQuote});
+                            return c == '"' ? LexerStateTripleDouble : LexerStateTripleSingle;
+                        }
+                        tokens->append(LexerToken{start, end + 3 - start, LexerQuote});
+                        i = end + 3;
+                        continue;
+                    }
+
+                    int end = i + 1;
+                    while (end < size && line[end] != c) {
+                        if (line[end] == '\\') {
+                            end++;
+                        }
+                        end++;
+                    }
+                    if (end < size) {
+                        tokens->append(LexerToken{start, end - start + 1, LexerQuote});
+                        i = end + 1;
+                    } else if (this->language->rawStrings && c == '`') {
+                        tokens->append(LexerToken{start, size - start, LexerQuote});
+                        return LexerStateRawString;
+                    } else {
+                        // not closed on this line
+                        i++;
+                    }
+                }
+                continue;
+
+            case LexerCharBracket:
+                if (!tokens->isEmpty() && tokens->last().type == LexerSpecialChar &&
+                        tokens->last().start + tokens->last().length == i) {
+                    tokens->last().length++;
+                } else {
+                    tokens->append(LexerToken{i, 1, LexerSpecialChar});
+                }
+                i++;
+                continue;
+
+            case LexerCharSlash:
+                if (this->language->slashComments && i + 1 < size && line[i + 1] == '/') {
+                    this->lexComment(line, i, size, tokens);
+                    return heredoc;
+                }
+                if (this->language->blockComments && i + 1 < size && line[i + 1] == '*') {
+                    int end = line.indexOf(QLatin1String("*/"), i + 2);
+                    if (end == -1) {
+                        this->lexComment(line, i, size, tokens);
+                        return LexerStateBlockComment;
+                    }
+                    this->lexComment(line, i, end + 2, tokens);
+                    i = end + 2;
+                    continue;
+                }
+                i++;
+                continue;
+
+            case LexerCharHash:
+                if (this->language->hashComments &&
+                        (!this->language->hashSpace || (i + 1 < size && line[i + 1] == ' '))) {
+                    this->lexComment(line, i, size, tokens);
+                    return heredoc;
+                }
+                i++;
+                continue;
+
+            case LexerCharLess:
+                if (this->language->heredocs) {
+                    int end = 0;
+                    int started = this->lexHeredoc(line, i, &end);
+                    if (started != LexerStateDefault) {
+                        tokens->append(LexerToken{i, end - i, LexerQuote});
+                        heredoc = started;
+                        i = end;
+                        continue;
+                    }
+                }
+                i++;
+                continue;
+        }
+        i++;
+    }
+
+    return heredoc;
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+#include <cstddef>
+#include <type_traits>
+
+// size of the tables of keywords, a power of 2.
+#define LEXER_KEYWORDS_TABLE_SIZE 1024
+// maximum amount of keywords per language.
+#define LEXER_MAX_KEYWORDS 254
+
+enum LexerTokenType {
+    LexerKeyword,
+    LexerFunctionCall,
+    LexerQuote,
+    LexerComment,
+    LexerTodo,
+    LexerSpecialChar,
+};
+
+// LexerState is the state of the lexer at the end of a line, for what is
+// spanning several lines. 0 and the values below are stored in the lowest
+// bits, heredocs are storing their terminator in the others, see
+// Lexer::heredocState.
+enum LexerState {
+    LexerStateDefault = 0,
+    // /* */
+    LexerStateBlockComment,
+    // =begin =end
+    LexerStateBeginEnd,
+    // `
+    LexerStateRawString,
+    // """
+    LexerStateTripleDouble,
+    // '''
+    LexerStateTripleSingle,
+    // <<ID, <<-ID or <<~ID
+    LexerStateHeredoc,
+};
+
+#define LEXER_STATE_MASK 0xf
+// set when the terminator of a heredoc can be indented.
+#define LEXER_STATE_INDENTED 0x10
+#define LEXER_STATE_HASH_SHIFT 5
+#define LEXER_STATE_HASH_MASK 0x1ffffff
+
+// LexerToken is a run of chars of a line to format.
+typedef struct LexerToken {
+    int start;
+    int length;
+    LexerTokenType type;
+} LexerToken;
+
+// KeywordTable is a set of keywords with a perfect hash: every keyword has
+// its own slot, a word is a keyword if it is the one in its slot.
+// Tables are built at compile time with makeKeywordTable.
+struct KeywordTable {
+    const char* const* words;
+    // index + 1 of the keyword in words for every slot, 0 for none.
+    unsigned char slots[LEXER_KEYWORDS_TABLE_SIZE];
+    unsigned int seed;
+    bool ok;
+
+    template <typename Char>
+    static constexpr unsigned int hash(const Char* s, std::size_t size, unsigned int seed) {
+        // FNV-1a
+        unsigned int h = 2166136261u ^ (seed * 16777619u);
+        for (std::size_t i = 0; i < size; i++) {
+            h ^= static_cast<unsigned int>(static_cast<std::make_unsigned_t<Char>>(s[i]));
+            h *= 16777619u;
+        }
+        return (h ^ (h >> 15)) & (LEXER_KEYWORDS_TABLE_SIZE - 1);
+    }
+
+    static constexpr std::size_t length(const char* s) {
+        std::size_t n = 0;
+        while (s[n] != '\0') {
+            n++;
+        }
+        return n;
+    }
+
+    // contains returns true if the word is one of the keywords.
+    bool contains(QStringView word) const {
+        unsigned char slot = this->slots[KeywordTable::hash(word.utf16(), word.size(), this->seed)];
+        if (slot == 0) {
+            return false;
+        }
+        const char* keyword = this->words[slot - 1];
+        qsizetype i = 0;
+        for (; i < word.size(); i++) {
+            if (keyword[i] == '\0' || static_cast<unsigned char>(keyword[i]) != word[i].unicode()) {
+                return false;
+            }
+        }
+        return keyword[i] == '\0';
+    }
+};
+
+// makeKeywordTable looks for a seed with which the hashes of all the
+// keywords are different.
+template <std::size_t K>
+constexpr KeywordTable makeKeywordTable(const char* const (&words)[K]) {
+    static_assert(K <= LEXER_MAX_KEYWORDS, "too many keywords");
+    for (unsigned int seed = 0; seed < 1000; seed++) {
+        KeywordTable table{words, {}, seed, true};
+        for (std::size_t i = 0; i < K && table.ok; i++) {
+            unsigned int h = KeywordTable::hash(words[i], KeywordTable::length(words[i]), seed);
+            if (table.slots[h] != 0) {
+                table.ok = false;
+            }
+            table.slots[h] = static_cast<unsigned char>(i + 1);
+        }
+        if (table.ok) {
+            return table;
+        }
+    }
+    return KeywordTable{words, {}, 0, false};
+}
+
+// LexerLanguage is the syntax of a language.
+typedef struct LexerLanguage {
+    const KeywordTable* keywords;
+    // comments starting with //
+    bool slashComments;
+    // comments starting with #, followed by a space if hashSpace is true
+    bool hashComments;
+    bool hashSpace;
+    // lines starting with a # directive, e.g. #include
+    bool preprocessor;
+    // comments between /* and */
+    bool blockComments;
+    // strings between ` which can span several lines
+    bool rawStrings;
+    // strings between """ or '''
+    bool tripleQuotes;
+    // Ruby heredocs and =begin =end comments
+    bool heredocs;
+} LexerLanguage;
+
+// Lexer splits lines of code in tokens to format, in one pass and without
+// allocating once its tokens vector is large enough.
+class Lexer
+{
+public:
+    // Lexer creates a lexer for the language of the given file, see languageFor.
+    Lexer(const QString& filename);
+
+    // languageFor returns the language of the given file from its extension.
+    // Files in unknown languages have comments and quotes but no keywords.
+    static const LexerLanguage* languageFor(const QString& filename);
+
+    // lex fills tokens with the tokens of the given line, state being the
+    // state at the end of the previous line. Returns the state at the end of
+    // this line.
+    int lex(QStringView line, int state, QVector<LexerToken>* tokens) const;
+
+    // heredocState returns the state of a heredoc ended by the given
+    // terminator.
+    static int heredocState(QStringView terminator, bool indented);
+
+private:
+    // lexComment adds the tokens of a comment from start to end.
+    void lexComment(QStringView line, int start, int end, QVector<LexerToken>* tokens) const;
+
+    // lexContinuation lexes the start of a line in the given state, it
+    // stores the state at the end of what it has lexed in state.
+    // Returns the position at which the default state starts again, or the
+    // size of the line.
+    int lexContinuation(QStringView line, int* state, QVector<LexerToken>* tokens) const;
+
+    // lexHeredoc returns the state of the heredoc starting at i (on a <<),
+    // 0 if it is not one, and stores its end in end.
+    int lexHeredoc(QStringView line, int i, int* end) const;
+
+    const LexerLanguage* language;
+};
@@ -1,6 +1,8 @@
 #include <QFileInfo>
 
 #include "editor.h"
+#include "git.h"
+#include "git_blame.h"
 #include "line_number_area.h"
 #include "window.h"
 
@@ -18,6 +20,14 @@ void LineNumberArea::mousePressEvent(QMouseEvent *event) {
         return;
     }
 
+    // show the commit of the line when clicking on its blame
+    GitCommit commit;
+    if (event->position().x() < this->editor->gitBlameWidth() &&
+            this->editor->getGitBlame()->commit(line, &commit)) {
+        this->editor->getGit()->show(this->editor->getBuffer()->getFilename(), commit.oid);
+        return;
+    }
+
     this->editor->getWindow()->showLSPDiagnosticsOfLine(this->editor->getId(), line);
 }
 
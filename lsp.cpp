@@ -5,12 +5,15 @@
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonValue>
 #include <QJsonParseError>
 #include <QStringList>
 #include <QTextStream>
-#include <QTime>
+
+#include <climits>
 
 #include "buffer.h"
+#include "completer.h"
 #include "lsp.h"
 #include "window.h"
 
@@ -18,11 +21,9 @@
 
 LSP::LSP(Window* window) : QObject(window) {
     this->window = window;
-    connect(&this->lspServer, &QProcess::readyReadStandardOutput, this, &LSP::readyReadStandardOutput);
-}
-
-void LSP::readyReadStandardOutput() {
-    this->readStandardOutput();
+    this->state = LSP_STATE_STOPPED;
+    // until the server has told us otherwise
+    this->textDocumentSync = LSP_TEXT_DOCUMENT_SYNC_FULL;
 }
 
 LSP::~LSP() {
@@ -30,7 +31,7 @@ LSP::~LSP() {
 
 // --------------------------
 
-QString LSPWriter::initialize(const QString& baseDir) {
+QByteArray LSPWriter::initialize(const QString& baseDir) {
     QString content;
     QFileInfo fi(baseDir);
     QJsonParseError* error = nullptr;
@@ -89,27 +90,25 @@ QString LSPWriter::initialize(const QString& baseDir) {
         {"method", "initialize"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::initialized() {
+QByteArray LSPWriter::initialized() {
     QJsonObject params;
     QJsonObject object {
         {"jsonrpc", "2.0"},
         {"method", "initialized"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::openFile(Buffer* buffer, const QString& filename, const QString& language) {
+QByteArray LSPWriter::openFile(Buffer* buffer, const QString& filename, const QString& language) {
     QJsonObject textDocument {
         {"uri", "file://" + filename },
         {"version", 1},
         {"languageId", language},
-        {"text", QString(buffer->getData())}
+        {"text", buffer->snapshot().toString()}
     };
     QJsonObject params {
         {"textDocument", textDocument}
@@ -119,17 +118,16 @@ QString LSPWriter::openFile(Buffer* buffer, const QString& filename, const QStri
         {"method", "textDocument/didOpen"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::refreshFile(Buffer* buffer, const QString& filename) {
+QByteArray LSPWriter::refreshFile(const QString& filename, int version, const QString& text) {
     QJsonObject textDocument {
         {"uri", "file://" + filename },
-        {"version", QTime::currentTime().second() },
+        {"version", version },
     };
     QJsonObject contentChange {
-        {"text", QString(buffer->getData())},
+        {"text", text},
     };
     QJsonArray contentChanges {
         contentChange,
@@ -143,11 +141,45 @@ QString LSPWriter::refreshFile(Buffer* buffer, const QString& filename) {
         {"method", "textDocument/didChange"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::definition(int reqId, const QString& filename, int line, int column) {
+QByteArray LSPWriter::changeFile(const QString& filename, int version, const QList<BufferChange>& changes) {
+    QJsonObject textDocument {
+        {"uri", "file://" + filename },
+        {"version", version },
+    };
+    QJsonArray contentChanges;
+    for (const BufferChange& change : changes) {
+        QJsonObject range {
+            {"start", QJsonObject {
+                {"line", change.startLine},
+                {"character", change.startCharacter}
+            }},
+            {"end", QJsonObject {
+                {"line", change.endLine},
+                {"character", change.endCharacter}
+            }}
+        };
+        QJsonObject contentChange {
+            {"range", range},
+            {"text", change.text},
+        };
+        contentChanges.append(contentChange);
+    }
+    QJsonObject params {
+        {"textDocument", textDocument},
+        {"contentChanges", contentChanges},
+    };
+    QJsonObject object {
+        {"jsonrpc", "2.0"},
+        {"method", "textDocument/didChange"},
+        {"params", params}
+    };
+    return this->payload(object);
+}
+
+QByteArray LSPWriter::definition(int reqId, const QString& filename, int line, int column) {
     QJsonObject position {
         {"line", line-1},
         {"character", column}
@@ -165,11 +197,10 @@ QString LSPWriter::definition(int reqId, const QString& filename, int line, int
         {"method", "textDocument/definition"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::declaration(int reqId, const QString& filename, int line, int column) {
+QByteArray LSPWriter::declaration(int reqId, const QString& filename, int line, int column) {
     QJsonObject position {
         {"line", line-1},
         {"character", column}
@@ -187,11 +218,10 @@ QString LSPWriter::declaration(int reqId, const QString& filename, int line, int
         {"method", "textDocument/declaration"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::hover(int reqId, const QString& filename, int line, int column) {
+QByteArray LSPWriter::hover(int reqId, const QString& filename, int line, int column) {
     QJsonObject position {
         {"line", line-1},
         {"character", column}
@@ -209,11 +239,10 @@ QString LSPWriter::hover(int reqId, const QString& filename, int line, int colum
         {"method", "textDocument/hover"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::signatureHelp(int reqId, const QString& filename, int line, int column) {
+QByteArray LSPWriter::signatureHelp(int reqId, const QString& filename, int line, int column) {
     QJsonObject position {
         {"line", line-1},
         {"character", column}
@@ -231,11 +260,10 @@ QString LSPWriter::signatureHelp(int reqId, const QString& filename, int line, i
         {"method", "textDocument/signatureHelp"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::references(int reqId, const QString& filename, int line, int column) {
+QByteArray LSPWriter::references(int reqId, const QString& filename, int line, int column) {
     QJsonObject position {
         {"line", line-1},
         {"character", column}
@@ -253,11 +281,10 @@ QString LSPWriter::references(int reqId, const QString& filename, int line, int
         {"method", "textDocument/references"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::completion(int reqId, const QString& filename, int line, int column) {
+QByteArray LSPWriter::completion(int reqId, const QString& filename, int line, int column) {
     QJsonObject position {
         {"line", line-1},
         {"character", column}
@@ -275,56 +302,143 @@ QString LSPWriter::completion(int reqId, const QString& filename, int line, int
         {"method", "textDocument/completion"},
         {"params", params}
     };
-    QString str = QString(QJsonDocument(object).toJson(QJsonDocument::Compact));
-    return this->payload(str);
+    return this->payload(object);
 }
 
-QString LSPWriter::payload(QString& content) {
-    int size = content.size();
-    content.prepend("Content-Length: " + QString::number(size) + "\r\n\r\n");
-    return content;
+QByteArray LSPWriter::cancelRequest(int reqId) {
+    QJsonObject params {
+        {"id", reqId}
+    };
+    QJsonObject object {
+        {"jsonrpc", "2.0"},
+        {"method", "$/cancelRequest"},
+        {"params", params}
+    };
+    return this->payload(object);
+}
+
+QByteArray LSPWriter::payload(const QJsonObject& object) {
+    QByteArray content = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    QByteArray rv = "Content-Length: " + QByteArray::number(content.size()) + "\r\n\r\n";
+    rv.append(content);
+    return rv;
 }
 
 // --------------------------
 
-QList<QJsonDocument> LSPReader::readMessage(QByteArray message) {
-    QList<QJsonDocument> rv;
-    while (true) {
-        QRegularExpression rx(QStringLiteral("^Content-Length: (\\d+)"));
-        QRegularExpressionMatchIterator it = rx.globalMatch(message);
-
-        if (it.hasNext()) {
-            // look for one message
-            // --------------------
-
-            QRegularExpressionMatch match = it.next();
-            int payloadSize = match.captured(1).toInt();
-            // first, we want to remove the header from the message
-            int headerSize = QString("Content-Length: " + QString::number(payloadSize) + "\r\n\r\n").size();
-            QByteArray payload  = message.remove(0, headerSize).left(payloadSize);
-
-            // read its json
-            // -------------
-
-            QJsonParseError* error = nullptr;
-            QJsonDocument result = QJsonDocument::fromJson(payload, error);
-            if (error != nullptr) {
-                qWarning() << "LSPReader::readMessage" << "can't unmarshal the payload:" << error;
+LSPFrameReader::LSPFrameReader() :
+    offset(0),
+    length(-1) {
+}
+
+void LSPFrameReader::clear() {
+    this->buffer.clear();
+    this->offset = 0;
+    this->length = -1;
+}
+
+void LSPFrameReader::append(const QByteArray& data) {
+    // drop what has been read once it is most of the buffer, not to move
+    // the data on every chunk.
+    if (this->offset > 0 && this->offset * 2 >= this->buffer.size()) {
+        this->buffer.remove(0, this->offset);
+        this->offset = 0;
+    }
+    this->buffer.append(data);
+}
+
+int LSPFrameReader::contentLength(const char* headers, int size) {
+    static const char name[] = "content-length:";
+    const int nameSize = sizeof(name) - 1;
+
+    int lineStart = 0;
+    while (lineStart < size) {
+        int lineEnd = lineStart;
+        while (lineEnd < size && headers[lineEnd] != '\r' && headers[lineEnd] != '\n') {
+            lineEnd++;
+        }
+
+        if (lineEnd - lineStart > nameSize && qstrnicmp(headers + lineStart, name, nameSize) == 0) {
+            int i = lineStart + nameSize;
+            while (i < lineEnd && headers[i] == ' ') {
+                i++;
             }
-            rv.append(result);
+            qint64 value = -1;
+            for (; i < lineEnd && headers[i] >= '0' && headers[i] <= '9'; i++) {
+                value = (value < 0 ? 0 : value * 10) + (headers[i] - '0');
+                if (value > INT_MAX) {
+                    return -1;
+                }
+            }
+            return int(value);
+        }
 
-            // move forward in the message for other payloads
-            // ----------------------------------------------
+        lineStart = lineEnd;
+        while (lineStart < size && (headers[lineStart] == '\r' || headers[lineStart] == '\n')) {
+            lineStart++;
+        }
+    }
+    return -1;
+}
 
-            message.remove(0, payloadSize);
-        } else {
-            // we've read all messages
-            break;
+bool LSPFrameReader::next(QByteArray* payload) {
+    Q_ASSERT(payload != nullptr);
+
+    while (this->length < 0) {
+        int end = this->buffer.indexOf("\r\n\r\n", this->offset);
+        if (end == -1) {
+            return false;
+        }
+        this->length = LSPFrameReader::contentLength(this->buffer.constData() + this->offset, end - this->offset);
+        if (this->length < 0) {
+            qWarning() << "LSPFrameReader::next: no Content-Length in the headers, skipping them";
         }
+        this->offset = end + 4;
     }
-    return rv;
+
+    if (this->buffer.size() - this->offset < this->length) {
+        // not entirely received yet
+        return false;
+    }
+
+    *payload = QByteArray::fromRawData(this->buffer.constData() + this->offset, this->length);
+    this->offset += this->length;
+    this->length = -1;
+    return true;
 }
 
+// --------------------------
+
 bool LSPReader::isFunc(int kind) {
     return (kind == 2 || kind == 3);
 }
+
+int LSPReader::textDocumentSync(const QJsonDocument& json) {
+    QJsonValue sync = json["result"]["capabilities"]["textDocumentSync"];
+    // either a TextDocumentSyncKind or a TextDocumentSyncOptions
+    if (sync.isDouble()) {
+        return sync.toInt(LSP_TEXT_DOCUMENT_SYNC_FULL);
+    }
+    if (sync.isObject() && sync.toObject().contains("change")) {
+        return sync.toObject()["change"].toInt(LSP_TEXT_DOCUMENT_SYNC_FULL);
+    }
+    return LSP_TEXT_DOCUMENT_SYNC_FULL;
+}
+
+QList<CompleterEntry> LSPReader::completionEntries(const QJsonDocument& json, bool insertText) {
+    QList<CompleterEntry> list;
+
+    QJsonArray items = json["result"]["items"].toArray();
+    list.reserve(items.size());
+    for (int i = 0; i < items.size(); i++) {
+        QJsonObject object = items[i].toObject();
+        bool isFunc = LSPReader::isFunc(object["kind"].toInteger(13));
+        if (insertText) {
+            list.append(CompleterEntry(object["insertText"].toString(), object["label"].toString(), isFunc));
+        } else {
+            list.append(CompleterEntry(object["label"].toString(), object["detail"].toString(), isFunc));
+        }
+    }
+
+    return list;
+}
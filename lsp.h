@@ -1,9 +1,11 @@
 #pragma once
 
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
 #include <QMap>
 #include <QObject>
 #include <QJsonDocument>
-#include <QProcess>
 #include <QString>
 
 #include "buffer.h"
@@ -18,36 +20,96 @@
 #define LSP_ACTION_HOVER_MOUSE 7
 #define LSP_ACTION_INIT 8
 
+// State of a LSP server.
+// It is spawning, then initializing until its reply to the initialize request:
+// the messages sent meanwhile are queued, and sent once it is ready.
+#define LSP_STATE_STOPPED 0
+#define LSP_STATE_SPAWNING 1
+#define LSP_STATE_INITIALIZING 2
+#define LSP_STATE_READY 3
+#define LSP_STATE_CRASHED 4
+
+// TextDocumentSyncKind, how the server wants the documents to be synchronized.
+#define LSP_TEXT_DOCUMENT_SYNC_NONE 0
+#define LSP_TEXT_DOCUMENT_SYNC_FULL 1
+#define LSP_TEXT_DOCUMENT_SYNC_INCREMENTAL 2
+
 class CompleterEntry;
 class LSP;
 class Window;
 
 // LSPWriter is used to generate the LSP messages.
+// The messages are encoded in UTF-8, with their header.
 class LSPWriter
 {
 public:
-    QString initialize(const QString& baseDir);
-    QString initialized();
-    QString openFile(Buffer* buffer, const QString& filepath, const QString& language);
-    QString refreshFile(Buffer* buffer, const QString& filepath);
-    QString definition(int reqId, const QString& filename, int line, int column);
-    QString declaration(int reqId, const QString& filename, int line, int column);
-    QString hover(int reqId, const QString& filename, int line, int column);
-    QString signatureHelp(int reqId, const QString& filename, int line, int column);
-    QString references(int reqId, const QString& filename, int line, int column);
-    QString completion(int reqId, const QString& filename, int line, int column);
+    QByteArray initialize(const QString& baseDir);
+    QByteArray initialized();
+    QByteArray openFile(Buffer* buffer, const QString& filepath, const QString& language);
+    QByteArray refreshFile(const QString& filepath, int version, const QString& text);
+    QByteArray changeFile(const QString& filepath, int version, const QList<BufferChange>& changes);
+    QByteArray definition(int reqId, const QString& filename, int line, int column);
+    QByteArray declaration(int reqId, const QString& filename, int line, int column);
+    QByteArray hover(int reqId, const QString& filename, int line, int column);
+    QByteArray signatureHelp(int reqId, const QString& filename, int line, int column);
+    QByteArray references(int reqId, const QString& filename, int line, int column);
+    QByteArray completion(int reqId, const QString& filename, int line, int column);
+    QByteArray cancelRequest(int reqId);
 
 protected:
 private:
-    QString payload(QString& content);
+    // payload encodes the message and prepends its header, the
+    // Content-Length being its size in bytes.
+    QByteArray payload(const QJsonObject& object);
+};
+
+// LSPFrameReader splits what a LSP server writes in messages. The data is
+// read by chunks which can contain several messages or only a part of one:
+// what has not been entirely received is kept until the next chunk.
+class LSPFrameReader
+{
+public:
+    LSPFrameReader();
+
+    // append appends data read from the server.
+    void append(const QByteArray& data);
+
+    // next sets payload to the content of the next complete message.
+    // Returns false if there is none.
+    // The payload is not a copy, it is only valid until the next call to
+    // append.
+    bool next(QByteArray* payload);
+
+    // clear drops everything not read yet, e.g. when the server restarts.
+    void clear();
+
+    // contentLength returns the value of the Content-Length header in the
+    // given headers, -1 if there is none.
+    static int contentLength(const char* headers, int size);
+
+private:
+    QByteArray buffer;
+    // start of what has not been read yet in buffer.
+    int offset;
+    // size of the content of the message being read, -1 while its
+    // headers have not been entirely received.
+    int length;
 };
 
 // LSPReader reads LSP messages.
 class LSPReader
 {
 public:
-    static QList<QJsonDocument> readMessage(QByteArray message);
     static bool isFunc(int kind);
+
+    // textDocumentSync returns the TextDocumentSyncKind announced by the server
+    // in its reply to the initialize request. Defaults to the full sync.
+    static int textDocumentSync(const QJsonDocument& json);
+
+    // completionEntries returns the entries of a completion reply. With
+    // insertText, the entries are the insertText of the items with their
+    // label as information, otherwise their label with their detail.
+    static QList<CompleterEntry> completionEntries(const QJsonDocument& json, bool insertText);
 };
 
 class LSP : public QObject
@@ -57,28 +119,36 @@ public:
     LSP(Window* window);
     virtual ~LSP();
 
-    // readStandardOutput is called when the LSP server has sent new data to read.
-    virtual void readStandardOutput() = 0;
+    // start spawns the server and initializes it in the background, the
+    // messages sent meanwhile are sent once it is ready.
+    // Returns false if the server can't be started.
+    virtual bool start() = 0;
 
     // lsp protocol
-    virtual bool start() = 0;
     virtual void openFile(Buffer* buffer) = 0;
     virtual void refreshFile(Buffer* buffer) = 0;
-    virtual void initialize(Buffer* buffer) = 0;
     virtual void definition(int reqId, const QString& filename, int line, int column) = 0;
     virtual void declaration(int reqId, const QString& filename, int line, int column) = 0;
     virtual void hover(int reqId, const QString& filename, int line, int column) = 0;
     virtual void signatureHelp(int reqId, const QString& filename, int line, int column) = 0;
     virtual void references(int reqId, const QString& filename, int line, int column) = 0;
     virtual void completion(int reqId, const QString& filename, int line, int column) = 0;
-    virtual QList<CompleterEntry> getEntries(const QJsonDocument& json) = 0;
+    // cancelRequest tells the server that the reply of the given request is
+    // not needed anymore.
+    virtual void cancelRequest(int reqId) = 0;
     virtual QString getLanguage() = 0;
 
-private slots:
-    void readyReadStandardOutput();
+    // setTextDocumentSync sets how the server wants the documents to be
+    // synchronized, see LSP_TEXT_DOCUMENT_SYNC_*.
+    virtual void setTextDocumentSync(int kind) { this->textDocumentSync = kind; }
+
+    // getState returns the state of the server, see LSP_STATE_*.
+    virtual int getState() { return this->state; }
+
 protected:
     Window* window;
-    QProcess lspServer;
-    bool serverSpawned;
+    int state;
+    // textDocumentSync is the sync kind announced by the server, see LSP_TEXT_DOCUMENT_SYNC_*.
+    int textDocumentSync;
 private:
 };
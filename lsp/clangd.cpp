@@ -1,10 +1,7 @@
 #include <QDir>
 #include <QFileInfo>
-#include <QJsonArray>
-#include <QJsonObject>
 #include <QStringList>
 
-#include "../completer.h"
 #include "../lsp.h"
 #include "../window.h"
 #include "clangd.h"
@@ -12,26 +9,19 @@
 
 LSPClangd::LSPClangd(Window* window, const QString& baseDir) : LSP(window) {
     this->generic = new LSPGeneric(window, baseDir, "cpp", "clangd", QStringList() << "--completion-style=detailed");
+    this->generic->setCompletionInsertText(true);
 }
 
 LSPClangd::~LSPClangd() {
     delete this->generic;
 }
 
-void LSPClangd::readStandardOutput() {
-    this->generic->readStandardOutput();
-}
-
 // --------------------------
 
 bool LSPClangd::start() {
     return this->generic->start();
 }
 
-void LSPClangd::initialize(Buffer* buffer) {
-    this->generic->initialize(buffer);
-}
-
 void LSPClangd::openFile(Buffer* buffer) {
     this->generic->openFile(buffer);
 }
@@ -64,29 +54,18 @@ void LSPClangd::completion(int reqId, const QString& filename, int line, int col
     this->generic->completion(reqId, filename, line, column);
 }
 
+void LSPClangd::cancelRequest(int reqId) {
+    this->generic->cancelRequest(reqId);
+}
+
 QString LSPClangd::getLanguage() {
     return this->generic->getLanguage();
 }
 
-QList<CompleterEntry> LSPClangd::getEntries(const QJsonDocument& json) {
-    QList<CompleterEntry> list;
-
-    if (json[tr("result")].isNull() || json[tr("result")][tr("items")].isNull()) {
-        return list;
-    }
-
-    QJsonArray items = json[tr("result")][tr("items")].toArray();
-
-    if (items.size() == 0) {
-        this->window->getStatusBar()->setMessage("Nothing found.");
-        return list;
-    }
-
-
-    for (int i = 0; i < items.size(); i++) {
-        QJsonObject object = items[i].toObject();
-        list.append(CompleterEntry(object[tr("insertText")].toString(), object[tr("label")].toString(), LSPReader::isFunc(object[tr("kind")].toInteger(13))));
-    }
+void LSPClangd::setTextDocumentSync(int kind) {
+    this->generic->setTextDocumentSync(kind);
+}
 
-    return list;
+int LSPClangd::getState() {
+    return this->generic->getState();
 }
@@ -1,130 +1,182 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QJsonArray>
+#include <QJsonDocument>
 #include <QJsonObject>
 #include <QProcessEnvironment>
+#include <QStandardPaths>
 #include <QStringList>
 
 #include "../completer.h"
 #include "../lsp.h"
+#include "../lsp_connection.h"
 #include "../window.h"
 #include "generic.h"
 
+#include "qdebug.h"
+
 LSPGeneric::LSPGeneric(Window* window, const QString& baseDir, const QString& language, const QString& command, QStringList args) : LSP(window) {
-    this->serverSpawned = false;
     this->language = language;
     this->baseDir = baseDir;
     this->command = command;
     this->args = args;
+    this->init();
 }
 
 LSPGeneric::LSPGeneric(Window* window, const QString& baseDir, const QString& language,
                        const QString& command, QStringList args, QProcessEnvironment extraEnv) : LSP(window) {
-    this->serverSpawned = false;
     this->language = language;
     this->baseDir = baseDir;
     this->command = command;
     this->args = args;
     this->extraEnv = extraEnv;
+    this->init();
 }
 
 LSPGeneric::~LSPGeneric() {
-    this->lspServer.kill();
-    this->lspServer.waitForFinished(1000);
+    LSPConnection* connection = this->connection;
+    QMetaObject::invokeMethod(connection, [connection]() { connection->stop(); }, Qt::BlockingQueuedConnection);
+    this->thread.quit();
+    this->thread.wait();
+    delete this->connection;
 }
 
-void LSPGeneric::readStandardOutput() {
-    if (this->window == nullptr) {
-        return;
-    }
-    QByteArray data = this->lspServer.readAll();
-    this->window->lspInterpretMessages(data);
+void LSPGeneric::init() {
+    this->connection = new LSPConnection(this->window->getFileContentService());
+    this->connection->moveToThread(&this->thread);
+    // queued: received on the GUI thread
+    connect(this->connection, &LSPConnection::results, this, [this](const QList<LSPResult>& results) {
+        for (int i = 0; i < results.size(); i++) {
+            if (results[i].action == LSP_ACTION_INIT) {
+                this->setTextDocumentSync(results[i].textDocumentSync);
+            }
+        }
+        if (this->window != nullptr) {
+            this->window->lspInterpretResults(results);
+        }
+    });
+    connect(this->connection, &LSPConnection::stateChanged, this, [this](int state) {
+        this->state = state;
+        if (state == LSP_STATE_CRASHED && this->window != nullptr) {
+            this->window->getStatusBar()->setMessage("The LSP server " + this->command + " has stopped.");
+        }
+    });
+    this->thread.start();
+}
+
+void LSPGeneric::setCompletionInsertText(bool insertText) {
+    LSPConnection* connection = this->connection;
+    QMetaObject::invokeMethod(connection, [connection, insertText]() {
+        connection->setCompletionInsertText(insertText);
+    }, Qt::QueuedConnection);
+}
+
+void LSPGeneric::write(const QByteArray& message) {
+    LSPConnection* connection = this->connection;
+    QMetaObject::invokeMethod(connection, [connection, message]() {
+        connection->write(message);
+    }, Qt::QueuedConnection);
+}
+
+void LSPGeneric::request(int reqId, int action, const QByteArray& message) {
+    LSPConnection* connection = this->connection;
+    QMetaObject::invokeMethod(connection, [connection, reqId, action, message]() {
+        connection->request(reqId, action, message);
+    }, Qt::QueuedConnection);
 }
 
 // --------------------------
 
 bool LSPGeneric::start() {
+    if (QStandardPaths::findExecutable(this->command).isEmpty()) {
+        qWarning() << "LSPGeneric::start: can't find" << this->command;
+        return false;
+    }
+
     QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
     env.insert(this->extraEnv);
-    this->lspServer.setEnvironment(env.toStringList());
-
-    this->lspServer.start(this->command, this->args);
-    this->serverSpawned = this->lspServer.waitForStarted(5000);
-    return this->serverSpawned;
-}
-
-void LSPGeneric::initialize(Buffer* buffer) {
-    Q_ASSERT(buffer != nullptr);
 
-    const QString& initialize = this->writer.initialize(this->baseDir);
-    const QString& initialized = this->writer.initialized();
-    this->lspServer.write(initialize.toUtf8());
-    this->window->getLSPManager()->setExecutedAction(1, LSP_ACTION_INIT, buffer);
-    this->lspServer.write(initialized.toUtf8());
+    LSPConnection* connection = this->connection;
+    const QString command = this->command;
+    const QStringList args = this->args;
+    const QStringList envList = env.toStringList();
+    const QByteArray initialize = this->writer.initialize(this->baseDir);
+    const QByteArray initialized = this->writer.initialized();
+    this->state = LSP_STATE_SPAWNING;
+    QMetaObject::invokeMethod(connection, [connection, command, args, envList, initialize, initialized]() {
+        connection->start(command, args, envList, initialize, initialized);
+    }, Qt::QueuedConnection);
+    return true;
 }
 
 void LSPGeneric::openFile(Buffer* buffer) {
     Q_ASSERT(buffer != nullptr);
 
-    const QString& msg = this->writer.openFile(buffer, buffer->getFilename(), this->language);
-    this->lspServer.write(msg.toUtf8());
+    // didOpen is sending the whole text, as its version 1
+    buffer->resetChanges(1);
+    const QByteArray& msg = this->writer.openFile(buffer, buffer->getFilename(), this->language);
+    this->write(msg);
 }
 
 void LSPGeneric::refreshFile(Buffer* buffer) {
     Q_ASSERT(buffer != nullptr);
 
-    const QString& msg = this->writer.refreshFile(buffer, buffer->getFilename());
-    this->lspServer.write(msg.toUtf8());
+    if (this->textDocumentSync == LSP_TEXT_DOCUMENT_SYNC_NONE) {
+        return;
+    }
+
+    QList<BufferChange> changes;
+    bool fullSync = false;
+    int version = buffer->takeChanges(&changes, &fullSync);
+    if (version == -1) {
+        // nothing has changed since the last sync
+        return;
+    }
+
+    QByteArray msg;
+    if (fullSync || this->textDocumentSync != LSP_TEXT_DOCUMENT_SYNC_INCREMENTAL) {
+        msg = this->writer.refreshFile(buffer->getFilename(), version, buffer->snapshot().toString());
+    } else {
+        msg = this->writer.changeFile(buffer->getFilename(), version, changes);
+    }
+    this->write(msg);
 }
 
 void LSPGeneric::definition(int reqId, const QString& filename, int line, int column) {
-    const QString& msg = this->writer.definition(reqId, filename, line, column);
-    this->lspServer.write(msg.toUtf8());
+    const QByteArray& msg = this->writer.definition(reqId, filename, line, column);
+    this->request(reqId, LSP_ACTION_DEFINITION, msg);
 }
 
 void LSPGeneric::declaration(int reqId, const QString& filename, int line, int column) {
-    const QString& msg = this->writer.declaration(reqId, filename, line, column);
-    this->lspServer.write(msg.toUtf8());
+    const QByteArray& msg = this->writer.declaration(reqId, filename, line, column);
+    this->request(reqId, LSP_ACTION_DECLARATION, msg);
 }
 
 void LSPGeneric::hover(int reqId, const QString& filename, int line, int column) {
-    const QString& msg = this->writer.hover(reqId, filename, line, column);
-    this->lspServer.write(msg.toUtf8());
+    // the replies of the mouse hovers are interpreted the same way
+    const QByteArray& msg = this->writer.hover(reqId, filename, line, column);
+    this->request(reqId, LSP_ACTION_HOVER, msg);
 }
 
 void LSPGeneric::signatureHelp(int reqId, const QString& filename, int line, int column) {
-    const QString& msg = this->writer.signatureHelp(reqId, filename, line, column);
-    this->lspServer.write(msg.toUtf8());
+    const QByteArray& msg = this->writer.signatureHelp(reqId, filename, line, column);
+    this->request(reqId, LSP_ACTION_SIGNATURE_HELP, msg);
 }
 
 void LSPGeneric::references(int reqId, const QString& filename, int line, int column) {
-    const QString& msg = this->writer.references(reqId, filename, line, column);
-    this->lspServer.write(msg.toUtf8());
+    const QByteArray& msg = this->writer.references(reqId, filename, line, column);
+    this->request(reqId, LSP_ACTION_REFERENCES, msg);
 }
 
 void LSPGeneric::completion(int reqId, const QString& filename, int line, int column) {
-    const QString& msg = this->writer.completion(reqId, filename, line, column);
-    this->lspServer.write(msg.toUtf8());
+    const QByteArray& msg = this->writer.completion(reqId, filename, line, column);
+    this->request(reqId, LSP_ACTION_COMPLETION, msg);
 }
 
-QList<CompleterEntry> LSPGeneric::getEntries(const QJsonDocument& json) {
-    QList<CompleterEntry> list;
-
-    if (json["result"].isNull() || json["result"]["items"].isNull()) {
-        return list;
-    }
-
-    QJsonArray items = json["result"]["items"].toArray();
-
-    if (items.size() == 0) {
-        this->window->getStatusBar()->setMessage("Nothing found.");
-        return list;
-    }
-
-    for (int i = 0; i < items.size(); i++) {
-        QJsonObject object = items[i].toObject();
-        list.append(CompleterEntry(object["label"].toString(), object["detail"].toString(),  LSPReader::isFunc(object["kind"].toInteger(13))));
-    }
-
-    return list;
+void LSPGeneric::cancelRequest(int reqId) {
+    LSPConnection* connection = this->connection;
+    const QByteArray& msg = this->writer.cancelRequest(reqId);
+    QMetaObject::invokeMethod(connection, [connection, reqId, msg]() {
+        connection->cancel(reqId, msg);
+    }, Qt::QueuedConnection);
 }
@@ -1,12 +1,15 @@
+#include <QByteArray>
 #include <QList>
 #include <QProcessEnvironment>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 
 #include "../buffer.h"
 
 class CompleterEntry;
 class LSP;
+class LSPConnection;
 class LSPWriter;
 class Window;
 
@@ -16,27 +19,43 @@ public:
     LSPGeneric(Window* window, const QString& baseDir, const QString& language, const QString& command, QStringList args);
     LSPGeneric(Window* window, const QString& baseDir, const QString& language, const QString& command, QStringList args, QProcessEnvironment extraEnv);
     ~LSPGeneric() override;
-    void readStandardOutput() override;
 
     // protocol
     bool start() override;
     void openFile(Buffer* buffer) override;
     void refreshFile(Buffer* buffer) override;
-    void initialize(Buffer* buffer) override;
     void definition(int reqId, const QString& filename, int line, int column) override;
     void declaration(int reqId, const QString& filename, int line, int column) override;
     void hover(int reqId, const QString& filename, int line, int column) override;
     void signatureHelp(int reqId, const QString& filename, int line, int column) override;
     void references(int reqId, const QString& filename, int line, int column) override;
     void completion(int reqId, const QString& filename, int line, int column) override;
-    QList<CompleterEntry> getEntries(const QJsonDocument& json) override;
+    void cancelRequest(int reqId) override;
     QString getLanguage() override { return this->language; };
 
+    // setCompletionInsertText sets whether the completion entries are using
+    // the insertText of the items, see LSPConnection.
+    void setCompletionInsertText(bool insertText);
+
 private:
+    // init starts the thread of the connection to the server.
+    void init();
+
+    // write sends a notification to the server, from the thread of the connection.
+    void write(const QByteArray& message);
+
+    // request sends a request to the server, from the thread of the connection.
+    void request(int reqId, int action, const QByteArray& message);
+
     QString baseDir;
     QString command;
     QString language;
     QStringList args;
     QProcessEnvironment extraEnv;
     LSPWriter writer;
+
+    // the server is read and written by the connection, on its own thread,
+    // not to block the GUI while the messages are decoded.
+    QThread thread;
+    LSPConnection* connection;
 };
@@ -0,0 +1,262 @@
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QJsonValue>
+#include <QProcessEnvironment>
+
+#include "lsp_connection.h"
+
+#include "qdebug.h"
+
+LSPConnection::LSPConnection(FileContentService* files) :
+    QObject(nullptr),
+    process(nullptr),
+    files(files),
+    state(LSP_STATE_STOPPED),
+    completionInsertText(false) {
+    Q_ASSERT(files != nullptr);
+}
+
+LSPConnection::~LSPConnection() {
+    // stop should have been called on the thread of the connection
+    Q_ASSERT(this->process == nullptr);
+}
+
+void LSPConnection::start(const QString& command, const QStringList& args, const QStringList& env,
+                          const QByteArray& initialize, const QByteArray& initialized) {
+    this->stop();
+
+    // created here to belong to the thread of the connection
+    this->process = new QProcess(this);
+    this->process->setEnvironment(env);
+    connect(this->process, &QProcess::readyReadStandardOutput, this, &LSPConnection::onReadyRead);
+    connect(this->process, &QProcess::started, this, &LSPConnection::onStarted);
+    connect(this->process, &QProcess::errorOccurred, this, &LSPConnection::onErrorOccurred);
+    connect(this->process, &QProcess::finished, this, &LSPConnection::onFinished);
+
+    this->frames.clear();
+    this->actions.clear();
+    this->initialize = initialize;
+    this->initialized = initialized;
+    this->setState(LSP_STATE_SPAWNING);
+    this->process->start(command, args);
+}
+
+void LSPConnection::stop() {
+    this->pending.clear();
+    if (this->process == nullptr) {
+        return;
+    }
+    // not a crash
+    this->process->disconnect(this);
+    this->process->kill();
+    this->process->waitForFinished(1000);
+    delete this->process;
+    this->process = nullptr;
+    this->setState(LSP_STATE_STOPPED);
+}
+
+void LSPConnection::setState(int state) {
+    if (this->state == state) {
+        return;
+    }
+    this->state = state;
+    emit this->stateChanged(state);
+}
+
+void LSPConnection::onStarted() {
+    this->setState(LSP_STATE_INITIALIZING);
+    // initialize is the only message the server can receive before it is ready
+    this->actions[1] = LSP_ACTION_INIT;
+    this->process->write(this->initialize);
+}
+
+void LSPConnection::onErrorOccurred(QProcess::ProcessError error) {
+    if (error != QProcess::FailedToStart && error != QProcess::Crashed) {
+        return;
+    }
+    qWarning() << "LSPConnection::onErrorOccurred:" << this->process->errorString();
+    this->pending.clear();
+    this->setState(LSP_STATE_CRASHED);
+}
+
+void LSPConnection::onFinished() {
+    this->pending.clear();
+    this->setState(LSP_STATE_CRASHED);
+}
+
+void LSPConnection::write(const QByteArray& message) {
+    switch (this->state) {
+        case LSP_STATE_READY:
+            this->process->write(message);
+            break;
+        case LSP_STATE_SPAWNING:
+        case LSP_STATE_INITIALIZING:
+            this->pending.append(message);
+            break;
+        default:
+            // no server to send it to
+            break;
+    }
+}
+
+void LSPConnection::request(int reqId, int action, const QByteArray& message) {
+    this->actions[reqId] = action;
+    this->write(message);
+}
+
+void LSPConnection::cancel(int reqId, const QByteArray& message) {
+    this->actions.remove(reqId);
+    this->write(message);
+}
+
+void LSPConnection::onReadyRead() {
+    this->frames.append(this->process->readAll());
+
+    QList<LSPResult> results;
+    QByteArray payload;
+    while (this->frames.next(&payload)) {
+        QJsonParseError error;
+        QJsonDocument json = QJsonDocument::fromJson(payload, &error);
+        if (error.error != QJsonParseError::NoError) {
+            qWarning() << "LSPConnection::onReadyRead: can't unmarshal the payload:" << error.errorString();
+            continue;
+        }
+        if (json.isNull() || json.isEmpty()) {
+            continue;
+        }
+        LSPResult result = this->interpret(json);
+        if (result.action == LSP_ACTION_INIT && this->state == LSP_STATE_INITIALIZING) {
+            this->process->write(this->initialized);
+            this->setState(LSP_STATE_READY);
+            for (int i = 0; i < this->pending.size(); i++) {
+                this->process->write(this->pending[i]);
+            }
+            this->pending.clear();
+        }
+        results.append(result);
+    }
+
+    if (!results.isEmpty()) {
+        emit this->results(results);
+    }
+}
+
+// --------------------------
+
+LSPResult LSPConnection::interpret(const QJsonDocument& json) {
+    LSPResult result;
+    // only the messages without method are replies to our requests: the
+    // servers are numbering their own requests (e.g. client/registerCapability)
+    // with ids which may be the ones of our pending requests.
+    result.requestId = 0;
+    result.action = LSP_ACTION_UNKNOWN;
+    if (json["method"].isUndefined() && !json["id"].isUndefined()) {
+        result.requestId = json["id"].toInt();
+        result.action = this->actions.take(result.requestId);
+    }
+    result.line = 0;
+    result.column = 0;
+    result.textDocumentSync = LSP_TEXT_DOCUMENT_SYNC_FULL;
+
+    if (result.action == LSP_ACTION_UNKNOWN) {
+        result.method = json["method"].toString();
+
+        // showMessage
+        // -----------
+        if (result.method == "window/showMessage") {
+            result.text = json["params"]["message"].toString();
+
+        // publishDiagnostics
+        // ------------------
+        } else if (result.method == "textDocument/publishDiagnostics") {
+            if (!json["params"]["diagnostics"].isArray()) {
+                qWarning() << "LSPConnection::interpret: \"diagnostics\" is not an array";
+                result.method.clear();
+                return result;
+            }
+            if (json["params"]["uri"].isUndefined()) {
+                qWarning() << "LSPConnection::interpret: no \"uri\" field in diagnostic";
+                result.method.clear();
+                return result;
+            }
+
+            result.file = QFileInfo(json["params"]["uri"].toString().replace("file://", "")).canonicalFilePath();
+            QJsonArray diags = json["params"]["diagnostics"].toArray();
+            for (int i = 0; i < diags.size(); i++) {
+                QJsonObject diag = diags[i].toObject();
+                QJsonObject start = diag["range"].toObject()["start"].toObject();
+                QJsonObject end = diag["range"].toObject()["end"].toObject();
+                if (start["line"].isUndefined() || start["line"].isNull()) {
+                    continue;
+                }
+                LSPDiagnostic diagnostic;
+                diagnostic.line = start["line"].toInt() + 1;
+                diagnostic.column = start["character"].toInt();
+                diagnostic.endLine = end["line"].toInt(diagnostic.line - 1) + 1;
+                diagnostic.endColumn = end["character"].toInt(diagnostic.column);
+                // no severity: up to the client, they are errors here
+                diagnostic.severity = diag["severity"].toInt(DIAGNOSTIC_SEVERITY_ERROR);
+                diagnostic.message = diag["message"].toString();
+                diagnostic.absFilename = result.file;
+                result.diagnostics.append(diagnostic);
+            }
+        }
+        return result;
+    }
+
+    switch (result.action) {
+        case LSP_ACTION_INIT:
+            result.textDocumentSync = LSPReader::textDocumentSync(json);
+            break;
+        case LSP_ACTION_DECLARATION:
+        case LSP_ACTION_DEFINITION:
+            {
+                // TODO(remy): deal with multiple results
+                result.line = json["result"][0]["range"]["start"]["line"].toInt() + 1;
+                result.column = json["result"][0]["range"]["start"]["character"].toInt();
+                result.file = json["result"][0]["uri"].toString();
+                if (result.file.startsWith("file://")) {
+                    result.file.remove(0, 7);
+                }
+                break;
+            }
+        case LSP_ACTION_COMPLETION:
+            result.entries = LSPReader::completionEntries(json, this->completionInsertText);
+            break;
+        case LSP_ACTION_HOVER:
+        case LSP_ACTION_HOVER_MOUSE:
+            result.text = json["result"]["contents"].toObject()["value"].toString();
+            break;
+        case LSP_ACTION_SIGNATURE_HELP:
+            {
+                QJsonArray signatures = json["result"]["signatures"].toArray();
+                for (int i = 0; i < signatures.size(); i++) {
+                    QJsonValue signature = signatures[i];
+                    result.text.append(signature["label"].toString()).append("\n");
+                    result.text.append(signature["documentation"].toString());
+                }
+                break;
+            }
+        case LSP_ACTION_REFERENCES:
+            {
+                QJsonArray list = json["result"].toArray();
+                result.references.reserve(list.size());
+                for (int i = 0; i < list.size(); i++) {
+                    QJsonObject entry = list[i].toObject();
+                    FileLine reference;
+                    reference.line = entry["range"].toObject()["start"].toObject()["line"].toInt() + 1;
+                    reference.file = entry["uri"].toString();
+                    if (reference.file.startsWith("file://")) {
+                        reference.file.remove(0, 7);
+                    }
+                    result.references.append(reference);
+                }
+                this->files->resolve(&result.references);
+                break;
+            }
+    }
+
+    return result;
+}
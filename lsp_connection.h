@@ -0,0 +1,119 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonDocument>
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "completer.h"
+#include "file_content_service.h"
+#include "lsp.h"
+#include "lsp_manager.h"
+
+// LSPResult is a message received from a LSP server, already interpreted
+// for the action it is replying to.
+typedef struct LSPResult {
+    // request the message is replying to, 0 for a notification
+    int requestId;
+    // LSP_ACTION_* of the request, LSP_ACTION_UNKNOWN for a notification
+    int action;
+    // method of a notification
+    QString method;
+    // showMessage, hover and signature help
+    QString text;
+    // definition and declaration, line starting with 1.
+    // Also the file of the diagnostics.
+    QString file;
+    int line;
+    int column;
+    // completion
+    QList<CompleterEntry> entries;
+    // references, with the text of their line
+    QVector<FileLine> references;
+    // publishDiagnostics
+    QList<LSPDiagnostic> diagnostics;
+    // initialize, see LSP_TEXT_DOCUMENT_SYNC_*
+    int textDocumentSync;
+} LSPResult;
+
+// LSPConnection talks to a LSP server process. It lives on its own thread:
+// it writes the messages, splits and decodes what the server sends, and
+// interprets the replies before sending them to the GUI thread, where
+// they only have to be displayed.
+//
+// Its methods must be called on its thread, e.g. with
+// QMetaObject::invokeMethod.
+class LSPConnection : public QObject
+{
+    Q_OBJECT
+public:
+    // files is used to read the lines of the references, it must outlive
+    // the connection.
+    LSPConnection(FileContentService* files);
+    ~LSPConnection();
+
+    // start spawns the server, sends it the initialize request once it has
+    // started, and the initialized notification once it has replied.
+    // Until then, the messages written are queued.
+    void start(const QString& command, const QStringList& args, const QStringList& env,
+               const QByteArray& initialize, const QByteArray& initialized);
+
+    // stop kills the server.
+    void stop();
+
+    // write sends a notification to the server, or queues it until the
+    // server is ready.
+    void write(const QByteArray& message);
+
+    // request sends a request to the server, its reply is interpreted for
+    // the given LSP_ACTION_*.
+    void request(int reqId, int action, const QByteArray& message);
+
+    // cancel sends the cancellation of a request to the server, its reply,
+    // if any, is not interpreted.
+    void cancel(int reqId, const QByteArray& message);
+
+    // setCompletionInsertText sets whether the completion entries are using
+    // the insertText of the items, and their label as information, instead
+    // of their label and their detail.
+    void setCompletionInsertText(bool insertText) { this->completionInsertText = insertText; }
+
+signals:
+    // results is emitted with the messages read from one output of the server.
+    void results(const QList<LSPResult>& results);
+
+    // stateChanged is emitted when the state of the server has changed,
+    // see LSP_STATE_*.
+    void stateChanged(int state);
+
+private slots:
+    void onReadyRead();
+    void onStarted();
+    void onErrorOccurred(QProcess::ProcessError error);
+    void onFinished();
+
+private:
+    // interpret interprets a message from the server.
+    LSPResult interpret(const QJsonDocument& json);
+
+    void setState(int state);
+
+    QProcess* process;
+    FileContentService* files;
+    // see LSP_STATE_*
+    int state;
+    // initialize and initialized messages of the server being started.
+    QByteArray initialize;
+    QByteArray initialized;
+    // messages written before the server is ready.
+    QList<QByteArray> pending;
+    LSPFrameReader frames;
+    // action of the requests waiting for a reply.
+    QHash<int, int> actions;
+    bool completionInsertText;
+};
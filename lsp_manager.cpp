@@ -1,6 +1,8 @@
 #include <QList>
 #include <QString>
-#include <QTime>
+#include <QStringList>
+
+#include <climits>
 
 #include "buffer.h"
 #include "lsp.h"
@@ -11,7 +13,12 @@
 
 #include "qdebug.h"
 
-LSPManager::LSPManager(Window* window) : window(window) {
+// upper bounds in milliseconds of the buckets of the latency histograms,
+// the last bucket is for the replies above.
+static const int latencyBounds[] = { 10, 25, 50, 100, 250, 500, 1000, 2500 };
+static const int latencyBucketsCount = sizeof(latencyBounds) / sizeof(latencyBounds[0]) + 1;
+
+LSPManager::LSPManager(Window* window) : nextId(2), window(window) {
     this->cleanTimer = new QTimer;
     this->cleanTimer->start(2000); // run every 2s
     connect(this->cleanTimer, &QTimer::timeout, this, &LSPManager::timeoutActions);
@@ -20,26 +27,25 @@ LSPManager::LSPManager(Window* window) : window(window) {
 LSPManager::~LSPManager() {
     this->cleanTimer->stop();
     delete this->cleanTimer;
-    for (int i = 0; i < lsps.size(); i++) {
-        LSP* lsp = lsps.takeAt(i);
-        delete lsp;
-    }
+    qDeleteAll(this->lsps);
+    this->lsps.clear();
 }
 
 void LSPManager::timeoutActions() {
-    QList<int> keys = this->executedActions.keys();
-    QList<int> toRemove;
-    for (int i = 0; i < keys.size(); i++) {
-        LSPAction action = this->executedActions[keys.at(i)];
-        // timeout
-        if (action.creationTime.addSecs(LSP_ACTION_TIMEOUT_S) < QTime::currentTime()) {
-            toRemove.append(keys.at(i));
+    for (auto it = this->executedActions.begin(); it != this->executedActions.end();) {
+        const LSPAction& action = it.value();
+        if (!action.elapsed.hasExpired(LSP_ACTION_TIMEOUT_S * 1000)) {
+            ++it;
+            continue;
         }
-    }
-
-    for (int i = 0; i < toRemove.size(); i++) {
-        this->executedActions.remove(toRemove.at(i));
-        qDebug() << "LSPManager::timeoutActions: timeout of request" << toRemove.at(i);
+        qDebug() << "LSPManager::timeoutActions: timeout of request" << action.requestId;
+        // the server can stop working on it
+        LSP* lsp = action.buffer != nullptr ? this->getLSP(action.buffer->getId()) : nullptr;
+        if (lsp != nullptr) {
+            lsp->cancelRequest(action.requestId);
+        }
+        this->recordLatency(action.action, -1);
+        it = this->executedActions.erase(it);
     }
 
     if (this->executedActions.size() == 0) {
@@ -52,65 +58,46 @@ void LSPManager::timeoutActions() {
     this->cleanTimer->start(2000); // run every 2s
 }
 
-LSP* LSPManager::start(Buffer* buffer, const QString& language) {
-    Q_ASSERT(buffer != nullptr);
-
+LSP* LSPManager::start(const QString& language) {
+    LSP* lsp = nullptr;
     if (language == "go") {
-         QProcessEnvironment extraEnv;
-         if (this->window->getProjectSettings() != nullptr &&
-              this->window->getProjectSettings()->contains("goflags")) {
-             extraEnv.insert("GOFLAGS", this->window->getProjectSettings()->value("goflags").toString());
-         }
-
-         LSP* lsp = new LSPGeneric(window, window->getBaseDir(), "go", "gopls", QStringList(), extraEnv);
-
-         if (!lsp->start()) {
-             // TODO(remy): warning here
-             delete lsp;
-             return nullptr;
-         }
-         lsp->initialize(buffer);
-         this->lsps.append(lsp);
-         return lsp;
-    } else if (language == "cpp" || language == "h") {
-        LSP* lsp = new LSPClangd(window, window->getBaseDir());
-        if (!lsp->start()) {
-            // TODO(remy): warning here
-            delete lsp;
-            return nullptr;
+        QProcessEnvironment extraEnv;
+        if (this->window->getProjectSettings() != nullptr &&
+             this->window->getProjectSettings()->contains("goflags")) {
+            extraEnv.insert("GOFLAGS", this->window->getProjectSettings()->value("goflags").toString());
         }
-        lsp->initialize(buffer);
-        this->lsps.append(lsp);
-        return lsp;
+        lsp = new LSPGeneric(window, window->getBaseDir(), "go", "gopls", QStringList(), extraEnv);
+    } else if (language == "cpp" || language == "h") {
+        lsp = new LSPClangd(window, window->getBaseDir());
     } else if (language == "rb" || language == "ruby") {
-        LSP* lsp = new LSPGeneric(window, window->getBaseDir(), "ruby", "solargraph", QStringList() << "stdio");
-        if (!lsp->start()) {
-            qWarning() << "Can't start lsp server.";
-            // TODO(remy): warning here
-            delete lsp;
-            return nullptr;
-        }
-        lsp->initialize(buffer);
-        this->lsps.append(lsp);
-        return lsp;
+        lsp = new LSPGeneric(window, window->getBaseDir(), "ruby", "solargraph", QStringList() << "stdio");
     } else if (language == "zig") {
-        LSP* lsp = new LSPGeneric(window, window->getBaseDir(), "zig", "zls", QStringList());
-        if (!lsp->start()) {
-            // TODO(remy): warning here
-            delete lsp;
-            return nullptr;
+        lsp = new LSPGeneric(window, window->getBaseDir(), "zig", "zls", QStringList());
+    } else {
+        return nullptr;
+    }
+
+    if (!lsp->start()) {
+        qWarning() << "Can't start lsp server for" << language;
+        delete lsp;
+        return nullptr;
+    }
+    this->lsps.append(lsp);
+    return lsp;
+}
+
+void LSPManager::prewarm(const QStringList& languages) {
+    for (const QString& language : languages) {
+        if (this->forLanguage(language) == nullptr) {
+            this->start(language);
         }
-        lsp->initialize(buffer);
-        this->lsps.append(lsp);
-        return lsp;
     }
-    // TODO(remy): warning here
-    return nullptr;
 }
 
 LSP* LSPManager::forLanguage(const QString& language) {
     QString l = language;
     if (l == "h") { l = "cpp"; }
+    if (l == "rb") { l = "ruby"; }
     for (int i = 0; i < this->lsps.size(); i++) {
         if (this->lsps.at(i)->getLanguage() == l) {
             return this->lsps.at(i);
@@ -132,7 +119,7 @@ bool LSPManager::manageBuffer(Buffer* buffer) {
     QFileInfo fi(buffer->getFilename());
     LSP* lsp = this->forLanguage(fi.suffix());
     if (lsp == nullptr) {
-        lsp = this->start(buffer, fi.suffix());
+        lsp = this->start(fi.suffix());
     }
     if (lsp != nullptr) {
         if (refresh) {
@@ -152,10 +139,8 @@ void LSPManager::reload(Buffer* buffer) {
     }
 
     this->lspsPerFile.clear();
-    for (int i = 0; i < lsps.size(); i++) {
-        LSP* lsp = lsps.takeAt(i);
-        delete lsp;
-    }
+    qDeleteAll(this->lsps);
+    this->lsps.clear();
 
     this->manageBuffer(buffer);
 }
@@ -173,43 +158,198 @@ void LSPManager::setExecutedAction(int reqId, int action, Buffer* buffer) {
     a.requestId = reqId;
     a.action = action;
     a.buffer = buffer;
-    a.creationTime = QTime::currentTime();
+    a.line = -1;
+    a.column = -1;
+    a.elapsed.start();
     this->executedActions.insert(reqId, a);
     if (window != nullptr) {
         window->getStatusBar()->setLspRunning(true);
     }
 }
 
+int LSPManager::request(Buffer* buffer, int action, int line, int column) {
+    Q_ASSERT(buffer != nullptr);
+
+    LSP* lsp = this->getLSP(buffer->getId());
+    if (lsp == nullptr || lsp->getState() == LSP_STATE_CRASHED) {
+        return 0;
+    }
+
+    for (auto it = this->executedActions.begin(); it != this->executedActions.end();) {
+        LSPAction& pending = it.value();
+        if (pending.buffer != buffer || !LSPManager::sameKind(pending.action, action)) {
+            ++it;
+            continue;
+        }
+        // the same hover is already on its way, its reply will do
+        if ((action == LSP_ACTION_HOVER || action == LSP_ACTION_HOVER_MOUSE) &&
+                pending.line == line && pending.column == column) {
+            pending.action = action;
+            return pending.requestId;
+        }
+        // superseded
+        lsp->cancelRequest(pending.requestId);
+        it = this->executedActions.erase(it);
+    }
+
+    int reqId = this->nextId++;
+    if (this->nextId == INT_MAX) {
+        this->nextId = 2;
+    }
+
+    const QString& filename = buffer->getFilename();
+    switch (action) {
+        case LSP_ACTION_DEFINITION:
+            lsp->definition(reqId, filename, line, column);
+            break;
+        case LSP_ACTION_DECLARATION:
+            lsp->declaration(reqId, filename, line, column);
+            break;
+        case LSP_ACTION_SIGNATURE_HELP:
+            lsp->signatureHelp(reqId, filename, line, column);
+            break;
+        case LSP_ACTION_REFERENCES:
+            lsp->references(reqId, filename, line, column);
+            break;
+        case LSP_ACTION_COMPLETION:
+            lsp->completion(reqId, filename, line, column);
+            break;
+        case LSP_ACTION_HOVER:
+        case LSP_ACTION_HOVER_MOUSE:
+            lsp->hover(reqId, filename, line, column);
+            break;
+        default:
+            Q_UNREACHABLE();
+            return 0;
+    }
+
+    this->setExecutedAction(reqId, action, buffer);
+    LSPAction& executed = this->executedActions[reqId];
+    executed.line = line;
+    executed.column = column;
+    return reqId;
+}
+
+void LSPManager::forgetBuffer(Buffer* buffer) {
+    Q_ASSERT(buffer != nullptr);
+
+    LSP* lsp = this->getLSP(buffer->getId());
+    for (auto it = this->executedActions.begin(); it != this->executedActions.end();) {
+        const LSPAction& action = it.value();
+        if (action.buffer != buffer) {
+            ++it;
+            continue;
+        }
+        if (lsp != nullptr) {
+            lsp->cancelRequest(action.requestId);
+        }
+        it = this->executedActions.erase(it);
+    }
+
+    if (this->executedActions.size() == 0 && this->window != nullptr) {
+        this->window->getStatusBar()->setLspRunning(false);
+    }
+}
+
+bool LSPManager::sameKind(int action, int other) {
+    if (action == LSP_ACTION_HOVER_MOUSE) { action = LSP_ACTION_HOVER; }
+    if (other == LSP_ACTION_HOVER_MOUSE) { other = LSP_ACTION_HOVER; }
+    return action == other && action != LSP_ACTION_INIT;
+}
+
 LSPAction LSPManager::getExecutedAction(int reqId) {
     if (!this->executedActions.contains(reqId)) {
         LSPAction action;
         action.requestId = 0;
         action.buffer = nullptr;
         action.action = LSP_ACTION_UNKNOWN;
+        action.line = -1;
+        action.column = -1;
         return action;
     }
     LSPAction action = this->executedActions.take(reqId);
+    this->recordLatency(action.action, action.elapsed.elapsed());
     if (this->executedActions.size() == 0) {
         window->getStatusBar()->setLspRunning(false);
     }
     return action;
 }
 
-// Diagnostics
-// -----------
+// Latencies
+// ---------
 
-void LSPManager::addDiagnostic(const QString& absFilepath, LSPDiagnostic diag) {
-    QMap<int, QList<LSPDiagnostic>>& lists = this->diagnostics[absFilepath];
-    QList<LSPDiagnostic>& list = lists[diag.line];
-    list.append(diag);
-    this->diagnostics[absFilepath].insert(diag.line, list);
+QString LSPManager::methodName(int action) {
+    switch (action) {
+        case LSP_ACTION_DEFINITION:
+            return "textDocument/definition";
+        case LSP_ACTION_DECLARATION:
+            return "textDocument/declaration";
+        case LSP_ACTION_SIGNATURE_HELP:
+            return "textDocument/signatureHelp";
+        case LSP_ACTION_REFERENCES:
+            return "textDocument/references";
+        case LSP_ACTION_COMPLETION:
+            return "textDocument/completion";
+        case LSP_ACTION_HOVER:
+        case LSP_ACTION_HOVER_MOUSE:
+            return "textDocument/hover";
+        case LSP_ACTION_INIT:
+            return "initialize";
+    }
+    return "unknown";
 }
 
-QMap<int, QList<LSPDiagnostic>> LSPManager::getDiagnostics(const QString& absFilepath) {
-    return this->diagnostics[absFilepath];
+void LSPManager::recordLatency(int action, qint64 elapsed) {
+    LSPLatency& latency = this->latencies[LSPManager::methodName(action)];
+    if (latency.buckets.isEmpty()) {
+        latency.buckets.fill(0, latencyBucketsCount);
+        latency.count = 0;
+        latency.timeouts = 0;
+        latency.totalMs = 0;
+        latency.maxMs = 0;
+    }
+
+    if (elapsed < 0) {
+        latency.timeouts++;
+        return;
+    }
+
+    int bucket = 0;
+    while (bucket < latencyBucketsCount - 1 && elapsed > latencyBounds[bucket]) {
+        bucket++;
+    }
+    latency.buckets[bucket]++;
+    latency.count++;
+    latency.totalMs += elapsed;
+    latency.maxMs = qMax(latency.maxMs, elapsed);
 }
 
-void LSPManager::clearDiagnostics(const QString& absFilepath) {
-    this->diagnostics[absFilepath].clear();
-    this->diagnostics.remove(absFilepath);
+QString LSPManager::latencyReport() const {
+    if (this->latencies.isEmpty()) {
+        return "No LSP replies yet.";
+    }
+
+    QStringList lines;
+    for (auto it = this->latencies.constBegin(); it != this->latencies.constEnd(); ++it) {
+        const LSPLatency& latency = it.value();
+        QString line = it.key() + ": " + QString::number(latency.count) + " replies";
+        if (latency.count > 0) {
+            line += ", avg " + QString::number(latency.totalMs / latency.count) + "ms";
+            line += ", max " + QString::number(latency.maxMs) + "ms";
+        }
+        if (latency.timeouts > 0) {
+            line += ", " + QString::number(latency.timeouts) + " timeouts";
+        }
+        lines.append(line);
+
+        QStringList buckets;
+        for (int i = 0; i < latency.buckets.size(); i++) {
+            const QString bound = i < latencyBucketsCount - 1 ?
+                "<=" + QString::number(latencyBounds[i]) :
+                ">" + QString::number(latencyBounds[i - 1]);
+            buckets.append(bound + "ms: " + QString::number(latency.buckets[i]));
+        }
+        lines.append("    " + buckets.join("  "));
+    }
+    return lines.join("\n");
 }
@@ -1,13 +1,16 @@
 #pragma once
 
+#include <QElapsedTimer>
 #include <QList>
 #include <QMap>
 #include <QObject>
-#include <QRandomGenerator>
 #include <QString>
-#include <QTime>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
 
 #include "buffer.h"
+#include "diagnostics_store.h"
 
 // consider a request to the LSP server timeouted after 5 seconds
 // if no reply has been received
@@ -20,14 +23,22 @@ typedef struct LSPAction {
     int requestId;
     int action;
     Buffer* buffer;
-    QTime creationTime;
+    // position of the request, -1 if none.
+    int line;
+    int column;
+    // started when the request has been sent, monotonic.
+    QElapsedTimer elapsed;
 } LSPAction;
 
-typedef struct LSPDiagnostic {
-    QString absFilename;
-    QString message;
-    int line;
-} LSPDiagnostic;
+// LSPLatency is the histogram of the round-trip latencies of a LSP method.
+typedef struct LSPLatency {
+    // replies per bucket, see latencyBounds in lsp_manager.cpp.
+    QVector<int> buckets;
+    int count;
+    int timeouts;
+    qint64 totalMs;
+    qint64 maxMs;
+} LSPLatency;
 
 class LSPManager : public QObject
 {
@@ -36,11 +47,14 @@ public:
     LSPManager(Window* window);
     ~LSPManager();
 
-    // start initializes the server and initializes a client for
-    // the given language. Synchronous calls returning a nullptr
-    // if an error occurred. This pointer returned must not be
-    // freed.
-    LSP* start(Buffer* buffer, const QString& language);
+    // start spawns the server for the given language, it is initialized in
+    // the background. Returns a nullptr if there is no server for this language
+    // or if it can't be started. This pointer returned must not be freed.
+    LSP* start(const QString& language);
+
+    // prewarm starts in the background the servers of the given languages which
+    // are not running yet, for them to be ready when the first file is opened.
+    void prewarm(const QStringList& languages);
 
     // manageBuffer let the LSP server managers the given buffer.
     // If it is already managed, it will refresh it in the LSP cache.
@@ -57,27 +71,31 @@ public:
     // request ID. The buffer the user was into at this moment is also stored.
     void setExecutedAction(int reqId, int action, Buffer* buffer);
 
-    // randomId returns a random ID to attribute to an action.
-    int randomId() {
-        int reqId = QRandomGenerator::global()->generate();
-        if (reqId < 0) {
-            reqId *= -1;
-        }
-        return reqId;
-    };
+    // request sends a request for the given LSP_ACTION_* at the given position
+    // in the buffer, and stores it as executed.
+    // A pending request of the same kind for the same buffer has been
+    // superseded by this one: it is cancelled. A hover identical to the
+    // pending one is not sent again.
+    // Returns the ID of the request, 0 if no LSP server manages the buffer.
+    int request(Buffer* buffer, int action, int line, int column);
+
+    // forgetBuffer cancels and drops the pending requests sent for the given
+    // buffer, it has to be called before the buffer is deleted.
+    void forgetBuffer(Buffer* buffer);
 
     // getExecutedAction returns information on the executed action for the
-    // given request ID.
+    // given request ID, and records the latency of its reply.
     LSPAction getExecutedAction(int reqId);
 
-    // TODO(remy): comment me
-    void addDiagnostic(const QString& absFilename, LSPDiagnostic diag);
+    // latencyReport returns the histograms of the latencies of the replies,
+    // per method.
+    QString latencyReport() const;
 
-    // TODO(remy): comment me
-    QMap<int, QList<LSPDiagnostic>> getDiagnostics(const QString& absFilename);
+    // methodName returns the LSP method used for the given LSP_ACTION_*.
+    static QString methodName(int action);
 
-    // TODO(remy): comment me
-    void clearDiagnostics(const QString& absFilename);
+    // getDiagnostics returns the diagnostics published by the servers.
+    DiagnosticsStore& getDiagnostics() { return this->diagnostics; }
 
 protected:
 private:
@@ -95,9 +113,21 @@ private:
     // executedActions is the list of executed actions waiting for a response
     // from the LSP server.
     QMap<int, LSPAction> executedActions;
+    // nextId is the ID of the next request, 1 is used by initialize.
+    int nextId;
+
+    // latencies of the replies per method.
+    QMap<QString, LSPLatency> latencies;
+
+    // recordLatency adds the latency of a reply to the histogram of its
+    // method. A negative elapsed is a timeout.
+    void recordLatency(int action, qint64 elapsed);
+
+    // sameKind returns true if both actions are superseding each other.
+    static bool sameKind(int action, int other);
 
     // diagnostics is storing the diagnostics for the different files.
-    QMap<QString, QMap<int, QList<LSPDiagnostic>>> diagnostics;
+    DiagnosticsStore diagnostics;
 
     Window* window;
 
@@ -0,0 +1,320 @@
+#include <QMetaObject>
+
+#include <algorithm>
+#include <cstring>
+
+#include "mapped_file.h"
+
+#include "qdebug.h"
+
+MappedFile::MappedFile(const QString& filename) :
+    filename(filename),
+    file(filename),
+    data(nullptr),
+    dataSize(0),
+    indexReady(false),
+    indexer(nullptr),
+    cancelled(false),
+    searcher(nullptr),
+    searchGeneration(0) {
+}
+
+MappedFile::~MappedFile() {
+    this->cancelled = true;
+    if (this->indexer != nullptr) {
+        this->indexer->wait();
+        delete this->indexer;
+    }
+    this->searchGeneration++;
+    if (this->searcher != nullptr) {
+        this->searcher->wait();
+        delete this->searcher;
+    }
+    if (this->data != nullptr) {
+        this->file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(this->data)));
+    }
+    this->file.close();
+}
+
+bool MappedFile::open() {
+    if (!this->file.open(QIODevice::ReadOnly)) {
+        qWarning() << "MappedFile::open: can't open" << this->filename << this->file.errorString();
+        return false;
+    }
+
+    this->dataSize = this->file.size();
+    if (this->dataSize == 0) {
+        // nothing to map
+        return true;
+    }
+
+    uchar* mapped = this->file.map(0, this->dataSize);
+    if (mapped == nullptr) {
+        qWarning() << "MappedFile::open: can't map" << this->filename << this->file.errorString();
+        this->dataSize = 0;
+        return false;
+    }
+    this->data = reinterpret_cast<const char*>(mapped);
+    return true;
+}
+
+QVector<qint64> MappedFile::computeIndex() const {
+    QVector<qint64> rv;
+    rv.append(0);
+    const char* current = this->data;
+    const char* end = this->data + this->dataSize;
+    while (current != nullptr && current < end) {
+        if (this->cancelled) {
+            break;
+        }
+        const char* lr = static_cast<const char*>(std::memchr(current, '\n', end - current));
+        if (lr == nullptr) {
+            break;
+        }
+        rv.append(lr - this->data + 1);
+        current = lr + 1;
+    }
+    return rv;
+}
+
+void MappedFile::buildIndex() {
+    if (this->indexReady || this->indexer != nullptr) {
+        return;
+    }
+
+    this->indexer = QThread::create([this]() {
+        QVector<qint64> offsets = this->computeIndex();
+        if (this->cancelled) {
+            return;
+        }
+        // hand the index to the thread owning this object
+        QMetaObject::invokeMethod(this, [this, offsets]() {
+            this->offsets = offsets;
+            this->indexReady = true;
+            emit indexed();
+        }, Qt::QueuedConnection);
+    });
+    this->indexer->start();
+}
+
+void MappedFile::buildIndexSync() {
+    if (this->indexReady) {
+        return;
+    }
+    this->offsets = this->computeIndex();
+    this->indexReady = true;
+}
+
+int MappedFile::lineCount() const {
+    if (!this->indexReady) {
+        return -1;
+    }
+    return this->offsets.size();
+}
+
+qint64 MappedFile::lineOffset(int line) const {
+    if (!this->indexReady || line < 0 || line >= this->offsets.size()) {
+        return -1;
+    }
+    return this->offsets.at(line);
+}
+
+int MappedFile::lineForOffset(qint64 offset) const {
+    if (!this->indexReady) {
+        return -1;
+    }
+    auto it = std::upper_bound(this->offsets.constBegin(), this->offsets.constEnd(), offset);
+    return qMax(0, int(it - this->offsets.constBegin()) - 1);
+}
+
+QString MappedFile::text(qint64 start, qint64 end) const {
+    if (this->data == nullptr || start >= end) {
+        return QString();
+    }
+    QString rv = QString::fromUtf8(this->data + start, end - start);
+    rv.replace("\r\n", "\n");
+    return rv;
+}
+
+QString MappedFile::line(int line) const {
+    return this->lines(line, 1);
+}
+
+QString MappedFile::lines(int from, int count) const {
+    if (this->data == nullptr || from < 0 || count <= 0) {
+        return QString();
+    }
+
+    qint64 start = -1;
+    qint64 end = this->dataSize;
+
+    if (this->indexReady) {
+        if (from >= this->offsets.size()) {
+            return QString();
+        }
+        start = this->offsets.at(from);
+        if (from + count < this->offsets.size()) {
+            end = this->offsets.at(from + count) - 1; // do not include the last line return
+            if (end > start && this->data[end - 1] == '\r') {
+                end--;
+            }
+        }
+        return this->text(start, end);
+    }
+
+    // not indexed yet, look for the lines from the start of the file
+    const char* current = this->data;
+    const char* last = this->data + this->dataSize;
+    int line = 0;
+    while (current < last) {
+        if (line == from) {
+            start = current - this->data;
+        }
+        const char* lr = static_cast<const char*>(std::memchr(current, '\n', last - current));
+        if (lr == nullptr) {
+            break;
+        }
+        line++;
+        if (line == from + count) {
+            end = lr - this->data;
+            if (end > start && this->data[end - 1] == '\r') {
+                end--;
+            }
+            break;
+        }
+        current = lr + 1;
+    }
+
+    if (start == -1) {
+        // empty last line or line not existing
+        return QString();
+    }
+    return this->text(start, end);
+}
+
+// bytes scanned by a search between two checks of its cancellation.
+#define MAPPED_FILE_SEARCH_CHECK 1048576
+
+static inline unsigned char asciiLower(unsigned char c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c + ('a' - 'A');
+    }
+    return c;
+}
+
+qint64 MappedFile::findIn(const QByteArray& needle, qint64 begin, qint64 end, bool backward, int generation) const {
+    const qint64 size = needle.size();
+    begin = qMax(qint64(0), begin);
+    end = qMin(this->dataSize, end);
+    if (this->data == nullptr || size == 0 || end - begin < size) {
+        return -1;
+    }
+
+    const unsigned char* d = reinterpret_cast<const unsigned char*>(this->data);
+    QByteArray lower = needle.toLower();
+    const unsigned char* n = reinterpret_cast<const unsigned char*>(lower.constData());
+
+    // Boyer-Moore-Horspool, on the ASCII folded bytes: the window is moved
+    // according to the byte of the text at its end (at its start backward).
+    qint64 skip[256];
+    for (int i = 0; i < 256; i++) {
+        skip[i] = size;
+    }
+    if (backward) {
+        for (qint64 i = size - 1; i >= 1; i--) {
+            skip[n[i]] = i;
+        }
+    } else {
+        for (qint64 i = 0; i < size - 1; i++) {
+            skip[n[i]] = size - 1 - i;
+        }
+    }
+
+    auto matches = [d, n, size](qint64 pos) {
+        for (qint64 i = size - 1; i >= 0; i--) {
+            if (asciiLower(d[pos + i]) != n[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    qint64 scanned = 0;
+    if (backward) {
+        for (qint64 pos = end - size; pos >= begin; ) {
+            if (matches(pos)) {
+                return pos;
+            }
+            qint64 shift = skip[asciiLower(d[pos])];
+            pos -= shift;
+            scanned += shift;
+            if (scanned > MAPPED_FILE_SEARCH_CHECK) {
+                if (this->searchGeneration != generation) {
+                    return -1;
+                }
+                scanned = 0;
+            }
+        }
+        return -1;
+    }
+
+    for (qint64 pos = begin; pos <= end - size; ) {
+        if (matches(pos)) {
+            return pos;
+        }
+        qint64 shift = skip[asciiLower(d[pos + size - 1])];
+        pos += shift;
+        scanned += shift;
+        if (scanned > MAPPED_FILE_SEARCH_CHECK) {
+            if (this->searchGeneration != generation) {
+                return -1;
+            }
+            scanned = 0;
+        }
+    }
+    return -1;
+}
+
+qint64 MappedFile::find(const QByteArray& needle, qint64 from, bool backward) const {
+    if (backward) {
+        // occurrences starting at from at the latest
+        return this->findIn(needle, 0, from + needle.size(), true, this->searchGeneration);
+    }
+    return this->findIn(needle, from, this->dataSize, false, this->searchGeneration);
+}
+
+void MappedFile::findAsync(const QByteArray& needle, qint64 from, bool backward) {
+    // stop the previous search, it stops after at most a few MB
+    int generation = ++this->searchGeneration;
+    if (this->searcher != nullptr) {
+        this->searcher->wait();
+        delete this->searcher;
+        this->searcher = nullptr;
+    }
+
+    this->searcher = QThread::create([this, needle, from, backward, generation]() {
+        qint64 offset = -1;
+        if (backward) {
+            offset = this->findIn(needle, 0, from + needle.size(), true, generation);
+            if (offset == -1) {
+                // the occurrences after from
+                offset = this->findIn(needle, from + 1, this->dataSize, true, generation);
+            }
+        } else {
+            offset = this->findIn(needle, from, this->dataSize, false, generation);
+            if (offset == -1) {
+                // the occurrences before from
+                offset = this->findIn(needle, 0, from + needle.size() - 1, false, generation);
+            }
+        }
+        if (this->searchGeneration != generation) {
+            return;
+        }
+        QMetaObject::invokeMethod(this, [this, offset, generation]() {
+            if (this->searchGeneration == generation) {
+                emit found(offset);
+            }
+        }, Qt::QueuedConnection);
+    });
+    this->searcher->start();
+}
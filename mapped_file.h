@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+#include <atomic>
+
+// MappedFile gives a read access to a file through a memory mapping.
+// The offsets of its lines can be indexed, on a background thread or not,
+// to then reach any line of the file without reading it.
+class MappedFile : public QObject
+{
+    Q_OBJECT
+public:
+    MappedFile(const QString& filename);
+    ~MappedFile();
+
+    // open maps the file in memory. Returns false if it can't be done.
+    bool open();
+
+    // buildIndex starts indexing the lines on a background thread,
+    // indexed() is emitted when it is done.
+    void buildIndex();
+
+    // buildIndexSync indexes the lines on the current thread.
+    void buildIndexSync();
+
+    bool isIndexed() const { return this->indexReady; }
+
+    const QString& getFilename() const { return this->filename; }
+
+    // size returns the size of the file in bytes.
+    qint64 size() const { return this->dataSize; }
+
+    // lineCount returns the amount of lines in the file, -1 if the
+    // lines are not indexed yet.
+    int lineCount() const;
+
+    // lineOffset returns the offset of the start of the given line (starting with 0).
+    // Returns -1 if the lines are not indexed yet or if the line doesn't exist.
+    qint64 lineOffset(int line) const;
+
+    // lineForOffset returns the line (starting with 0) containing the
+    // given offset, using a binary search in the index.
+    // Returns -1 if the lines are not indexed yet.
+    int lineForOffset(qint64 offset) const;
+
+    // line returns the given line (starting with 0) without its line return.
+    QString line(int line) const;
+
+    // lines returns count lines starting with the given one (starting with 0),
+    // separated with '\n'. When the lines are not indexed yet, the file is
+    // read from its start to find the first line.
+    QString lines(int from, int count) const;
+
+    // text returns the content of the file between the two given offsets.
+    QString text(qint64 start, qint64 end) const;
+
+    // find returns the offset of the next occurrence of needle from the given
+    // offset, or of the previous one if backward is set. ASCII letters are
+    // compared case insensitively, as QTextDocument::find does by default.
+    // Returns -1 if nothing has been found.
+    qint64 find(const QByteArray& needle, qint64 from, bool backward) const;
+
+    // findAsync searches needle as find does on a background thread, and
+    // continues from the other end of the file if nothing has been found in
+    // this direction. found is emitted with the offset of the occurrence,
+    // -1 if none. A search still running is cancelled.
+    void findAsync(const QByteArray& needle, qint64 from, bool backward);
+
+signals:
+    // indexed is emitted when the background indexing of the lines is done.
+    void indexed();
+
+    // found is emitted when a search started with findAsync is done.
+    void found(qint64 offset);
+
+private:
+    // computeIndex returns the offsets of the start of all lines.
+    QVector<qint64> computeIndex() const;
+
+    // findIn returns the first occurrence, or the last one if backward,
+    // of needle entirely between the offsets begin and end. Returns -1 if
+    // none or if the search generation has changed in the meantime.
+    qint64 findIn(const QByteArray& needle, qint64 begin, qint64 end, bool backward, int generation) const;
+
+    QString filename;
+    QFile file;
+
+    const char* data;
+    qint64 dataSize;
+
+    // offsets of the start of every line, only available when indexReady is true.
+    QVector<qint64> offsets;
+    bool indexReady;
+
+    QThread* indexer;
+    std::atomic<bool> cancelled;
+
+    QThread* searcher;
+    // incremented by every search, the running one stops when it changes.
+    std::atomic<int> searchGeneration;
+};
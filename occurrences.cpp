@@ -0,0 +1,106 @@
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+
+#include "editor.h"
+#include "occurrences.h"
+
+Occurrences::Occurrences(Editor* editor) :
+    QObject(editor),
+    editor(editor),
+    wholeWord(false),
+    firstBlock(-1),
+    lastBlock(-1),
+    revision(-1) {
+    Q_ASSERT(editor != nullptr);
+
+    this->format.setForeground(Qt::white);
+    this->format.setBackground(QColor::fromRgb(90, 90, 90));
+
+    this->refreshTimer = new QTimer(this);
+    this->refreshTimer->setSingleShot(true);
+    this->refreshTimer->setInterval(0);
+    connect(this->refreshTimer, &QTimer::timeout, this, &Occurrences::refresh);
+
+    connect(this->editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &Occurrences::refresh);
+    connect(this->editor->verticalScrollBar(), &QScrollBar::rangeChanged, this, &Occurrences::refresh);
+    connect(this->editor->document(), &QTextDocument::contentsChange, this, &Occurrences::onContentsChange);
+}
+
+void Occurrences::setText(const QString& text, bool wholeWord) {
+    if (this->text == text && this->wholeWord == wholeWord) {
+        return;
+    }
+
+    this->text = text;
+    this->wholeWord = wholeWord;
+    this->matcher.setPattern(text);
+    this->matcher.setCaseSensitivity(Qt::CaseSensitive);
+
+    this->firstBlock = -1;
+    this->refresh();
+}
+
+void Occurrences::onContentsChange() {
+    if (this->text.isEmpty()) {
+        return;
+    }
+    this->refreshTimer->start();
+}
+
+bool Occurrences::isWholeWord(const QString& line, int position) const {
+    auto isWordChar = [](QChar c) { return c.isLetterOrNumber() || c == '_'; };
+    int end = position + this->text.size();
+    if (position > 0 && isWordChar(line.at(position - 1))) {
+        return false;
+    }
+    return end >= line.size() || !isWordChar(line.at(end));
+}
+
+void Occurrences::refresh() {
+    QTextDocument* document = this->editor->document();
+
+    if (this->text.isEmpty()) {
+        if (this->firstBlock != -1 || !this->editor->extraSelections().isEmpty()) {
+            this->firstBlock = -1;
+            this->editor->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+        }
+        return;
+    }
+
+    int first = 0, last = 0;
+    this->editor->visibleBlocks(&first, &last);
+    first = qMax(0, first - OCCURRENCES_MARGIN_BLOCKS);
+    last = qMin(document->blockCount() - 1, last + OCCURRENCES_MARGIN_BLOCKS);
+
+    // still in the scanned blocks, and nothing has changed
+    if (this->revision == document->revision() && this->firstBlock != -1 &&
+            first >= this->firstBlock && last <= this->lastBlock) {
+        return;
+    }
+
+    QList<QTextEdit::ExtraSelection> selections;
+    const int size = this->text.size();
+    for (QTextBlock block = document->findBlockByNumber(first);
+         block.isValid() && block.blockNumber() <= last && selections.size() < OCCURRENCES_MAX;
+         block = block.next()) {
+        const QString line = block.text();
+        for (int idx = this->matcher.indexIn(line); idx != -1; idx = this->matcher.indexIn(line, idx + size)) {
+            if (this->wholeWord && !this->isWholeWord(line, idx)) {
+                continue;
+            }
+            QTextEdit::ExtraSelection selection;
+            selection.format = this->format;
+            selection.cursor = QTextCursor(document);
+            selection.cursor.setPosition(block.position() + idx);
+            selection.cursor.setPosition(block.position() + idx + size, QTextCursor::KeepAnchor);
+            selections.append(selection);
+        }
+    }
+
+    this->firstBlock = first;
+    this->lastBlock = last;
+    this->revision = document->revision();
+    this->editor->setExtraSelections(selections);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringMatcher>
+#include <QTextCharFormat>
+#include <QTextEdit>
+#include <QTimer>
+
+// blocks scanned above and below the visible ones.
+#define OCCURRENCES_MARGIN_BLOCKS 50
+// maximum amount of occurrences painted at once, e.g. on long lines.
+#define OCCURRENCES_MAX 2000
+
+class Editor;
+
+// Occurrences paints the occurrences of a text in an editor, over its
+// syntax highlighting, with extra selections.
+//
+// Only the visible blocks (and a margin around them) are scanned, again
+// when the editor is scrolled or edited: it costs the same in a file of
+// any size.
+class Occurrences : public QObject
+{
+    Q_OBJECT
+public:
+    Occurrences(Editor* editor);
+
+    // setText sets the text of which the occurrences are painted, it is
+    // searched as it is and not as a regular expression. When wholeWord is
+    // true, only the occurrences which are not part of a bigger word are
+    // painted. An empty text clears the occurrences.
+    void setText(const QString& text, bool wholeWord);
+
+    const QString& getText() const { return this->text; }
+
+public slots:
+    // refresh scans the visible blocks again.
+    void refresh();
+
+private slots:
+    void onContentsChange();
+
+private:
+    // isWholeWord returns true if the occurrence at position is not part of
+    // a bigger word.
+    bool isWholeWord(const QString& line, int position) const;
+
+    Editor* editor;
+
+    QString text;
+    QStringMatcher matcher;
+    bool wholeWord;
+    QTextCharFormat format;
+
+    // what was scanned by the last refresh, not to scan it again if
+    // nothing has changed.
+    int firstBlock;
+    int lastBlock;
+    int revision;
+
+    // edits are refreshing once the event loop is back.
+    QTimer* refreshTimer;
+};
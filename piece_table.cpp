@@ -0,0 +1,235 @@
+#include <QStringEncoder>
+
+#include "piece_table.h"
+
+// after this many pieces, the text is considered too fragmented and it is
+// compacted in a new original content.
+#define PIECE_TABLE_MAX_PIECES 8192
+// below this many chars no longer referenced by any piece, the table is not
+// compacted, whatever the size of the text.
+#define PIECE_TABLE_MIN_DEAD_CHARS 4096
+
+PieceTable::PieceTable() :
+    length(0) {
+}
+
+PieceTable::PieceTable(const QString& original) :
+    original(original),
+    length(original.size()) {
+    if (this->length > 0) {
+        Piece piece;
+        piece.added = false;
+        piece.start = 0;
+        piece.length = this->length;
+        this->pieces.append(piece);
+    }
+}
+
+QStringView PieceTable::view(const Piece& piece) const {
+    if (piece.added) {
+        return QStringView(this->added).mid(piece.start, piece.length);
+    }
+    return QStringView(this->original).mid(piece.start, piece.length);
+}
+
+int PieceTable::findPiece(int position, int* offset) const {
+    int current = 0;
+    for (int i = 0; i < this->pieces.size(); i++) {
+        const Piece& piece = this->pieces.at(i);
+        if (position >= current && position < current + piece.length) {
+            *offset = current;
+            return i;
+        }
+        current += piece.length;
+    }
+    *offset = current;
+    return this->pieces.size();
+}
+
+void PieceTable::insert(int position, const QString& text) {
+    if (text.isEmpty()) {
+        return;
+    }
+
+    position = qBound(0, position, this->length);
+
+    Piece piece;
+    piece.added = true;
+    piece.start = this->added.size();
+    piece.length = text.size();
+    this->added.append(text);
+
+    int offset = 0;
+    int idx = this->findPiece(position, &offset);
+
+    // typing is mostly appending right after the previous insertion, in this
+    // case we can grow the previous piece instead of creating a new one.
+    if (position == offset && idx > 0) {
+        Piece& previous = this->pieces[idx - 1];
+        if (previous.added && previous.start + previous.length == piece.start) {
+            previous.length += piece.length;
+            this->length += piece.length;
+            return;
+        }
+    }
+
+    if (idx == this->pieces.size() || position == offset) {
+        this->pieces.insert(idx, piece);
+    } else {
+        // split the piece in which we are inserting
+        Piece left = this->pieces.at(idx);
+        Piece right = left;
+        left.length = position - offset;
+        right.start += left.length;
+        right.length -= left.length;
+        this->pieces[idx] = left;
+        this->pieces.insert(idx + 1, piece);
+        this->pieces.insert(idx + 2, right);
+    }
+
+    this->length += piece.length;
+
+    if (this->pieces.size() > PIECE_TABLE_MAX_PIECES) {
+        this->compact();
+    }
+}
+
+void PieceTable::remove(int position, int count) {
+    if (position < 0) {
+        count += position;
+        position = 0;
+    }
+    if (count <= 0 || position >= this->length) {
+        return;
+    }
+    count = qMin(count, this->length - position);
+    int end = position + count;
+
+    // e.g. the whole document being replaced, nothing is referenced anymore
+    if (count == this->length) {
+        this->original.clear();
+        this->added.clear();
+        this->pieces.clear();
+        this->length = 0;
+        return;
+    }
+
+    QVector<Piece> pieces;
+    pieces.reserve(this->pieces.size() + 1);
+    int offset = 0;
+    for (const Piece& piece : this->pieces) {
+        int pieceEnd = offset + piece.length;
+        if (pieceEnd <= position || offset >= end) {
+            // not touched by the removal
+            pieces.append(piece);
+        } else {
+            // keep what's on the left of the removal
+            if (offset < position) {
+                Piece left = piece;
+                left.length = position - offset;
+                pieces.append(left);
+            }
+            // keep what's on the right of the removal
+            if (pieceEnd > end) {
+                Piece right = piece;
+                right.start += end - offset;
+                right.length = pieceEnd - end;
+                pieces.append(right);
+            }
+        }
+        offset = pieceEnd;
+    }
+
+    this->pieces = pieces;
+    this->length -= count;
+
+    // the removed text is still in the original and added strings, they are
+    // copied again when it becomes larger than the text itself.
+    int dead = this->original.size() + this->added.size() - this->length;
+    if (dead > PIECE_TABLE_MIN_DEAD_CHARS && dead > this->length) {
+        this->compact();
+    }
+}
+
+QString PieceTable::mid(int position, int count) const {
+    QString rv;
+    if (position < 0) {
+        count += position;
+        position = 0;
+    }
+    if (count <= 0 || position >= this->length) {
+        return rv;
+    }
+    count = qMin(count, this->length - position);
+    rv.reserve(count);
+
+    int end = position + count;
+    int offset = 0;
+    for (const Piece& piece : this->pieces) {
+        int pieceEnd = offset + piece.length;
+        if (pieceEnd > position && offset < end) {
+            int from = qMax(position, offset) - offset;
+            int to = qMin(end, pieceEnd) - offset;
+            rv.append(this->view(piece).mid(from, to - from));
+        }
+        if (pieceEnd >= end) {
+            break;
+        }
+        offset = pieceEnd;
+    }
+    return rv;
+}
+
+QString PieceTable::toString() const {
+    // no need to copy anything when the text has not been edited
+    if (this->pieces.size() == 1 && !this->pieces.at(0).added &&
+            this->pieces.at(0).length == this->original.size()) {
+        return this->original;
+    }
+
+    QString rv;
+    rv.reserve(this->length);
+    for (const Piece& piece : this->pieces) {
+        rv.append(this->view(piece));
+    }
+    return rv;
+}
+
+QByteArray PieceTable::toUtf8() const {
+    // the encoder is stateful: a surrogate pair split by two pieces is still
+    // properly encoded.
+    QStringEncoder encoder(QStringEncoder::Utf8);
+    QByteArray rv;
+    rv.reserve(this->length);
+    for (const Piece& piece : this->pieces) {
+        QByteArray data = encoder(this->view(piece));
+        rv.append(data);
+    }
+    return rv;
+}
+
+bool PieceTable::writeTo(QIODevice* device) const {
+    Q_ASSERT(device != nullptr);
+
+    QStringEncoder encoder(QStringEncoder::Utf8);
+    for (const Piece& piece : this->pieces) {
+        QByteArray data = encoder(this->view(piece));
+        if (device->write(data) != data.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PieceTable::compact() {
+    this->original = this->toString();
+    this->added.clear();
+    this->pieces.clear();
+    if (this->length > 0) {
+        Piece piece;
+        piece.added = false;
+        piece.start = 0;
+        piece.length = this->length;
+        this->pieces.append(piece);
+    }
+}
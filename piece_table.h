@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+// PieceTable stores a text as a list of pieces pointing either in the
+// original content (what has been read from disk) or in an append-only
+// buffer receiving everything inserted afterwards.
+//
+// Positions are expressed in QChar, the same way QTextDocument does it, with
+// a '\n' for every paragraph separator.
+//
+// Copying a PieceTable is cheap (the strings and the pieces are implicitly
+// shared), which is what is used to provide snapshots of a Buffer.
+class PieceTable
+{
+public:
+    PieceTable();
+    PieceTable(const QString& original);
+
+    // size returns the amount of QChar in the text.
+    int size() const { return this->length; }
+    bool isEmpty() const { return this->length == 0; }
+
+    // insert inserts the given text at the given position.
+    void insert(int position, const QString& text);
+
+    // remove removes count chars starting at the given position.
+    void remove(int position, int count);
+
+    // mid returns count chars starting at the given position.
+    QString mid(int position, int count) const;
+
+    // toString returns the whole text.
+    QString toString() const;
+
+    // toUtf8 returns the whole text encoded in UTF-8.
+    QByteArray toUtf8() const;
+
+    // writeTo encodes the text in UTF-8 and writes it piece by piece in the
+    // given device. Returns false if an error occurred.
+    bool writeTo(QIODevice* device) const;
+
+    // piecesCount returns how many pieces are composing the text.
+    int piecesCount() const { return this->pieces.size(); }
+
+protected:
+private:
+    typedef struct Piece {
+        bool added; // true when pointing in the append buffer
+        int start;
+        int length;
+    } Piece;
+
+    // view returns the part of the text a piece is pointing to.
+    QStringView view(const Piece& piece) const;
+
+    // findPiece returns the index of the piece containing the given position
+    // and stores in offset the position of this piece in the text.
+    // Returns pieces.size() if the position is the end of the text.
+    int findPiece(int position, int* offset) const;
+
+    // compact merges all the pieces into a new original content, it is used
+    // when the text has been too much fragmented by the edits, or when most
+    // of the original and added strings is not referenced anymore.
+    void compact();
+
+    QString original;
+    QString added;
+    QVector<Piece> pieces;
+    int length;
+};
@@ -0,0 +1,237 @@
+#include <algorithm>
+
+#include "references_model.h"
+
+ReferencesModel::ReferencesModel(QObject* parent) :
+    QAbstractItemModel(parent),
+    referencesCount(0) {
+}
+
+ReferencesModel::~ReferencesModel() {
+    qDeleteAll(this->files);
+}
+
+void ReferencesModel::clear() {
+    this->beginResetModel();
+    qDeleteAll(this->files);
+    this->files.clear();
+    this->referencesCount = 0;
+    this->endResetModel();
+}
+
+static bool fileLessThan(const QString& labelA, const QString& pathA, const QString& labelB, const QString& pathB) {
+    if (labelA != labelB) {
+        return labelA < labelB;
+    }
+    return pathA < pathB;
+}
+
+int ReferencesModel::fileRow(const QString& label, const QString& path) const {
+    auto it = std::lower_bound(this->files.constBegin(), this->files.constEnd(), nullptr,
+        [&label, &path](const ReferencesFile* file, std::nullptr_t) {
+            return fileLessThan(file->label, file->path, label, path);
+        });
+    return it - this->files.constBegin();
+}
+
+void ReferencesModel::add(QVector<ReferencesEntry> entries) {
+    std::stable_sort(entries.begin(), entries.end(), [](const ReferencesEntry& a, const ReferencesEntry& b) {
+        if (a.path != b.path) {
+            return fileLessThan(a.label, a.path, b.label, b.path);
+        }
+        return a.line < b.line;
+    });
+
+    int i = 0;
+    while (i < entries.size()) {
+        // [i, j) are the references of one file, sorted by line
+        int j = i + 1;
+        while (j < entries.size() && entries.at(j).path == entries.at(i).path) {
+            j++;
+        }
+
+        const ReferencesEntry& first = entries.at(i);
+        int row = this->fileRow(first.label, first.path);
+        if (row < this->files.size() && this->files.at(row)->path == first.path) {
+            this->merge(row, entries, i, j);
+        } else {
+            ReferencesFile* file = new ReferencesFile();
+            file->path = first.path;
+            file->label = first.label;
+            file->lines.reserve(j - i);
+            file->texts.reserve(j - i);
+            for (int k = i; k < j; k++) {
+                file->lines.append(entries.at(k).line);
+                file->texts.append(entries.at(k).text);
+            }
+            this->beginInsertRows(QModelIndex(), row, row);
+            this->files.insert(row, file);
+            this->endInsertRows();
+        }
+
+        this->referencesCount += j - i;
+        i = j;
+    }
+}
+
+void ReferencesModel::merge(int row, const QVector<ReferencesEntry>& entries, int from, int to) {
+    ReferencesFile* file = this->files.at(row);
+    QModelIndex parent = this->index(row, 0);
+
+    // the references of a file are usually arriving in order
+    if (entries.at(from).line >= file->lines.last()) {
+        int child = file->lines.size() - 1;
+        this->beginInsertRows(parent, child, child + (to - from) - 1);
+        for (int k = from; k < to; k++) {
+            file->lines.append(entries.at(k).line);
+            file->texts.append(entries.at(k).text);
+        }
+        this->endInsertRows();
+        return;
+    }
+
+    for (int k = from; k < to; k++) {
+        int line = entries.at(k).line;
+        int position = std::upper_bound(file->lines.begin(), file->lines.end(), line) - file->lines.begin();
+        // the first reference is shown by the file row, the others are
+        // children: inserting a new first one moves the previous one to
+        // the first child.
+        int child = qMax(0, position - 1);
+        this->beginInsertRows(parent, child, child);
+        file->lines.insert(position, line);
+        file->texts.insert(position, entries.at(k).text);
+        this->endInsertRows();
+        if (position == 0) {
+            emit dataChanged(this->index(row, 0), this->index(row, 2));
+        }
+    }
+}
+
+void ReferencesModel::remove(const QModelIndex& index) {
+    if (!index.isValid()) {
+        return;
+    }
+
+    if (index.internalPointer() == nullptr) {
+        int row = index.row();
+        this->beginRemoveRows(QModelIndex(), row, row);
+        ReferencesFile* file = this->files.takeAt(row);
+        this->referencesCount -= file->lines.size();
+        delete file;
+        this->endRemoveRows();
+        return;
+    }
+
+    ReferencesFile* file = static_cast<ReferencesFile*>(index.internalPointer());
+    int position = index.row() + 1;
+    this->beginRemoveRows(index.parent(), index.row(), index.row());
+    file->lines.remove(position);
+    file->texts.removeAt(position);
+    this->referencesCount--;
+    this->endRemoveRows();
+}
+
+ReferencesFile* ReferencesModel::reference(const QModelIndex& index, int* position) const {
+    if (!index.isValid()) {
+        return nullptr;
+    }
+    if (index.internalPointer() == nullptr) {
+        *position = 0;
+        return this->files.at(index.row());
+    }
+    *position = index.row() + 1;
+    return static_cast<ReferencesFile*>(index.internalPointer());
+}
+
+QString ReferencesModel::path(const QModelIndex& index) const {
+    int position = 0;
+    ReferencesFile* file = this->reference(index, &position);
+    return file != nullptr ? file->path : QString();
+}
+
+int ReferencesModel::line(const QModelIndex& index) const {
+    int position = 0;
+    ReferencesFile* file = this->reference(index, &position);
+    if (file == nullptr || position >= file->lines.size()) {
+        return -1;
+    }
+    return file->lines.at(position);
+}
+
+QModelIndex ReferencesModel::index(int row, int column, const QModelIndex& parent) const {
+    if (row < 0 || column < 0 || column >= 3) {
+        return QModelIndex();
+    }
+    if (!parent.isValid()) {
+        if (row >= this->files.size()) {
+            return QModelIndex();
+        }
+        return this->createIndex(row, column, nullptr);
+    }
+    if (parent.internalPointer() != nullptr || parent.row() >= this->files.size()) {
+        return QModelIndex();
+    }
+    ReferencesFile* file = this->files.at(parent.row());
+    if (row >= file->lines.size() - 1) {
+        return QModelIndex();
+    }
+    return this->createIndex(row, column, file);
+}
+
+QModelIndex ReferencesModel::parent(const QModelIndex& index) const {
+    if (!index.isValid() || index.internalPointer() == nullptr) {
+        return QModelIndex();
+    }
+    const ReferencesFile* file = static_cast<ReferencesFile*>(index.internalPointer());
+    int row = this->fileRow(file->label, file->path);
+    return this->createIndex(row, 0, nullptr);
+}
+
+int ReferencesModel::rowCount(const QModelIndex& parent) const {
+    if (!parent.isValid()) {
+        return this->files.size();
+    }
+    if (parent.internalPointer() != nullptr || parent.column() != 0) {
+        return 0;
+    }
+    return this->files.at(parent.row())->lines.size() - 1;
+}
+
+int ReferencesModel::columnCount(const QModelIndex&) const {
+    return 3;
+}
+
+QVariant ReferencesModel::data(const QModelIndex& index, int role) const {
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    int position = 0;
+    ReferencesFile* file = this->reference(index, &position);
+    if (file == nullptr || position >= file->lines.size()) {
+        return QVariant();
+    }
+    switch (index.column()) {
+        case 0:
+            return file->label;
+        case 1:
+            return QString::number(file->lines.at(position));
+        case 2:
+            return file->texts.at(position);
+    }
+    return QVariant();
+}
+
+QVariant ReferencesModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    switch (section) {
+        case 0:
+            return QString("File");
+        case 1:
+            return QString("Line #");
+        case 2:
+            return QString("Line");
+    }
+    return QVariant();
+}
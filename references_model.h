@@ -0,0 +1,81 @@
+#pragma once
+
+#include <QAbstractItemModel>
+#include <QList>
+#include <QModelIndex>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+// ReferencesEntry is a reference to add to the model.
+typedef struct ReferencesEntry {
+    QString path;
+    // label displayed for the file
+    QString label;
+    int line;
+    QString text;
+} ReferencesEntry;
+
+// ReferencesFile is all the references in one file. They are stored by
+// columns sorted by line: the reference i is on lines[i], showing texts[i].
+typedef struct ReferencesFile {
+    QString path;
+    QString label;
+    QVector<int> lines;
+    QStringList texts;
+} ReferencesFile;
+
+// ReferencesModel is a two levels model of references: a row per file,
+// showing its first reference, with the other references of the file as
+// children. Files are sorted by label, references by line.
+class ReferencesModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    ReferencesModel(QObject* parent);
+    ~ReferencesModel();
+
+    // add adds the references at their sorted position.
+    void add(QVector<ReferencesEntry> entries);
+
+    // remove removes the reference at the given index, and all the other
+    // references of the file if it is a file row.
+    void remove(const QModelIndex& index);
+
+    void clear();
+
+    // count returns how many references are in the model.
+    int count() const { return this->referencesCount; }
+
+    // path returns the file of the reference at the given index.
+    QString path(const QModelIndex& index) const;
+
+    // line returns the line of the reference at the given index.
+    int line(const QModelIndex& index) const;
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& index) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    // fileRow returns the row of the given file, or the row at which it
+    // should be inserted if it is not in the model.
+    int fileRow(const QString& label, const QString& path) const;
+
+    // merge adds the references [from, to) of entries, all of the file at
+    // the given row.
+    void merge(int row, const QVector<ReferencesEntry>& entries, int from, int to);
+
+    // reference returns the file and the position in it of the reference
+    // at the given index.
+    ReferencesFile* reference(const QModelIndex& index, int* position) const;
+
+    // the children indexes are pointing to their file, the files indexes
+    // to nothing.
+    QList<ReferencesFile*> files;
+    int referencesCount;
+};
@@ -1,5 +1,7 @@
 #include <QDir>
+#include <QFileInfo>
 #include <QGridLayout>
+#include <QSettings>
 #include <QWidget>
 
 #include "references_widget.h"
@@ -10,15 +12,26 @@ ReferencesWidget::ReferencesWidget(Window* window) :
     window(window) {
     Q_ASSERT(window != nullptr);
 
-    this->label = new QLabel(this);
-    this->tree = new QTreeWidget(this);
+    QSettings settings("mehteor", "meh");
+    this->maxResults = settings.value("references/max_results", REF_WIDGET_DEFAULT_MAX_RESULTS).toInt();
+    if (this->maxResults <= 0) {
+        this->maxResults = REF_WIDGET_DEFAULT_MAX_RESULTS;
+    }
+    this->limit = this->maxResults;
 
-    this->tree->setSortingEnabled(true);
-    this->tree->setColumnCount(3);
+    this->label = new QLabel(this);
+    this->model = new ReferencesModel(this);
+    this->tree = new QTreeView(this);
+    this->tree->setModel(this->model);
+    // only the visible rows are laid out
+    this->tree->setUniformRowHeights(true);
+    this->tree->setEditTriggers(QAbstractItemView::NoEditTriggers);
     this->tree->setFont(Editor::getFont());
-    QStringList columns;
-    columns << "File" << "Line #" << "Line";
-    this->tree->setHeaderLabels(columns);
+
+    this->publishTimer = new QTimer(this);
+    this->publishTimer->setSingleShot(true);
+    this->publishTimer->setInterval(REF_WIDGET_PUBLISH_INTERVAL_MS);
+    connect(this->publishTimer, &QTimer::timeout, this, &ReferencesWidget::publish);
 
     this->setFont(Editor::getFont());
     this->setFocusPolicy(Qt::StrongFocus);
@@ -35,6 +48,7 @@ void ReferencesWidget::onKeyPressEvent(QKeyEvent* event) {
 }
 
 void ReferencesWidget::fitContent() {
+    this->publish();
     this->tree->setColumnWidth(1, 50);
     this->tree->resizeColumnToContents(0);
     if (this->tree->columnWidth(0) > 300) {
@@ -42,18 +56,15 @@ void ReferencesWidget::fitContent() {
     }
 }
 
-void ReferencesWidget::sort(int column, Qt::SortOrder order) {
-    if (this->tree) {
-        this->tree->sortItems(column, order);
-    }
-}
-
-
 // selectFirst selects the first entry in the list if any.
 void ReferencesWidget::selectFirst() {
-    QTreeWidgetItem* first = this->tree->topLevelItem(0);
-    if (first != nullptr) {
-        this->tree->setCurrentItem(first);
+    this->publish();
+    this->select(this->model->index(0, 0));
+}
+
+void ReferencesWidget::select(const QModelIndex& index) {
+    if (index.isValid()) {
+        this->tree->setCurrentIndex(index);
     }
 }
 
@@ -62,20 +73,23 @@ void ReferencesWidget::show() {
     this->tree->show();
     this->label->setFocus();
     QWidget::show();
-    this->label->setText("No results");
+    this->updateLabel();
 }
 
 void ReferencesWidget::hide() {
-    this->tree->clear();
+    this->clear();
     this->label->hide();
     this->tree->hide();
-    data.clear();
     QWidget::hide();
 }
 
 void ReferencesWidget::clear() {
     this->label->setText("");
-    this->tree->clear();
+    this->publishTimer->stop();
+    this->pending.clear();
+    this->overflow.clear();
+    this->limit = this->maxResults;
+    this->model->clear();
 }
 
 void ReferencesWidget::keyPressEvent(QKeyEvent* event) {
@@ -95,19 +109,18 @@ void ReferencesWidget::keyPressEvent(QKeyEvent* event) {
     switch (event->key()) {
         case Qt::Key_Return:
             {
-                QTreeWidgetItem* currentItem = this->tree->currentItem();
-                if (currentItem == nullptr) {
+                QModelIndex current = this->tree->currentIndex();
+                if (!current.isValid()) {
                     return;
                 }
-                QString filename = currentItem->text(0);
-                QString lineNumber = currentItem->text(1);
+                int lineNumber = this->model->line(current);
                 this->window->saveCheckpoint();
-                QString filepath = currentItem->data(REF_WIDGET_DATA_ID, Qt::UserRole).toString();
+                QString filepath = this->model->path(current);
                 if (filepath.size() == 0) {
-                    qDebug() << "error: currentItem->data(REF_WIDGET_DATA_ID, Qt::UserRole)) is empty";
+                    qDebug() << "error: no file for the current reference";
                 }
                 this->window->setCurrentEditor(filepath);
-                this->window->getEditor()->goToLine(lineNumber.toInt());
+                this->window->getEditor()->goToLine(lineNumber);
                 this->window->getRefWidget()->setDisabled(true);
                 this->window->getEditor()->setFocus();
                 return;
@@ -115,51 +128,47 @@ void ReferencesWidget::keyPressEvent(QKeyEvent* event) {
         case Qt::Key_N:
         case Qt::Key_J:
             if ((event->key() == Qt::Key_N && ctrl) || (event->key() == Qt::Key_J && !ctrl)) {
-                QTreeWidgetItem* currentItem = this->tree->currentItem();
-                if (currentItem == nullptr) {
-                    currentItem = this->tree->topLevelItem(0);
-                    this->tree->setCurrentItem(currentItem);
+                QModelIndex current = this->tree->currentIndex();
+                if (!current.isValid()) {
+                    this->select(this->model->index(0, 0));
                     return;
                 }
-                currentItem = this->tree->itemBelow(currentItem);
-                if (currentItem != nullptr) {
-                    this->tree->setCurrentItem(currentItem);
-                }
+                this->select(this->tree->indexBelow(current));
             } else if (event->key() == Qt::Key_J && ctrl) {
-                QTreeWidgetItem* currentItem = this->tree->currentItem();
-                if (currentItem != nullptr) {
-                    currentItem->setExpanded(true);
-                    this->tree->setCurrentItem(currentItem);
+                QModelIndex current = this->tree->currentIndex();
+                if (current.isValid()) {
+                    this->tree->setExpanded(current, true);
+                    this->tree->setCurrentIndex(current);
                 }
             }
             return;
         case Qt::Key_Backspace:
         case Qt::Key_X:
             {
-                QTreeWidgetItem* currentItem = this->tree->currentItem();
-                if (currentItem != nullptr) {
-                    delete currentItem;
+                QModelIndex current = this->tree->currentIndex();
+                if (current.isValid()) {
+                    this->model->remove(current);
+                    this->updateLabel();
                 }
             }
             return;
+        case Qt::Key_M:
+            this->loadMore();
+            return;
         case Qt::Key_P:
         case Qt::Key_K:
             if ((event->key() == Qt::Key_P && ctrl) || (event->key() == Qt::Key_K && !ctrl)) {
-                QTreeWidgetItem* currentItem = this->tree->currentItem();
-                if (currentItem == nullptr) {
-                    currentItem = this->tree->topLevelItem(0);
-                    this->tree->setCurrentItem(currentItem);
+                QModelIndex current = this->tree->currentIndex();
+                if (!current.isValid()) {
+                    this->select(this->model->index(0, 0));
                     return;
                 }
-                currentItem = this->tree->itemAbove(currentItem);
-                if (currentItem != nullptr) {
-                    this->tree->setCurrentItem(currentItem);
-                }
+                this->select(this->tree->indexAbove(current));
             } else if (event->key() == Qt::Key_K && ctrl) {
-                QTreeWidgetItem* currentItem = this->tree->currentItem();
-                if (currentItem != nullptr) {
-                    currentItem->setExpanded(false);
-                    this->tree->setCurrentItem(currentItem);
+                QModelIndex current = this->tree->currentIndex();
+                if (current.isValid()) {
+                    this->tree->setExpanded(current, false);
+                    this->tree->setCurrentIndex(current);
                 }
             }
             return;
@@ -172,23 +181,76 @@ void ReferencesWidget::setLabelText(QString text) {
     }
 }
 
+void ReferencesWidget::updateLabel() {
+    int count = this->model->count();
+    if (count == 0 && this->overflow.isEmpty()) {
+        this->label->setText("No results");
+        return;
+    }
+    QString text = " " + QString::number(count) + " results";
+    if (!this->overflow.isEmpty()) {
+        text += ", " + QString::number(this->overflow.size()) + " more not displayed (m to load more)";
+    }
+    this->label->setText(text);
+}
+
 void ReferencesWidget::insert(const QString& filepath, const QString& lineNumber, const QString& text) {
     QFileInfo info(filepath);
 
-    QStringList parts;
+    ReferencesEntry entry;
+    entry.path = filepath;
     QString dirName = info.dir().dirName();
     if (dirName != "." && !this->window->getBaseDir().endsWith(dirName + "/")) {
-        parts << dirName + "/" + info.fileName();
+        entry.label = dirName + "/" + info.fileName();
     } else {
-        parts << info.fileName();
+        entry.label = info.fileName();
     }
-    parts << lineNumber << text;
-    if (this->data.contains(filepath)) {
-        QTreeWidgetItem* item = new QTreeWidgetItem(this->data[filepath], parts);
-        item->setData(REF_WIDGET_DATA_ID, Qt::UserRole, filepath);
-    } else {
-        QTreeWidgetItem* item = new QTreeWidgetItem(this->tree, parts);
-        item->setData(REF_WIDGET_DATA_ID, Qt::UserRole, filepath);
-        this->data[filepath] = item;
+    entry.line = lineNumber.toInt();
+    entry.text = text;
+    this->pending.append(entry);
+
+    if (!this->publishTimer->isActive()) {
+        this->publishTimer->start();
+    }
+}
+
+void ReferencesWidget::publish() {
+    this->publishTimer->stop();
+    if (this->pending.isEmpty()) {
+        return;
+    }
+
+    QVector<ReferencesEntry> entries;
+    entries.swap(this->pending);
+
+    // once some are not displayed, the next ones have to wait for their turn
+    int available = this->overflow.isEmpty() ? this->limit - this->model->count() : 0;
+    if (available < entries.size()) {
+        int kept = qMax(0, available);
+        this->overflow.append(entries.mid(kept));
+        entries.resize(kept);
+    }
+
+    bool wasEmpty = this->model->count() == 0;
+    if (!entries.isEmpty()) {
+        this->model->add(entries);
+    }
+    if (wasEmpty && !this->tree->currentIndex().isValid()) {
+        this->select(this->model->index(0, 0));
     }
+    this->updateLabel();
+}
+
+void ReferencesWidget::loadMore() {
+    this->publish();
+    if (this->overflow.isEmpty()) {
+        return;
+    }
+
+    this->limit += this->maxResults;
+    int count = qMin(int(this->overflow.size()), this->maxResults);
+    QVector<ReferencesEntry> entries = this->overflow.mid(0, count);
+    this->overflow.remove(0, count);
+    this->model->add(entries);
+    this->updateLabel();
 }
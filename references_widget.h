@@ -4,14 +4,20 @@
 #include <QKeyEvent>
 #include <QLabel>
 #include <QObject>
-#include <QMap>
 #include <QString>
 #include <QStringList>
-#include <QTreeWidget>
-#include <QTreeWidgetItem>
+#include <QTimer>
+#include <QTreeView>
+#include <QVector>
 #include <QWidget>
 
-#define REF_WIDGET_DATA_ID    0 << 2 // full filepath
+#include "references_model.h"
+
+// inserted references are published at most this often.
+#define REF_WIDGET_PUBLISH_INTERVAL_MS 16
+// default maximum amount of references displayed, more can be loaded on demand.
+// It can be changed with the setting references/max_results.
+#define REF_WIDGET_DEFAULT_MAX_RESULTS 10000
 
 class Window;
 
@@ -20,7 +26,6 @@ class ReferencesWidget : public QWidget {
 
 public:
     ReferencesWidget(Window* window);
-    void setItems(const QString& base, const QStringList& list);
 
     // fitContent must be called in order to resize the columns
     // when the content has been inserted.
@@ -32,8 +37,16 @@ public:
 
     void setLabelText(QString string);
 
+    // insert adds a reference. The references are not displayed right away
+    // but in batches, sorted by file and line.
     void insert(const QString& file, const QString& lineNumber, const QString& text);
-    void sort(int column, Qt::SortOrder order);
+
+    // publish displays the references inserted since the last publish.
+    void publish();
+
+    // loadMore displays more references when some were not displayed
+    // because of the maximum of displayed results.
+    void loadMore();
 
     // selectFirst selects the first entry in the list if any.
     void selectFirst();
@@ -44,9 +57,26 @@ protected:
     void keyPressEvent(QKeyEvent*) override;
 
 private:
+    // updateLabel shows the amount of references.
+    void updateLabel();
+
+    // select selects the given index if valid.
+    void select(const QModelIndex& index);
+
     Window* window;
-    QTreeWidget* tree;
+    QTreeView* tree;
+    ReferencesModel* model;
     QGridLayout* layout;
     QLabel* label;
-    QMap<QString, QTreeWidgetItem*> data;
+
+    // references inserted but not published yet.
+    QVector<ReferencesEntry> pending;
+    // references not displayed because of the limit.
+    QVector<ReferencesEntry> overflow;
+    QTimer* publishTimer;
+
+    // maxResults is how many references are displayed at most, limit is
+    // the current maximum which grows when loading more.
+    int maxResults;
+    int limit;
 };
@@ -0,0 +1,233 @@
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QProcess>
+#include <QSaveFile>
+#include <QTimer>
+
+#include "buffer.h"
+#include "editor.h"
+#include "save_pipeline.h"
+#include "statusbar.h"
+#include "window.h"
+
+#include "qdebug.h"
+
+// a formatter running for longer than this is killed.
+#define SAVE_PIPELINE_FORMATTER_TIMEOUT_MS 10000
+
+SavePipeline::SavePipeline(Window* window) :
+    QObject(window),
+    window(window),
+    started(0),
+    done(0) {
+    Q_ASSERT(window != nullptr);
+}
+
+SavePipeline::~SavePipeline() {
+    // do not leave a file half written
+    this->pool.waitForDone();
+}
+
+QList<QStringList> SavePipeline::formattersFor(const QString& filename) {
+    QList<QStringList> rv;
+    if (filename.endsWith(".go")) {
+        rv.append(QStringList() << "gofmt");
+        // goimports needs to know where the file is to resolve the imports
+        rv.append(QStringList() << "goimports" << "-srcdir" << QFileInfo(filename).absolutePath());
+    } else if (filename.endsWith(".zig")) {
+        rv.append(QStringList() << "zig" << "fmt" << "--stdin");
+    }
+    return rv;
+}
+
+void SavePipeline::save(Buffer* buffer) {
+    Q_ASSERT(buffer != nullptr);
+
+    if (buffer->getFilename().isEmpty()) {
+        this->window->getStatusBar()->setMessage("Can't save " + buffer->getId() + ": no filename.");
+        return;
+    }
+
+    SaveJob job;
+    job.id = buffer->getId();
+    job.filename = buffer->getFilename();
+    job.snapshot = buffer->snapshot();
+    job.revision = buffer->getRevision();
+    job.format = true;
+
+    this->started++;
+    this->start(job);
+    this->updateProgress();
+}
+
+void SavePipeline::start(const SaveJob& job) {
+    if (this->running.contains(job.id)) {
+        // the files must be written in order, replace any job already
+        // waiting for this buffer since this one is more recent.
+        if (this->waiting.contains(job.id)) {
+            this->done++;
+        }
+        this->waiting.insert(job.id, job);
+        return;
+    }
+    this->running.insert(job.id, job);
+    this->write(job);
+}
+
+void SavePipeline::write(const SaveJob& job) {
+    this->pool.start([this, job]() {
+        QString error;
+        // QSaveFile writes in a temporary file renamed over the original
+        // one on commit, the file is never left half written.
+        QSaveFile file(job.filename);
+        if (!file.open(QIODevice::WriteOnly)) {
+            error = file.errorString();
+        } else if (!job.snapshot.writeTo(&file)) {
+            error = file.errorString();
+            file.cancelWriting();
+        } else if (!file.commit()) {
+            error = file.errorString();
+        }
+
+        QMetaObject::invokeMethod(this, [this, job, error]() {
+            this->onWritten(job, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void SavePipeline::onWritten(const SaveJob& job, const QString& error) {
+    if (!error.isEmpty()) {
+        qWarning() << "SavePipeline::onWritten: can't write" << job.filename << error;
+        this->window->getStatusBar()->setMessage("Can't save " + job.filename + ": " + error);
+        this->finish(job, false);
+        return;
+    }
+
+    QList<QStringList> formatters = SavePipeline::formattersFor(job.filename);
+    if (!job.format || formatters.isEmpty()) {
+        this->finish(job, true);
+        return;
+    }
+
+    this->runFormatter(job, formatters, 0, job.snapshot.toString());
+}
+
+void SavePipeline::runFormatter(const SaveJob& job, const QList<QStringList>& formatters, int idx, const QString& input) {
+    QStringList args = formatters.at(idx);
+    QString program = args.takeFirst();
+
+    QProcess* process = new QProcess(this);
+    process->setWorkingDirectory(QFileInfo(job.filename).absolutePath());
+
+    connect(process, &QProcess::errorOccurred, this, [this, job, formatters, idx, input, process, program](QProcess::ProcessError error) {
+        // on other errors, finished is emitted as well
+        if (error != QProcess::FailedToStart) {
+            return;
+        }
+        qWarning() << "SavePipeline::runFormatter: can't start" << program;
+        process->deleteLater();
+        // e.g. not installed: the next formatters still have to run on the
+        // same input, as if this one were not part of the chain.
+        if (idx + 1 < formatters.size()) {
+            this->runFormatter(job, formatters, idx + 1, input);
+            return;
+        }
+        this->onFormatted(job, input);
+    });
+
+    connect(process, &QProcess::finished, this, [this, job, formatters, idx, process, program](int exitCode, QProcess::ExitStatus status) {
+        process->deleteLater();
+        if (status != QProcess::NormalExit || exitCode != 0) {
+            // most likely the file doesn't compile, keep it as written
+            qWarning() << "while running:" << program << process->readAllStandardError();
+            this->finish(job, true);
+            return;
+        }
+
+        QString output = QString::fromUtf8(process->readAllStandardOutput());
+        if (idx + 1 < formatters.size()) {
+            this->runFormatter(job, formatters, idx + 1, output);
+            return;
+        }
+        this->onFormatted(job, output);
+    });
+
+    QTimer::singleShot(SAVE_PIPELINE_FORMATTER_TIMEOUT_MS, process, [process, program]() {
+        qWarning() << "while running:" << program << "timeout";
+        process->kill();
+    });
+
+    process->start(program, args);
+    process->write(input.toUtf8());
+    process->closeWriteChannel();
+}
+
+void SavePipeline::onFormatted(const SaveJob& job, const QString& formatted) {
+    Editor* editor = this->window->getEditor(job.id);
+    if (editor == nullptr || editor->getBuffer() == nullptr) {
+        // closed in the meantime
+        this->finish(job, true);
+        return;
+    }
+
+    Buffer* buffer = editor->getBuffer();
+    if (buffer->getRevision() != job.revision) {
+        // the buffer has been edited since the snapshot, the formatted
+        // text is not relevant anymore.
+        this->finish(job, true);
+        return;
+    }
+
+    if (formatted == job.snapshot.toString()) {
+        this->finish(job, true);
+        return;
+    }
+
+    // the editor may have been hibernated while its buffer was saved, the
+    // formatted text replaces the one of its document.
+    editor->materialize();
+    buffer->replaceContent(formatted);
+
+    // write the formatted text
+    SaveJob rewrite = job;
+    rewrite.snapshot = buffer->snapshot();
+    rewrite.revision = buffer->getRevision();
+    rewrite.format = false;
+    this->running.insert(rewrite.id, rewrite);
+    this->write(rewrite);
+}
+
+void SavePipeline::finish(const SaveJob& job, bool success) {
+    this->running.remove(job.id);
+    this->done++;
+
+    if (success) {
+        Editor* editor = this->window->getEditor(job.id);
+        // the buffer may have changed while being saved
+        if (editor != nullptr && editor->getBuffer() != nullptr &&
+                editor->getBuffer()->getRevision() == job.revision) {
+            editor->onSaved();
+        }
+        emit saved(job.id);
+    }
+
+    if (this->waiting.contains(job.id)) {
+        this->start(this->waiting.take(job.id));
+    }
+
+    this->updateProgress();
+
+    if (this->running.isEmpty()) {
+        this->started = 0;
+        this->done = 0;
+        emit drained();
+    }
+}
+
+void SavePipeline::updateProgress() {
+    if (this->running.isEmpty()) {
+        this->window->getStatusBar()->setSaveProgress(0, 0);
+        return;
+    }
+    this->window->getStatusBar()->setSaveProgress(this->done, this->started);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+
+#include "piece_table.h"
+
+class Buffer;
+class Window;
+
+// SaveJob is a buffer being saved by the SavePipeline.
+typedef struct SaveJob {
+    QString id;
+    QString filename;
+    // snapshot of the buffer text at the moment the save has been asked.
+    PieceTable snapshot;
+    // revision of the buffer text corresponding to the snapshot.
+    int revision;
+    // format is true if the formatters have to be run once the file is written.
+    bool format;
+} SaveJob;
+
+// SavePipeline saves buffers without blocking the UI: the snapshot of a buffer
+// is written on a worker thread, in a temporary file atomically renamed over
+// the original one, and then the formatters of the file (e.g. gofmt) are
+// running in the background. Their output is applied back only if the buffer
+// has not changed in the meantime.
+class SavePipeline : public QObject
+{
+    Q_OBJECT
+public:
+    SavePipeline(Window* window);
+    ~SavePipeline();
+
+    // save starts saving the given buffer.
+    void save(Buffer* buffer);
+
+    // isSaving returns true if the buffer with the given id is being saved.
+    bool isSaving(const QString& id) const { return this->running.contains(id); }
+
+    // isIdle returns true if nothing is being saved.
+    bool isIdle() const { return this->running.isEmpty(); }
+
+signals:
+    // saved is emitted when the buffer with the given id has been saved.
+    void saved(const QString& id);
+
+    // drained is emitted when every saves started have been done.
+    void drained();
+
+private:
+    // start starts the job or queues it if the same buffer is already being saved.
+    void start(const SaveJob& job);
+
+    // write writes the snapshot of the job on a worker thread.
+    void write(const SaveJob& job);
+
+    // onWritten is called on the UI thread when the snapshot has been written.
+    void onWritten(const SaveJob& job, const QString& error);
+
+    // runFormatter runs the formatter at the given index of the list on the
+    // given input. The next formatter receives its output, or the same input
+    // if it can't be started. The chain stops when a formatter fails.
+    void runFormatter(const SaveJob& job, const QList<QStringList>& formatters, int idx, const QString& input);
+
+    // onFormatted applies the formatted text to the buffer if it has not
+    // changed since the snapshot, and saves it again.
+    void onFormatted(const SaveJob& job, const QString& formatted);
+
+    // finish ends the job, starts the one queued for the same buffer if any.
+    void finish(const SaveJob& job, bool success);
+
+    // updateProgress shows the saves progress in the status bar.
+    void updateProgress();
+
+    // formattersFor returns the formatters to run for the given file. A formatter
+    // is a command reading the file on its stdin and writing it on its stdout.
+    static QList<QStringList> formattersFor(const QString& filename);
+
+    Window* window;
+
+    QThreadPool pool;
+
+    // running are the jobs being processed, per buffer id.
+    QMap<QString, SaveJob> running;
+    // waiting are the jobs to start when the running one of the same buffer is done.
+    QMap<QString, SaveJob> waiting;
+
+    // progress since the pipeline was last idle.
+    int started;
+    int done;
+};
@@ -0,0 +1,276 @@
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+#include "session_store.h"
+
+#include "qdebug.h"
+
+SessionStore::SessionStore(const QString& filename, QObject* parent) :
+    QObject(parent),
+    filename(filename) {
+    this->pool.setMaxThreadCount(1);
+
+    this->flushTimer = new QTimer(this);
+    this->flushTimer->setSingleShot(true);
+    this->flushTimer->setInterval(SESSION_STORE_FLUSH_DELAY_MS);
+    connect(this->flushTimer, &QTimer::timeout, this, &SessionStore::flush);
+}
+
+SessionStore::~SessionStore() {
+    if (this->flushTimer->isActive()) {
+        this->flushTimer->stop();
+        this->flush();
+    }
+    this->pool.waitForDone();
+}
+
+QString SessionStore::defaultFilename() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/session";
+}
+
+void SessionStore::load() {
+    this->session = Snapshot();
+    if (!SessionStore::read(this->filename, &this->session)) {
+        SessionStore::import(&this->session);
+        SessionStore::evict(&this->session);
+        this->changed();
+    }
+}
+
+bool SessionStore::file(const QString& filename, FileSession* session) const {
+    Q_ASSERT(session != nullptr);
+    auto it = this->session.files.constFind(filename);
+    if (it == this->session.files.constEnd()) {
+        return false;
+    }
+    *session = it.value();
+    return true;
+}
+
+FileSession& SessionStore::touch(const QString& filename) {
+    if (!this->session.files.contains(filename)) {
+        FileSession session;
+        session.cursor = 0;
+        session.vscroll = 0;
+        session.openedBy = 0;
+        this->session.files[filename] = session;
+    }
+    FileSession& session = this->session.files[filename];
+    session.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    return session;
+}
+
+void SessionStore::setFilePosition(const QString& filename, int cursor, int vscroll) {
+    FileSession& session = this->touch(filename);
+    session.cursor = cursor;
+    session.vscroll = vscroll;
+    this->changed();
+}
+
+qint64 SessionStore::fileOpenedBy(const QString& filename) const {
+    FileSession session;
+    bool known = this->file(filename, &session);
+
+    // the most recent of the two wins, as when the session is written
+    Snapshot disk;
+    if (SessionStore::read(this->filename, &disk)) {
+        auto it = disk.files.constFind(filename);
+        if (it != disk.files.constEnd() && (!known || session.lastUsed < it.value().lastUsed)) {
+            session = it.value();
+            known = true;
+        }
+    }
+    return known ? session.openedBy : 0;
+}
+
+void SessionStore::setFileOpenedBy(const QString& filename, qint64 pid) {
+    if (pid == 0 && !this->session.files.contains(filename)) {
+        return;
+    }
+    FileSession& session = this->touch(filename);
+    session.openedBy = pid;
+    // not delayed: the other instances are checking it when opening a file
+    this->flush();
+}
+
+QString SessionStore::value(const QString& key, const QString& defaultValue) const {
+    return this->session.values.value(key, defaultValue);
+}
+
+void SessionStore::setValue(const QString& key, const QString& value) {
+    if (this->session.values.value(key) == value) {
+        return;
+    }
+    this->session.values[key] = value;
+    this->changed();
+}
+
+void SessionStore::appendHistory(const QString& command) {
+    if (!this->session.commands.isEmpty() && this->session.commands.last() == command) {
+        return;
+    }
+    this->session.commands.append(command);
+    while (this->session.commands.size() > SESSION_STORE_MAX_HISTORY) {
+        this->session.commands.removeFirst();
+    }
+    this->changed();
+}
+
+void SessionStore::changed() {
+    // restarted on each change: written once the changes have settled
+    this->flushTimer->start();
+}
+
+void SessionStore::flush() {
+    this->flushTimer->stop();
+
+    // the containers are implicitly shared, copied only if the session
+    // changes while being written.
+    const QString filename = this->filename;
+    const Snapshot snapshot = this->session;
+    this->pool.start([filename, snapshot]() {
+        if (!SessionStore::write(filename, snapshot)) {
+            qWarning() << "SessionStore::flush: can't write" << filename;
+        }
+    });
+}
+
+// file format
+// ----------------------
+
+bool SessionStore::read(const QString& filename, Snapshot* snapshot) {
+    Q_ASSERT(snapshot != nullptr);
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+    if (magic != SESSION_STORE_MAGIC || version != SESSION_STORE_VERSION) {
+        qWarning() << "SessionStore::read: unknown format for" << filename;
+        return false;
+    }
+
+    Snapshot rv;
+    quint32 count = 0;
+    in >> rv.values >> rv.commands >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString name;
+        qint32 cursor = 0, vscroll = 0;
+        FileSession session;
+        in >> name >> cursor >> vscroll >> session.openedBy >> session.lastUsed;
+        session.cursor = cursor;
+        session.vscroll = vscroll;
+        rv.files[name] = session;
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "SessionStore::read: truncated file" << filename;
+        return false;
+    }
+
+    *snapshot = rv;
+    return true;
+}
+
+bool SessionStore::write(const QString& filename, Snapshot snapshot) {
+    // the other instances may have written their own files since the load
+    Snapshot disk;
+    if (SessionStore::read(filename, &disk)) {
+        for (auto it = disk.files.constBegin(); it != disk.files.constEnd(); ++it) {
+            auto current = snapshot.files.constFind(it.key());
+            if (current == snapshot.files.constEnd() || current.value().lastUsed < it.value().lastUsed) {
+                snapshot.files[it.key()] = it.value();
+            }
+        }
+    }
+    SessionStore::evict(&snapshot);
+
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << (quint32)SESSION_STORE_MAGIC << (quint32)SESSION_STORE_VERSION;
+    out << snapshot.values << snapshot.commands << (quint32)snapshot.files.size();
+    for (auto it = snapshot.files.constBegin(); it != snapshot.files.constEnd(); ++it) {
+        const FileSession& session = it.value();
+        out << it.key() << (qint32)session.cursor << (qint32)session.vscroll
+            << session.openedBy << session.lastUsed;
+    }
+
+    return file.commit();
+}
+
+void SessionStore::evict(Snapshot* snapshot) {
+    Q_ASSERT(snapshot != nullptr);
+
+    if (snapshot->files.size() <= SESSION_STORE_MAX_FILES) {
+        return;
+    }
+
+    QVector<qint64> times;
+    times.reserve(snapshot->files.size());
+    for (auto it = snapshot->files.constBegin(); it != snapshot->files.constEnd(); ++it) {
+        times.append(it.value().lastUsed);
+    }
+    // oldest time kept
+    auto nth = times.begin() + (times.size() - SESSION_STORE_MAX_FILES);
+    std::nth_element(times.begin(), nth, times.end());
+    const qint64 oldest = *nth;
+
+    for (auto it = snapshot->files.begin(); it != snapshot->files.end(); ) {
+        if (it.value().lastUsed < oldest) {
+            it = snapshot->files.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SessionStore::import(Snapshot* snapshot) {
+    Q_ASSERT(snapshot != nullptr);
+
+    QSettings settings("mehteor", "meh");
+    snapshot->commands = settings.value("command/history").toStringList();
+    const QString occurrence = settings.value("editor/last_value_go_to_occurrence").toString();
+    if (!occurrence.isEmpty()) {
+        snapshot->values["editor/last_value_go_to_occurrence"] = occurrence;
+    }
+
+    // the files were stored as "buffer/<filename>/cursor", the order in
+    // which they were used being unknown.
+    settings.beginGroup("buffer");
+    const QStringList keys = settings.allKeys();
+    for (const QString& key : keys) {
+        if (!key.endsWith("/cursor")) {
+            continue;
+        }
+        // QSettings has removed the leading / of the absolute paths
+        const QString name = key.left(key.size() - 7);
+        const QString filename = QDir::isAbsolutePath(name) ? name : "/" + name;
+        FileSession session;
+        session.cursor = settings.value(key).toInt();
+        session.vscroll = settings.value(name + "/vscroll").toInt();
+        session.openedBy = 0;
+        session.lastUsed = 0;
+        snapshot->files[filename] = session;
+    }
+    settings.endGroup();
+}
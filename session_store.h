@@ -0,0 +1,115 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+// files for which the session is kept, the least recently used are
+// forgotten first.
+#define SESSION_STORE_MAX_FILES 1000
+// commands kept in the history.
+#define SESSION_STORE_MAX_HISTORY 1000
+// delay between a change and its write on disk.
+#define SESSION_STORE_FLUSH_DELAY_MS 2000
+// first bytes of the session file, and its format version.
+#define SESSION_STORE_MAGIC 0x6d656873
+#define SESSION_STORE_VERSION 1
+
+// FileSession is what is remembered about a file between its uses.
+typedef struct FileSession {
+    // cursor position and vertical scroll
+    int cursor;
+    int vscroll;
+    // pid of the instance having the file opened, 0 if none
+    qint64 openedBy;
+    // ms since epoch, for the eviction
+    qint64 lastUsed;
+} FileSession;
+
+// SessionStore keeps the state of the editor between its runs: the position
+// in the files, the commands history, the last searched value.
+// It is read once at startup and then only lives in memory, the changes are
+// written behind, on a worker thread, a bit after the last of them. When
+// written, the entries of the files are merged with the ones written in the
+// meantime by other instances, the most recent wins. Which instance has a
+// file opened is the exception: written right away and read from the file.
+class SessionStore : public QObject
+{
+    Q_OBJECT
+public:
+    SessionStore(const QString& filename, QObject* parent = nullptr);
+    // ~SessionStore writes what has not been written yet.
+    ~SessionStore();
+
+    // defaultFilename returns where the session is stored by default.
+    static QString defaultFilename();
+
+    // load reads the session from its file, importing the one of the
+    // previous versions (stored in the QSettings) if there is none.
+    void load();
+
+    // file returns in session what is known about the given file.
+    bool file(const QString& filename, FileSession* session) const;
+
+    // setFilePosition stores the cursor and scroll positions in the file.
+    void setFilePosition(const QString& filename, int cursor, int vscroll);
+
+    // fileOpenedBy returns the pid of the instance having the file opened, 0
+    // if none. The file of the session is read again to know about the files
+    // opened by the other instances since the load.
+    qint64 fileOpenedBy(const QString& filename) const;
+
+    // setFileOpenedBy stores which instance has the file opened, 0 for none.
+    // It is written right away for the other instances to see it.
+    void setFileOpenedBy(const QString& filename, qint64 pid);
+
+    // value returns a value stored with setValue.
+    QString value(const QString& key, const QString& defaultValue = QString()) const;
+    void setValue(const QString& key, const QString& value);
+
+    // history returns the commands history, the oldest first.
+    const QStringList& history() const { return this->commands; }
+
+    // appendHistory adds the command at the end of the history.
+    void appendHistory(const QString& command);
+
+    // flush writes the session now, without waiting for the delay.
+    void flush();
+
+private:
+    // Snapshot is the content of the session.
+    typedef struct Snapshot {
+        QHash<QString, FileSession> files;
+        QHash<QString, QString> values;
+        QStringList commands;
+    } Snapshot;
+
+    // touch returns the entry of the file, created if needed, marked as
+    // just used.
+    FileSession& touch(const QString& filename);
+
+    // changed schedules the write of the session.
+    void changed();
+
+    // read reads a snapshot from the given file.
+    static bool read(const QString& filename, Snapshot* snapshot);
+
+    // write merges the snapshot with the file and writes it, from the worker.
+    static bool write(const QString& filename, Snapshot snapshot);
+
+    // import reads the session stored by the previous versions.
+    static void import(Snapshot* snapshot);
+
+    // evict removes the least recently used files past the maximum.
+    static void evict(Snapshot* snapshot);
+
+    QString filename;
+    Snapshot session;
+
+    QTimer* flushTimer;
+    // written by a single worker, in order.
+    QThreadPool pool;
+};
@@ -31,10 +31,20 @@ StatusBar::StatusBar(Window* window) :
     this->lineNumber->setMaximumHeight(15);
     #endif
     this->lineNumber->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Minimum);
+    this->saveProgress = new QLabel("");
+    this->saveProgress->setFont(Editor::getFont());
+    #ifdef Q_OS_MAC
+    this->saveProgress->setMaximumHeight(18);
+    #else
+    this->saveProgress->setMaximumHeight(15);
+    #endif
+    this->saveProgress->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Minimum);
+    this->saveProgress->hide();
     this->glayout->setContentsMargins(10, 0, 10, 5);
     this->glayout->addWidget(this->mode);
     this->glayout->addWidget(this->breadcrumb, 0, 1, Qt::AlignCenter);
-    this->glayout->addWidget(this->lineNumber, 0, 2, Qt::AlignRight);
+    this->glayout->addWidget(this->saveProgress, 0, 2, Qt::AlignRight);
+    this->glayout->addWidget(this->lineNumber, 0, 3, Qt::AlignRight);
     this->setFont(Editor::getFont());
     this->message = new QPlainTextEdit();
     this->message->setReadOnly(true);
@@ -96,6 +106,17 @@ void StatusBar::setLineNumber(int lineNumber) {
     this->lineNumber->setText(QString::number(lineNumber));
 }
 
+void StatusBar::setSaveProgress(int done, int total) {
+    if (this->saveProgress == nullptr) { return; }
+    if (total == 0) {
+        this->saveProgress->setText("");
+        this->saveProgress->hide();
+        return;
+    }
+    this->saveProgress->setText(QString("saving %1/%2").arg(done).arg(total));
+    this->saveProgress->show();
+}
+
 void StatusBar::setLspRunning(bool running) {
     if (this->lspWorking == running) { return; }
     this->lspWorking = running;
@@ -35,6 +35,10 @@ public:
 
 	void setLspRunning(bool running);
 
+    // setSaveProgress shows how many of the files being saved are done.
+    // Hidden when total is 0.
+    void setSaveProgress(int done, int total);
+
 protected:
 private:
     Window* window;
@@ -43,6 +47,7 @@ private:
     QGridLayout* glayout;
     QLabel* mode;
     QLabel* lineNumber;
+    QLabel* saveProgress;
     QPlainTextEdit* message;
 
     bool lspWorking;
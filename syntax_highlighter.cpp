@@ -1,37 +1,70 @@
+#include <QElapsedTimer>
+#include <QScrollBar>
 #include <QTextBlock>
 
+#include <atomic>
+
+#include "buffer.h"
 #include "editor.h"
 #include "git.h"
 #include "tasks.h"
 #include "syntax_highlighter.h"
 
+// HighlightJob is the lexing of a snapshot of the buffer by the worker.
+struct HighlightJob {
+    PieceTable text;
+    Lexer lexer;
+    HighlightRules rules;
+    // revision of the buffer when the snapshot has been taken
+    int revision;
+
+    std::atomic<bool> cancelled;
+
+    // the runs of the line i are runs[offsets[i]] to runs[offsets[i+1]], the
+    // state of the lexer at its end is states[i].
+    QVector<HighlightRun> runs;
+    QVector<int> offsets;
+    QVector<int> states;
+
+    HighlightJob(const PieceTable& text, const Lexer& lexer, const HighlightRules& rules, int revision) :
+        text(text), lexer(lexer), rules(rules), revision(revision), cancelled(false) {}
+
+    int lineCount() const { return this->offsets.size() - 1; }
+};
+
 QColor SyntaxHighlighter::getMainColor() {
     return QColor::fromRgb(46,126,184); // blue
 }
 
-SyntaxHighlighter::SyntaxHighlighter(Editor* editor, QTextDocument *parent) :
-  QSyntaxHighlighter(parent), editor(editor)
+SyntaxHighlighter::SyntaxHighlighter(Editor* editor, QTextDocument* document) :
+  QObject(editor), editor(editor), document(document),
+  filename(editor->getBuffer()->getFilename()),
+  lexer(filename),
+  remaining(0),
+  nextLine(0),
+  viewportFirst(-1),
+  applying(false)
 {
-    if (editor == nullptr) {
-        return;
-    }
+    Q_ASSERT(editor != nullptr);
+    Q_ASSERT(document != nullptr);
 
-    this->filename = editor->getBuffer()->getFilename();
+    this->pool.setMaxThreadCount(1);
 
-    QList<QString> languages{
-        ".go", ".java", ".py", ".rs", ".rb", ".zig", ".c", ".cpp", ".h", ".hpp",
-        ".scala", ".js", ".cs"
-    };
+    this->sliceTimer = new QTimer(this);
+    this->sliceTimer->setInterval(0);
+    connect(this->sliceTimer, &QTimer::timeout, this, &SyntaxHighlighter::onSlice);
 
-    todoRx = QRegularExpression(QStringLiteral("(TODO|NOTE|FIXME|XXX)"));
-    whitespaceEolRx = QRegularExpression(QStringLiteral("( |\t)+$"));
+    this->restartTimer = new QTimer(this);
+    this->restartTimer->setSingleShot(true);
+    this->restartTimer->setInterval(HIGHLIGHT_RESTART_DELAY_MS);
+    connect(this->restartTimer, &QTimer::timeout, this, &SyntaxHighlighter::rehighlight);
 
-    selectionFormat.setForeground(Qt::white);
-    selectionFormat.setBackground(QColor::fromRgb(90, 90, 90));
+    this->rules.whitespaceEol = QRegularExpression(QStringLiteral("( |\t)+$"));
 
     searchTextFormat.setForeground(Qt::white);
     searchTextFormat.setBackground(QColor::fromRgb(129,179,234));
 
+    keywordFormat.setForeground(SyntaxHighlighter::getMainColor());
     commentFormat.setForeground(Qt::darkGray);
     functionCallFormat.setForeground(Qt::white);
     specialCharsFormat.setForeground(SyntaxHighlighter::getMainColor());
@@ -40,12 +73,6 @@ SyntaxHighlighter::SyntaxHighlighter(Editor* editor, QTextDocument *parent) :
     todoFormat.setForeground(QColor::fromRgb(232, 52, 28));
     whitespaceEolFormat.setBackground(QColor::fromRgb(250, 50, 50));
 
-    for (QString language : languages) {
-        if (filename.endsWith(language)) {
-            setCodeRules();
-        }
-    }
-
     if (filename.endsWith(".tasks")) {
         for (PluginRule rule : TasksPlugin::getSyntaxRules()) {
             pluginRules.append(rule);
@@ -63,218 +90,305 @@ SyntaxHighlighter::SyntaxHighlighter(Editor* editor, QTextDocument *parent) :
             pluginRules.append(rule);
         }
     }
-}
 
-void SyntaxHighlighter::setCodeRules() {
-    SyntaxRule rule;
-    QTextCharFormat format;
+    for (const PluginRule& rule : this->pluginRules) {
+        this->rules.plugins.append(rule.pattern);
+    }
 
-    // code syntax rules
+    connect(this->document, &QTextDocument::contentsChange, this, &SyntaxHighlighter::onContentsChange);
+    connect(this->editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &SyntaxHighlighter::onScroll);
 
-    format.setForeground(SyntaxHighlighter::getMainColor());
-    const QString keywordPatterns[] = {
-        "char", "class", "const",
-        "double", "enum", "explicit",
-        "friend", "inline", "int",
-        "long", "namespace", "operator",
-        "private", "protected", "public",
-        "slots", "static", "struct",
-        "if", "else", "const",
-        "var", "return", "continue",
-        "void", "string", "bool",
-        "func", "select", "range",
-        "for", "switch", "case", "break",
-        "true", "false", "type",
-        "null", "nil", "nullptr",
-        "while", "delete", "new",
-        "def", "end", "until", "unless", // ruby
-        "package", "import", "#include"
-    };
-
-    for (const QString &pattern : keywordPatterns) {
-        rule.word = pattern;
-        rule.format = format;
-        simpleWordEqualityRules.append(rule);
-    }
+    this->rehighlight();
+}
+
+SyntaxHighlighter::~SyntaxHighlighter() {
+    this->cancel();
+    this->pool.waitForDone();
 }
 
-void SyntaxHighlighter::processRegexp(const QString& text, QRegularExpression rx, QTextCharFormat format) {
-    if (text.size() > 0 && rx.isValid()) {
+// lexing
+// ----------------------
+
+void SyntaxHighlighter::processRegexp(const QString& text, const QRegularExpression& rx, int format,
+                                      QVector<HighlightRun>* runs) {
+    if (text.size() > 0 && !rx.pattern().isEmpty() && rx.isValid()) {
         QRegularExpressionMatchIterator matchIterator = rx.globalMatch(text);
         while (matchIterator.hasNext()) {
             QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), format);
+            runs->append(HighlightRun{int(match.capturedStart()), int(match.capturedLength()), format});
         }
     }
 }
 
-void SyntaxHighlighter::processWord(const QString& word, int wordStart, bool endOfLine, bool inQuote) {
-    if (word == " ") {
-        return;
+int SyntaxHighlighter::lexLine(const Lexer& lexer, const HighlightRules& rules, const QString& line, int state,
+                               QVector<LexerToken>* tokens, QVector<HighlightRun>* runs) {
+    state = lexer.lex(line, state, tokens);
+    for (const LexerToken& token : *tokens) {
+        runs->append(HighlightRun{token.start, token.length, token.type});
     }
 
-    if (word.size() < 2) {
-        return;
+    // the runs are applied in order, the ones of the rules are over the tokens.
+    for (int i = 0; i < rules.plugins.size(); i++) {
+        processRegexp(line, rules.plugins.at(i), HighlightPluginRule + i, runs);
     }
+    processRegexp(line, rules.searchText, HighlightSearchText, runs);
+    processRegexp(line, rules.whitespaceEol, HighlightWhitespaceEol, runs);
 
-    for (int i = 0; i < simpleWordEqualityRules.size(); i++) {
-        if (word == simpleWordEqualityRules[i].word) {
-            setFormat(wordStart, word.size(), simpleWordEqualityRules[i].format);
-        }
-    }
+    return state;
 }
 
-void SyntaxHighlighter::processLine(const QString& line) {
-    if (pluginRules.size() > 0) {
-        for (PluginRule rule : pluginRules) {
-            processRegexp(line, rule.pattern, rule.format);
-        }
+const QTextCharFormat& SyntaxHighlighter::formatFor(int format) const {
+    switch (format) {
+        case LexerKeyword:
+            return this->keywordFormat;
+        case LexerFunctionCall:
+            return this->functionCallFormat;
+        case LexerQuote:
+            return this->quoteFormat;
+        case LexerComment:
+            return this->commentFormat;
+        case LexerTodo:
+            return this->todoFormat;
+        case LexerSpecialChar:
+            return this->specialCharsFormat;
+        case HighlightSearchText:
+            return this->searchTextFormat;
+        case HighlightWhitespaceEol:
+            return this->whitespaceEolFormat;
     }
+    return this->pluginRules.at(format - HighlightPluginRule).format;
+}
 
-    if (this->selection.size() > 0) {
-        processRegexp(line, this->selectionRx, this->selectionFormat);
+// formats
+// ----------------------
+
+void SyntaxHighlighter::applyRuns(const QTextBlock& block, const HighlightRun* runs, int count) {
+    QVector<QTextLayout::FormatRange> formats;
+    formats.reserve(count);
+    for (int i = 0; i < count; i++) {
+        QTextLayout::FormatRange range;
+        range.start = runs[i].start;
+        range.length = runs[i].length;
+        range.format = this->formatFor(runs[i].format);
+        formats.append(range);
     }
-    if (this->searchText.size() > 0) {
-        processRegexp(line, this->searchTextRx, this->searchTextFormat);
+
+    QTextLayout* layout = block.layout();
+    if (layout == nullptr || layout->formats() == formats) {
+        return;
     }
 
-    processRegexp(line, this->whitespaceEolRx, this->whitespaceEolFormat);
+    this->applying = true;
+    layout->setFormats(formats);
+    this->document->markContentsDirty(block.position(), block.length());
+    this->applying = false;
 }
 
-void SyntaxHighlighter::processQuote(const QString& text, int start) {
-    if (text == "") {
-        return;
+int SyntaxHighlighter::previousBlockState(const QTextBlock& block) {
+    QTextBlock previous = block.previous();
+    return previous.isValid() ? previous.userState() : LexerStateDefault;
+}
+
+bool SyntaxHighlighter::highlightBlock(QTextBlock block) {
+    this->runs.clear();
+    int state = SyntaxHighlighter::lexLine(this->lexer, this->rules, block.text(),
+                                           SyntaxHighlighter::previousBlockState(block),
+                                           &this->tokens, &this->runs);
+    this->applyRuns(block, this->runs.constData(), this->runs.size());
+
+    if (block.userState() == state) {
+        return false;
     }
+    block.setUserState(state);
+    return true;
+}
 
-    setFormat(start-1, text.size()+2, quoteFormat);
+void SyntaxHighlighter::highlightViewport() {
+    int first = 0, last = 0;
+    this->editor->visibleBlocks(&first, &last);
+    for (QTextBlock block = this->document->findBlockByNumber(first);
+         block.isValid() && block.blockNumber() <= last; block = block.next()) {
+        this->highlightBlock(block);
+    }
 }
 
-void SyntaxHighlighter::processComment(const QString& comment, int start) {
-    if (comment == "") {
+void SyntaxHighlighter::onContentsChange(int position, int, int charsAdded) {
+    if (this->applying) {
         return;
     }
 
-    setFormat(start, comment.size(), commentFormat);
-    processRegexp(comment, todoRx, todoFormat);
-}
+    QTextBlock block = this->document->findBlock(position);
+    QTextBlock end = this->document->findBlock(position + charsAdded);
+    if (!end.isValid()) {
+        end = this->document->lastBlock();
+    }
 
-void SyntaxHighlighter::processFunctionCall(const QString& text, int start, bool endOfLine) {
-    if (text == "") {
+    if (end.blockNumber() - block.blockNumber() > HIGHLIGHT_SYNC_MAX_BLOCKS) {
+        this->rehighlight();
         return;
     }
 
-    int size = text.size();
-    if (endOfLine) {
-        size += 1;
+    // after the edited blocks, continue as long as the state at the end of
+    // the blocks is changing, e.g. after having opened a comment.
+    int count = 0;
+    for (; block.isValid(); block = block.next(), count++) {
+        bool changed = this->highlightBlock(block);
+        if (block.blockNumber() >= end.blockNumber() && !changed) {
+            break;
+        }
+        if (count > HIGHLIGHT_SYNC_MAX_BLOCKS) {
+            this->rehighlight();
+            return;
+        }
+    }
+
+    // the snapshot of the worker is not the text anymore
+    if (this->job != nullptr || this->result != nullptr) {
+        this->cancel();
+        this->restartTimer->start();
     }
-    setFormat(start, size, functionCallFormat);
 }
 
-void SyntaxHighlighter::highlightBlock(const QString &text) {
-    QString wordBuffer = "";
-    QString quoteBuffer = "";
-    QChar charBeforeWord = '0';
-    QChar isInQuote = '0';
-    QChar pc = '0';
-    int quoteStart = 0;
-    int wordStart = 0;
-
-    for (int i = 0; i < text.size(); i++) {
-        if (i > 0) { pc = text[i-1]; }
-        QChar c = text[i];
-
-        // entering comment
-        if ((c == '/' && pc == '/') || (c == ' ' && pc == '#')) {
-            QString comment = text.right(text.size());
-            processComment(comment, i-1);
-            wordBuffer.clear();
-            break;
-        }
+// background highlighting
+// ----------------------
 
-        // leaving a quoted text
-        if (isInQuote != '0') {
-            if (c == isInQuote && pc != '\\') {
-                processQuote(quoteBuffer, quoteStart);
-                isInQuote = '0';
-                wordStart = i+1;
-                quoteBuffer.clear();
-                wordBuffer.clear();
-                continue;
-            }
-
-            quoteBuffer += c;
-        }
+void SyntaxHighlighter::cancel() {
+    if (this->job != nullptr) {
+        this->job->cancelled = true;
+        this->job = nullptr;
+    }
+    this->result = nullptr;
+    this->applied.clear();
+    this->remaining = 0;
+    this->sliceTimer->stop();
+    this->restartTimer->stop();
+}
 
-        // we are entering a quoted text, store which char has been used to open it
-        if (isInQuote == '0' && pc != '\\' && (c == '\"' || c == '\'' || c == '`')) {
-            quoteStart = i+1;
-            isInQuote = c;
-            quoteBuffer.clear();
-            continue;
+void SyntaxHighlighter::rehighlight() {
+    this->cancel();
+
+    if (this->document->blockCount() <= HIGHLIGHT_SYNC_MAX_BLOCKS) {
+        for (QTextBlock block = this->document->firstBlock(); block.isValid(); block = block.next()) {
+            this->highlightBlock(block);
         }
+        return;
+    }
 
-        if (isInQuote == '0' && // only when not in a quote
-            (c == '(' || c == ')' || c == '{' || c == '}' || c == '[' || c == ']')) {
-            setFormat(i, 1, this->specialCharsFormat);
+    this->highlightViewport();
+
+    Buffer* buffer = this->editor->getBuffer();
+    std::shared_ptr<HighlightJob> job = std::make_shared<HighlightJob>(
+        buffer->snapshot(), this->lexer, this->rules, buffer->getRevision());
+    this->job = job;
+    this->pool.start([this, job]() {
+        SyntaxHighlighter::work(job);
+        if (!job->cancelled) {
+            QMetaObject::invokeMethod(this, [this, job]() { this->onWorkDone(job); }, Qt::QueuedConnection);
         }
+    });
+}
 
-        // end of word
-        if (c.isSpace() || (c.isPunct() && c != '_') || i == text.size()-1) {
-            if (wordBuffer.size() > 0) {
-                bool endOfLine = (i == text.size()-1);
-                if (c == '(' || charBeforeWord == '.') {
-                    processFunctionCall(wordBuffer, wordStart, endOfLine);
-                } else {
-                    if (!(c.isSpace() || (c.isPunct() && c != '_'))) {
-                        wordBuffer.append(c);
-                        break;
-                    }
-                    processWord(wordBuffer, wordStart, endOfLine, false);
-                }
-            }
-            wordBuffer.clear();
-            wordStart = i+1;
-            charBeforeWord = c;
-            continue;
+void SyntaxHighlighter::work(std::shared_ptr<HighlightJob> job) {
+    const QStringList lines = job->text.toString().split('\n');
+    QVector<LexerToken> tokens;
+    int state = LexerStateDefault;
+
+    job->offsets.reserve(lines.size() + 1);
+    job->states.reserve(lines.size());
+    for (int i = 0; i < lines.size(); i++) {
+        if ((i & 1023) == 0 && job->cancelled) {
+            return;
         }
+        job->offsets.append(job->runs.size());
+        state = SyntaxHighlighter::lexLine(job->lexer, job->rules, lines.at(i), state, &tokens, &job->runs);
+        job->states.append(state);
+    }
+    job->offsets.append(job->runs.size());
+}
 
-        wordBuffer.append(c);
+void SyntaxHighlighter::onWorkDone(std::shared_ptr<HighlightJob> job) {
+    if (job != this->job) {
+        // cancelled in the meantime
+        return;
     }
+    this->job = nullptr;
 
-    // end of line
-    if (wordBuffer.size() > 0) {
-        processWord(wordBuffer, wordStart, true, isInQuote != '0');
-        wordBuffer.clear();
+    if (job->revision != this->editor->getBuffer()->getRevision()) {
+        this->restartTimer->start();
+        return;
     }
 
-    processLine(text);
+    this->result = job;
+    this->remaining = job->lineCount();
+    this->applied = QBitArray(this->remaining);
+    this->viewportFirst = -1;
+    this->sliceTimer->start();
+}
 
-    quoteBuffer = '0';
-    wordBuffer.clear();
-    quoteBuffer.clear();
-    wordStart = 0;
+void SyntaxHighlighter::onScroll() {
+    if (this->result != nullptr) {
+        // apply right away what has become visible
+        this->onSlice();
+    } else if (this->job != nullptr) {
+        this->highlightViewport();
+    }
 }
 
-bool SyntaxHighlighter::setSelection(const QString& text) {
-    if (this->selection == text) {
-        return false;
+void SyntaxHighlighter::onSlice() {
+    if (this->result == nullptr) {
+        this->sliceTimer->stop();
+        return;
     }
 
-    if (this->selection != text && text.size() > 0) {
-        this->selectionRx = QRegularExpression("(" + text + ")");
+    QElapsedTimer timer;
+    timer.start();
+
+    // the lines are applied from the first visible one, going back to the
+    // new visible lines every time the user jumps elsewhere.
+    int first = 0, last = 0;
+    this->editor->visibleBlocks(&first, &last);
+    if (first != this->viewportFirst) {
+        this->viewportFirst = first;
+        this->nextLine = first;
     }
-    this->selection = text;
 
-    return true;
+    const int lineCount = this->result->lineCount();
+    const HighlightRun* runs = this->result->runs.constData();
+    const QVector<int>& offsets = this->result->offsets;
+
+    QTextBlock block = this->document->findBlockByNumber(this->nextLine);
+    for (int visited = 0; this->remaining > 0 && visited < lineCount; visited++) {
+        if (!block.isValid()) {
+            block = this->document->firstBlock();
+        }
+        int line = block.blockNumber();
+        if (line < lineCount && !this->applied.testBit(line)) {
+            this->applyRuns(block, runs + offsets.at(line), offsets.at(line + 1) - offsets.at(line));
+            block.setUserState(this->result->states.at(line));
+            this->applied.setBit(line);
+            this->remaining--;
+        }
+        block = block.next();
+
+        if ((visited & 63) == 63 && timer.elapsed() >= HIGHLIGHT_SLICE_MS) {
+            break;
+        }
+    }
+    this->nextLine = block.isValid() ? block.blockNumber() : 0;
+
+    if (this->remaining == 0) {
+        this->cancel();
+    }
 }
 
+// rules
+// ----------------------
+
 bool SyntaxHighlighter::setSearchText(const QString& text) {
     if (this->searchText == text) {
         return false;
     }
-    if (text.size() > 0) {
-        this->searchTextRx = QRegularExpression("(" + text + ")");
-    }
+    this->rules.searchText = text.size() > 0 ? QRegularExpression("(" + text + ")") : QRegularExpression();
     this->searchText = text;
     return true;
 }
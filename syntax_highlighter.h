@@ -1,20 +1,31 @@
 #pragma once
 
+#include <QBitArray>
+#include <QObject>
 #include <QRegularExpression>
 #include <QString>
-#include <QSyntaxHighlighter>
 #include <QTextBlock>
 #include <QTextCharFormat>
 #include <QTextDocument>
+#include <QTextLayout>
+#include <QThreadPool>
+#include <QTimer>
 #include <QVector>
 
-class Editor;
+#include <memory>
 
-struct SyntaxRule
-{
-    QString word;
-    QTextCharFormat format;
-};
+#include "lexer.h"
+
+// documents with up to this many blocks are entirely highlighted at once.
+#define HIGHLIGHT_SYNC_MAX_BLOCKS 500
+// time spent at most applying the formats of the worker per event loop
+// iteration.
+#define HIGHLIGHT_SLICE_MS 8
+// delay before highlighting again the whole document after an edit made
+// while it was being highlighted.
+#define HIGHLIGHT_RESTART_DELAY_MS 250
+
+class Editor;
 
 struct PluginRule
 {
@@ -22,54 +33,139 @@ struct PluginRule
     QTextCharFormat format;
 };
 
-class SyntaxHighlighter : public QSyntaxHighlighter
+// HighlightFormat are the formats of the runs, the values of LexerTokenType
+// being used for the tokens of the lexer.
+enum HighlightFormat {
+    HighlightSearchText = LexerSpecialChar + 1,
+    HighlightWhitespaceEol,
+    // the plugin rule i is using HighlightPluginRule + i
+    HighlightPluginRule,
+};
+
+// HighlightRun is a run of chars of a line to format.
+typedef struct HighlightRun {
+    int start;
+    int length;
+    int format;
+} HighlightRun;
+
+// HighlightRules are the regular expressions applied after the lexer, they
+// are copied for the worker.
+typedef struct HighlightRules {
+    QVector<QRegularExpression> plugins;
+    QRegularExpression searchText;
+    QRegularExpression whitespaceEol;
+} HighlightRules;
+
+struct HighlightJob;
+
+// SyntaxHighlighter formats the blocks of the document of an editor.
+//
+// Edits are highlighted right away, but highlighting the whole document
+// (when it is opened or when the searched text changes) is
+// done in the background: the visible blocks are highlighted first, then a
+// worker lexes a snapshot of the buffer and its formats are applied back by
+// small slices of time, starting with what is visible. Jumping elsewhere in
+// the document moves what is left to apply to the new visible blocks.
+class SyntaxHighlighter : public QObject
 {
     Q_OBJECT
 
 public:
-    SyntaxHighlighter(Editor *editor, QTextDocument *parent = 0);
-    bool setSelection(const QString& text);
+    SyntaxHighlighter(Editor* editor, QTextDocument* document);
+    ~SyntaxHighlighter();
+
     bool setSearchText(const QString& text);
 
+    // rehighlight highlights the whole document again.
+    void rehighlight();
+
     static QColor getMainColor();
 
-protected:
-    void highlightBlock(const QString &text) override;
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void onScroll();
+    void onSlice();
 
 private:
     Editor* editor;
+    QTextDocument* document;
     QString filename;
 
-    QVector<SyntaxRule> simpleWordEqualityRules;
-    QVector<PluginRule> pluginRules;
+    Lexer lexer;
+    HighlightRules rules;
+
+    // tokens and runs are reused from one line to another to avoid allocations.
+    QVector<LexerToken> tokens;
+    QVector<HighlightRun> runs;
+
+    // the worker lexing the whole document, and the result of the last one
+    // being applied.
+    QThreadPool pool;
+    std::shared_ptr<HighlightJob> job;
+    std::shared_ptr<HighlightJob> result;
+    // lines of the result already applied, and how many are left.
+    QBitArray applied;
+    int remaining;
+    // next line of the result to apply, and first visible block when it has
+    // been chosen.
+    int nextLine;
+    int viewportFirst;
 
-    QString selection;
-    QRegularExpression selectionRx;
-    QTextCharFormat selectionFormat;
+    QTimer* sliceTimer;
+    QTimer* restartTimer;
+
+    // true while formats are applied, the document reports them as changes.
+    bool applying;
+
+    QVector<PluginRule> pluginRules;
 
     QString searchText;
-    QRegularExpression searchTextRx;
     QTextCharFormat searchTextFormat;
 
-    QRegularExpression todoRx;
+    QTextCharFormat keywordFormat;
     QTextCharFormat todoFormat;
-
-    QRegularExpression whitespaceEolRx;
     QTextCharFormat whitespaceEolFormat;
-
     QTextCharFormat commentFormat;
     QTextCharFormat quoteFormat;
     QTextCharFormat functionCallFormat;
     QTextCharFormat specialCharsFormat;
 
-    void setCodeRules();
     QVector<PluginRule> markdownRules();
     QVector<PluginRule> gitRules();
 
-    void processWord(const QString& word, int wordStart, bool endOfLine, bool inQuote);
-    void processLine(const QString& line);
-    void processQuote(const QString& text, int start);
-    void processComment(const QString& text, int start);
-    void processFunctionCall(const QString& text, int start, bool endOfLine);
-    void processRegexp(const QString& text, QRegularExpression rx, QTextCharFormat format);
-};
\ No newline at end of file
+    // formatFor returns the format of the given HighlightFormat.
+    const QTextCharFormat& formatFor(int format) const;
+
+    // lexLine appends to runs the runs of the given line, state being the
+    // state of the lexer at the end of the previous line. Returns the state
+    // at the end of this line. It is used by the worker as well.
+    static int lexLine(const Lexer& lexer, const HighlightRules& rules, const QString& line, int state,
+                       QVector<LexerToken>* tokens, QVector<HighlightRun>* runs);
+    static void processRegexp(const QString& text, const QRegularExpression& rx, int format,
+                              QVector<HighlightRun>* runs);
+
+    // work lexes all the lines of the snapshot of the job. It runs on a
+    // worker thread.
+    static void work(std::shared_ptr<HighlightJob> job);
+    void onWorkDone(std::shared_ptr<HighlightJob> job);
+
+    // cancel stops the worker and drops what is left to apply.
+    void cancel();
+
+    // highlightBlock lexes and formats the given block. The state of the
+    // lexer at the end of a block is stored as its user state, the way
+    // QSyntaxHighlighter is doing with setCurrentBlockState.
+    // Returns true if the state has changed.
+    bool highlightBlock(QTextBlock block);
+
+    // highlightViewport lexes and formats the visible blocks.
+    void highlightViewport();
+
+    // applyRuns sets the formats of the given block.
+    void applyRuns(const QTextBlock& block, const HighlightRun* runs, int count);
+
+    // previousBlockState returns the state of the lexer at the end of the
+    // block before the given one.
+    static int previousBlockState(const QTextBlock& block);
+};
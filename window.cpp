@@ -1,23 +1,29 @@
 #include <QApplication>
+#include <QDateTime>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QLocalSocket>
-#include <QJsonArray>
-#include <QJsonObject>
+#include <QSet>
 #include <QSettings>
 #include <QString>
 #include <QThread>
 #include <QMessageBox>
 
+#include <algorithm>
+#include <climits>
+
 #include "command.h"
 #include "completer.h"
 #include "editor.h"
 #include "exec.h"
 #include "fileslookup.h"
 #include "git.h"
+#include "git_repository.h"
 #include "grep.h"
 #include "info_popup.h"
 #include "replace.h"
+#include "save_pipeline.h"
 #include "statusbar.h"
 #include "window.h"
 
@@ -27,6 +33,15 @@ Window::Window(QApplication* app, QString instanceSocket, QWidget* parent) :
     QWidget(parent),
     projectSettings(nullptr),
     commandServer(this) {
+    // session, read once for the whole run
+    // ----------------------
+    this->session = new SessionStore(SessionStore::defaultFilename());
+    this->session->load();
+
+    // files index, (re)built every time the base dir changes
+    // ----------------------
+    this->filesIndex = new FilesIndex(this);
+
     // widgets
     // ----------------------
     this->command = new Command(this);
@@ -72,8 +87,30 @@ Window::Window(QApplication* app, QString instanceSocket, QWidget* parent) :
     // prepare the lsp manager
     // ----------------------
 
+    this->fileContents = new FileContentService();
     this->lspManager = new LSPManager(this);
 
+    // save pipeline
+    // ----------------------
+
+    this->savePipeline = new SavePipeline(this);
+
+    // prefetch of the lazy tabs
+    // ----------------------
+
+    this->prefetchTimer = new QTimer(this);
+    this->prefetchTimer->setSingleShot(true);
+    this->prefetchTimer->setInterval(WINDOW_PREFETCH_DELAY_MS);
+    connect(this->prefetchTimer, &QTimer::timeout, this, &Window::onPrefetch);
+
+    // hibernation of the tabs
+    // ----------------------
+
+    this->hibernateTimer = new QTimer(this);
+    this->hibernateTimer->setInterval(WINDOW_HIBERNATE_CHECK_MS);
+    connect(this->hibernateTimer, &QTimer::timeout, this, &Window::onHibernate);
+    this->hibernateTimer->start();
+
     // layout
     // ----------------------
 
@@ -160,10 +197,30 @@ Window::~Window() {
     }
 
     commandServer.close();
+    // wait for the files being written
+    delete this->savePipeline;
     delete this->tabs;
+    // after the editors, they store their positions when closed
+    delete this->session;
     delete this->grep;
     delete this->exec;
+    // the lsp servers are reading the files until they are stopped
     delete this->lspManager;
+    delete this->fileContents;
+    // stop the git processes
+    qDeleteAll(this->gitRepositories);
+    this->gitRepositories.clear();
+}
+
+GitRepository* Window::getGitRepository(const QString& filename) {
+    const QString root = GitRepository::findRoot(filename);
+    if (root.isEmpty()) {
+        return nullptr;
+    }
+    if (!this->gitRepositories.contains(root)) {
+        this->gitRepositories[root] = new GitRepository(root, this);
+    }
+    return this->gitRepositories[root];
 }
 
 void Window::onNewSocketCommand() {
@@ -343,6 +400,7 @@ void Window::setBaseDir(const QString& dir) {
     if (!this->baseDir.endsWith("/")) {
         this->baseDir += "/";
     }
+    this->filesIndex->setRoot(this->baseDir);
 }
 
 void Window::resizeEvent(QResizeEvent* event) {
@@ -374,14 +432,33 @@ void Window::openProject(QString filename) {
 
     QStringList sl = settings->value("files").toStringList();
 
+    // start the LSP servers while the files are opened, either the ones
+    // of the configured languages or the ones of the files.
+    QStringList languages = settings->value("languages").toStringList();
+    if (!settings->contains("languages")) {
+        for (const QString& file : sl) {
+            const QString& suffix = QFileInfo(file).suffix();
+            if (!suffix.isEmpty() && !languages.contains(suffix)) {
+                languages.append(suffix);
+            }
+        }
+    }
+    this->lspManager->prewarm(languages);
+
+    QElapsedTimer timer;
+    timer.start();
+
     // first, open the project file
     Editor* projectEditor = this->newEditor(projectFi.canonicalFilePath(), filename);
 
-    // open files if any has been configured
+    // open files if any has been configured, they are read when their tab
+    // is shown for the first time.
+    int count = 0;
     for (QString filename : sl) {
         QFileInfo fi(filename);
         if (fi.exists()) {
-            this->newEditor(fi.canonicalFilePath(), filename);
+            this->newEditor(fi.canonicalFilePath(), filename, true);
+            count++;
         }
     }
 
@@ -389,6 +466,9 @@ void Window::openProject(QString filename) {
 
     // focus on the project file
     this->setCurrentEditor(projectEditor->getId());
+
+    const QString message = QString("Project opened in %1ms (%2 files).").arg(timer.elapsed()).arg(count);
+    this->statusBar->setMessage(message);
 }
 
 // buffers
@@ -411,7 +491,7 @@ Editor* Window::newEditor(QString name, QByteArray content) {
     return editor;
 }
 
-Editor* Window::newEditor(QString name, QString filename) {
+Editor* Window::newEditor(QString name, QString filename, bool lazy) {
     QFileInfo fi(filename);
     if (fi.isDir()) {
         this->setBaseDir(fi.canonicalFilePath());
@@ -422,7 +502,11 @@ Editor* Window::newEditor(QString name, QString filename) {
     // we want to create a new Editor with this buffer.
     Editor* editor = new Editor(this);
     Buffer* buffer = new Buffer(editor, name, filename);
-    editor->setBuffer(buffer);
+    if (lazy) {
+        editor->setLazyBuffer(buffer);
+    } else {
+        editor->setBuffer(buffer);
+    }
 
     QString label;
     QString dirName = fi.dir().dirName();
@@ -435,7 +519,7 @@ Editor* Window::newEditor(QString name, QString filename) {
     label = QString("  ") + label;
 
     int tabIdx = this->tabs->addTab(editor, label);
-    if (this->getEditor() != nullptr && this->getEditor()->getId() != editor->getId()) {
+    if (!lazy && this->getEditor() != nullptr && this->getEditor()->getId() != editor->getId()) {
         this->setCurrentEditor(editor->getId());
     }
     return editor;
@@ -447,17 +531,37 @@ void Window::save() {
 }
 
 void Window::saveAll() {
-    // save other buffers
     for (Editor* editor : this->getEditors()) {
-        editor->save();
+        if (editor->getBuffer()->modified) {
+            editor->save();
+        }
     }
 }
 
+void Window::quitWhenSaved() {
+    if (this->savePipeline->isIdle()) {
+        QCoreApplication::quit();
+        return;
+    }
+
+    QMetaObject::Connection* connection = new QMetaObject::Connection;
+    *connection = connect(this->savePipeline, &SavePipeline::drained, this, [this, connection]() {
+        disconnect(*connection);
+        delete connection;
+        // some saves may have failed
+        if (this->modifiedBuffersIds().size() > 0) {
+            this->getStatusBar()->setMessage("Some buffers have not been saved, not quitting.");
+            return;
+        }
+        QCoreApplication::quit();
+    });
+}
+
 QStringList Window::modifiedBuffersIds() {
     QStringList rv;
 
     for (Editor* editor : this->getEditors()) {
-        if (editor->getBuffer()->modified) {
+        if (editor->getBuffer()->modified && !this->savePipeline->isSaving(editor->getId())) {
             rv << editor->getId();
         }
     }
@@ -556,6 +660,11 @@ Editor* Window::setCurrentEditor(QString id) {
     if (tabIndex >= 0) {
         this->tabs->setCurrentIndex(tabIndex);
         Editor* editor = this->getEditor();
+        editor->materialize();
+        editor->markShown();
+        if (WINDOW_PREFETCH_TABS > 0) {
+            this->prefetchTimer->start();
+        }
         this->setWindowTitle(QString("meh - ") + this->tabs->tabText(this->tabs->currentIndex()).trimmed());
         this->statusBar->setEditor(editor);
         editor->update();
@@ -575,6 +684,55 @@ Editor* Window::setCurrentEditor(QString id) {
     return this->newEditor(id, id);
 }
 
+void Window::onPrefetch() {
+    // the next tabs are the most likely to be shown next
+    int current = this->tabs->currentIndex();
+    if (current < 0) {
+        return;
+    }
+    for (int i = 1; i <= WINDOW_PREFETCH_TABS && current + i < this->tabs->count(); i++) {
+        Editor* editor = this->getEditor(current + i);
+        if (editor != nullptr && !editor->isMaterialized()) {
+            // one at a time, not to block the UI for too long
+            editor->materialize();
+            this->prefetchTimer->start();
+            return;
+        }
+    }
+}
+
+void Window::onHibernate() {
+    Editor* current = this->getEditor();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    // the tabs not used for a while
+    QList<Editor*> editors;
+    qint64 size = 0;
+    for (Editor* editor : this->getEditors()) {
+        if (!editor->isMaterialized()) {
+            continue;
+        }
+        if (editor != current && now - editor->getLastShown() > WINDOW_HIBERNATE_IDLE_MS && editor->hibernate()) {
+            continue;
+        }
+        size += editor->document()->characterCount();
+        if (editor != current) {
+            editors.append(editor);
+        }
+    }
+
+    // then the least recently shown ones while over the budget
+    std::sort(editors.begin(), editors.end(), [](Editor* a, Editor* b) {
+        return a->getLastShown() < b->getLastShown();
+    });
+    for (int i = 0; i < editors.size() && size > WINDOW_HIBERNATE_BUDGET; i++) {
+        const int characters = editors[i]->document()->characterCount();
+        if (editors[i]->hibernate()) {
+            size -= characters;
+        }
+    }
+}
+
 void Window::closeCurrentEditor() {
     Editor* editor = this->getEditor();
     if (editor == nullptr) {
@@ -682,106 +840,44 @@ bool Window::lastCheckpoint() {
 // -------------
 
 void Window::showLSPDiagnostics(const QString& buffId) {
-    auto allDiags = this->getLSPManager()->getDiagnostics(buffId);
-
-    // get all the keys, and sort them in order to display them in a proper order.
-    QList<int> lines = allDiags.keys();
-    std::sort(lines.begin(), lines.end());
-
-    for (int j = 0; j < lines.size(); j++) {
-        auto lineDiags = allDiags[lines[j]];
-        for (int i = 0; i < lineDiags.size(); i++) {
-            auto diag = lineDiags[i];
-            if (diag.message.size() > 0) {
-                QFileInfo fi = QFileInfo(diag.absFilename);
-                QString message = fi.fileName() + ":" + QString::number(diag.line) + " " + diag.message;
-                this->getStatusBar()->setMessage(message);
-            }
-        }
-    }
+    this->showLSPDiagnosticsOfLines(buffId, 1, INT_MAX);
 }
 
 void Window::showLSPDiagnosticsOfLine(const QString& buffId, int line) {
-    auto allDiags = this->getLSPManager()->getDiagnostics(buffId);
-    auto lineDiags = allDiags[line];
-    if (lineDiags.size() == 0) {
-        return;
-    }
+    this->showLSPDiagnosticsOfLines(buffId, line, line);
+}
 
-    for (int i = 0; i < lineDiags.size(); i++) {
-        auto diag = lineDiags[i];
-        if (diag.message.size() > 0) {
-            QFileInfo fi = QFileInfo(diag.absFilename);
-            QString message = fi.fileName() + ":" + QString::number(diag.line) + " " + diag.message;
-            this->getStatusBar()->setMessage(message);
+void Window::showLSPDiagnosticsOfLines(const QString& buffId, int first, int last) {
+    const DiagnosticsStore& store = this->getLSPManager()->getDiagnostics();
+    const QString fileName = QFileInfo(buffId).fileName();
+    for (const Diagnostic& diag : store.range(buffId, first, last)) {
+        const QString& message = store.message(diag);
+        if (message.size() > 0) {
+            this->getStatusBar()->setMessage(fileName + ":" + QString::number(diag.line) + " " + message);
         }
     }
 }
 
-void Window::lspInterpretMessages(const QByteArray& data) {
-    QList<QJsonDocument> list = LSPReader::readMessage(data);
-    if (list.size() == 0) {
-        return;
-    }
-
-    for (int i = 0; i < list.size(); i++) {
-        this->lspInterpret(list[i]);
+void Window::lspInterpretResults(const QList<LSPResult>& results) {
+    for (int i = 0; i < results.size(); i++) {
+        this->lspInterpret(results[i]);
     }
 }
 
-
-void Window::lspInterpret(QJsonDocument json) {
-    if (json.isNull() || json.isEmpty()) {
-        return;
-    }
-
-    LSPAction action = this->lspManager->getExecutedAction(json["id"].toInt());
+void Window::lspInterpret(const LSPResult& result) {
+    LSPAction action = this->lspManager->getExecutedAction(result.requestId);
     if (action.requestId == 0) {
-        if (json["method"].isNull()) {
-            return;
-        }
         // showMessage
         // -----------
-        if (json["method"].toString() == "window/showMessage") {
-            if (!json["params"].isNull()) {
-                const QString& msg = json["params"]["message"].toString();
-                if (msg.size() > 0) {
-                    this->getStatusBar()->setMessage(msg);
-                }
+        if (result.method == "window/showMessage") {
+            if (result.text.size() > 0) {
+                this->getStatusBar()->setMessage(result.text);
             }
         // publishDiagnostics
         // ------------------
-        } else if (json["method"] == "textDocument/publishDiagnostics") {
-            if (!json["params"].isNull() && !json["params"]["diagnostics"].isNull()) {
-                if (!json["params"]["diagnostics"].isArray()) {
-                    qWarning() << "lspInterpret: \"diagnostics\" is not an array";
-                    return;
-                }
-                if (json["params"]["uri"].isNull()) {
-                    qWarning() << "lspInterpret: no \"uri\" field in diagnostic";
-                    return;
-                }
-
-                auto diags = json["params"]["diagnostics"].toArray();
-                const QString& uri = QFileInfo(json["params"]["uri"].toString().replace("file://", "")).canonicalFilePath();
-
-                this->lspManager->clearDiagnostics(uri);
-
-                for (int i = 0; i < diags.size(); i++) {
-                    QJsonObject diag = diags[i].toObject();
-                    const QString& msg = diag["message"].toString();
-                    if (!diag["range"].isNull() && !diag["range"].toObject()["start"].isNull()
-                            && !diag["range"].toObject()["start"].toObject()["line"].isNull()) {
-                        int line = diag["range"].toObject()["start"].toObject()["line"].toInt();
-                        LSPDiagnostic diag;
-                        diag.line = line + 1;
-                        diag.message = msg;
-                        diag.absFilename = uri;
-                        this->lspManager->addDiagnostic(uri, diag);
-                    }
-                }
-                this->repaint();
-            }
+        } else if (result.method == "textDocument/publishDiagnostics") {
+            this->lspManager->getDiagnostics().set(result.file, result.diagnostics);
+            this->repaint();
         }
         return;
     }
@@ -790,59 +886,41 @@ void Window::lspInterpret(QJsonDocument json) {
         case LSP_ACTION_DECLARATION:
         case LSP_ACTION_DEFINITION:
             {
-                // TODO(remy): deal with multiple results
-                int line = json["result"][0]["range"]["start"]["line"].toInt();
-                int column = json["result"][0]["range"]["start"]["character"].toInt();
-                QString file = json["result"][0]["uri"].toString();
-                if (file.isEmpty()) {
+                if (result.file.isEmpty()) {
                     this->getStatusBar()->setMessage("Nothing found.");
                     return;
                 }
-                file.remove(0,7); // remove the file://
                 this->saveCheckpoint();
-                this->setCurrentEditor(file);
-                this->getEditor()->goToLine(line + 1);
-                this->getEditor()->goToColumn(column);
+                this->setCurrentEditor(result.file);
+                this->getEditor()->goToLine(result.line);
+                this->getEditor()->goToColumn(result.column);
                 return;
             }
         case LSP_ACTION_COMPLETION:
             {
-                if (json["result"].isNull()) {
-                    this->getStatusBar()->setMessage("Nothing found.");
-                    return;
-                }
-
                 if (action.buffer->getId() != this->getEditor()->getId()) {
                     qDebug() << "debug: received an lsp response for another editor than the current one";
                     return;
                 }
 
-                LSP* lsp = this->lspManager->getLSP(this->getEditor()->getId()) ;
-                if (lsp == nullptr) {
-                    this->getStatusBar()->setMessage("Nothing found.");
-                    return;
-                }
-
-                auto entries = lsp->getEntries(json);
-                if (entries.size() == 0) {
+                if (result.entries.size() == 0) {
                     this->getStatusBar()->setMessage("Nothing found.");
                     return;
                 }
 
                 const QString& base = this->getEditor()->getWordUnderCursor();
-                this->openCompleter(base, entries);
+                this->openCompleter(base, result.entries);
                 return;
             }
         case LSP_ACTION_HOVER:
         case LSP_ACTION_HOVER_MOUSE:
             {
-                if (json["result"].isNull() || json["result"]["contents"].isNull()) {
+                if (result.text.isEmpty()) {
                     this->getInfoPopup()->setMessage("Nothing found.");
                     return;
                 }
 
-                auto contents = json["result"]["contents"].toObject();
-                this->getInfoPopup()->setMessage(contents["value"].toString());
+                this->getInfoPopup()->setMessage(result.text);
                 if (action.action == LSP_ACTION_HOVER_MOUSE) {
                     this->getInfoPopup()->moveNearMouse();
                 }
@@ -850,18 +928,11 @@ void Window::lspInterpret(QJsonDocument json) {
             }
         case LSP_ACTION_SIGNATURE_HELP:
             {
-                if (!json["result"].isNull() && !json["result"]["signatures"].isNull() && json["result"]["signatures"].toArray().size() > 0) {
-                    QString message;
-                    QJsonArray signatures = json["result"]["signatures"].toArray();
-                    for (int i = 0; i < signatures.size(); i++) {
-                        QJsonValue signature = signatures[i];
-                        message.append(signature["label"].toString()).append("\n");
-                        message.append(signature["documentation"].toString());
-                    }
-                    this->getInfoPopup()->setMessage(message);
+                if (result.text.isEmpty()) {
+                    this->getInfoPopup()->setMessage("Nothing found.");
                     return;
                 }
-                this->getInfoPopup()->setMessage("Nothing found.");
+                this->getInfoPopup()->setMessage(result.text);
                 return;
             }
         case LSP_ACTION_REFERENCES:
@@ -869,18 +940,21 @@ void Window::lspInterpret(QJsonDocument json) {
                 // TODO(remy): error management
                 this->getRefWidget()->clear();
                 this->getRefWidget()->hide();
-                QJsonArray list = json["result"].toArray();
-                for (int i = 0; i < list.size(); i++) {
-                    QJsonObject entry = list[i].toObject();
-                    int line = entry["range"].toObject()["start"].toObject()["line"].toInt();
-                    line += 1;
-                    QString file = entry["uri"].toString();
-                    if (file.startsWith("file://")) {
-                        file = file.remove(0, 7);
+                // the files opened may have been modified since they have been saved
+                QVector<FileLine> references = result.references;
+                QSet<QString> files;
+                for (const FileLine& reference : references) {
+                    files.insert(reference.file);
+                }
+                for (const QString& file : files) {
+                    Editor* editor = this->getEditor(file);
+                    if (editor != nullptr && editor->isMaterialized() && !editor->getBuffer()->isHuge()) {
+                        FileContentService::resolveFromDocument(file, editor->document(), &references);
                     }
-
-                    const QString targetLine = this->getEditor()->getOneLine(file, line);
-                    this->getRefWidget()->insert(file, QString::number(line), targetLine);
+                }
+                for (int i = 0; i < references.size(); i++) {
+                    const FileLine& reference = references[i];
+                    this->getRefWidget()->insert(reference.file, QString::number(reference.line), reference.text);
                 }
                 this->getRefWidget()->fitContent();
                 this->getRefWidget()->show();
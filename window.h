@@ -6,16 +6,36 @@
 #include <QLineEdit>
 #include <QListWidget>
 #include <QLocalServer>
+#include <QMap>
 #include <QPaintEvent>
 #include <QResizeEvent>
 #include <QSettings>
 #include <QString>
 #include <QTabWidget>
+#include <QTimer>
 #include <QWidget>
 
 #include "editor.h"
+#include "file_content_service.h"
+#include "files_index.h"
 #include "lsp.h"
+#include "lsp_connection.h"
 #include "lsp_manager.h"
+#include "session_store.h"
+
+// amount of tabs after the current one materialized in the background, 0
+// to disable the prefetch.
+#define WINDOW_PREFETCH_TABS 1
+// delay after a tab has been shown before prefetching the next ones.
+#define WINDOW_PREFETCH_DELAY_MS 500
+
+// the tabs not shown for this long are hibernated, see Editor::hibernate.
+#define WINDOW_HIBERNATE_IDLE_MS (15 * 60 * 1000)
+// characters in the documents of the tabs past which the least recently
+// shown tabs are hibernated.
+#define WINDOW_HIBERNATE_BUDGET (32 * 1024 * 1024)
+// interval between two checks of the tabs to hibernate.
+#define WINDOW_HIBERNATE_CHECK_MS (60 * 1000)
 
 class Command;
 class Completer;
@@ -23,10 +43,12 @@ class CompleterEntry;
 class Editor;
 class Exec;
 class Git;
+class GitRepository;
 class Grep;
 class InfoPopup;
 class ReferencesWidget;
 class ReplaceWidget;
+class SavePipeline;
 class StatusBar;
 
 class Checkpoint {
@@ -80,6 +102,9 @@ public:
 
     FilesLookup* getFilesLookup() const { return this->filesLookup; }
 
+    // getFilesIndex returns the index of all the files of the base dir.
+    FilesIndex* getFilesIndex() const { return this->filesIndex; }
+
     // setBaseDir sets the base dir on which the FilesLookup
     // should be opened.
     void setBaseDir(const QString& dir);
@@ -111,6 +136,10 @@ public:
 
     QSettings* getProjectSettings() { return this->projectSettings; }
 
+    // getSessionStore returns the store of the state kept between the runs,
+    // e.g. the position in the files or the commands history.
+    SessionStore* getSessionStore() { return this->session; }
+
     // buffers manipulation
     // --------------------
 
@@ -119,7 +148,9 @@ public:
     // The editor instance returned is managed by the Window.
     Editor* newEditor(QString name, QByteArray content);
 
-    Editor* newEditor(QString name, QString filename);
+    // If lazy, the file is only read once the tab of the editor is shown,
+    // see Editor::setLazyBuffer, and the editor is not made the current one.
+    Editor* newEditor(QString name, QString filename, bool lazy = false);
 
     // getEditor returns the current Editor instance.
     Editor* getEditor();
@@ -156,11 +187,18 @@ public:
     // save saves the buffer in the current editor.
     void save();
 
-    // saveAll saves all the loaded buffers.
+    // saveAll saves all the loaded buffers having been modified.
     void saveAll();
 
-    // modifiedBuffersIds returns true if at least one buffer has a change
-    // which has not been saved.
+    // getSavePipeline returns the SavePipeline saving the buffers in the background.
+    SavePipeline* getSavePipeline() { return this->savePipeline; }
+
+    // quitWhenSaved quits the app as soon as all the saves are done. It doesn't
+    // quit if some buffers are still modified after that.
+    void quitWhenSaved();
+
+    // modifiedBuffersIds returns the ids of the buffers having a change which
+    // has not been saved and which are not being saved.
     QStringList modifiedBuffersIds();
 
     // saveCheckpoint stores the current filename/cursor position information has a checkpoint.
@@ -175,6 +213,17 @@ public:
 
     LSPManager* getLSPManager() { return this->lspManager; }
 
+    // getFileContentService returns the service reading the lines of the
+    // files, e.g. for the references.
+    FileContentService* getFileContentService() { return this->fileContents; }
+
+    // git
+    // -----------
+
+    // getGitRepository returns the repository containing the given file,
+    // nullptr if it is not in a git repository.
+    GitRepository* getGitRepository(const QString& filename);
+
     // showLSPDiagnosticsOfLine shows the diagnostics for the given buffer and
     // the given line (of the current buffer) in the statusbar.
     void showLSPDiagnosticsOfLine(const QString& buffId, int line);
@@ -183,13 +232,16 @@ public:
     // statusbar.
     void showLSPDiagnostics(const QString& buffId);
 
-    // lspInterpretMessages is called when data has been received from the LSP server
-    // and that we need to interpret them. Note that it can interpret several
-    // messages in on call (if the LSP server has sent several messages in one output)
-    void lspInterpretMessages(const QByteArray& data);
+    // showLSPDiagnosticsOfLines shows the diagnostics for the given buffer
+    // starting between the lines first and last included.
+    void showLSPDiagnosticsOfLines(const QString& buffId, int first, int last);
+
+    // lspInterpretResults is called with the messages received from a LSP
+    // server, already interpreted on the thread of its connection.
+    void lspInterpretResults(const QList<LSPResult>& results);
 
-    // lspInterpret is called by the LSP manager to interpret one JSON message.
-    void lspInterpret(QJsonDocument json);
+    // lspInterpret displays one message received from a LSP server.
+    void lspInterpret(const LSPResult& result);
 
 protected:
     void paintEvent(QPaintEvent* event);
@@ -200,6 +252,8 @@ private slots:
     void onCloseTab(int);
     void onChangeTab(int);
     void onNewSocketCommand();
+    void onPrefetch();
+    void onHibernate();
 
 private:
     QApplication* app;
@@ -211,6 +265,7 @@ private:
     QGridLayout* layout;
     Command* command;
     FilesLookup* filesLookup;
+    FilesIndex* filesIndex;
     Grep* grep;
     InfoPopup* infoPopup;
     Completer* completer;
@@ -218,6 +273,7 @@ private:
     StatusBar* statusBar;
     Exec* exec;
     ReplaceWidget* replace;
+    SavePipeline* savePipeline;
 
     // baseDir on which the FilesLookup should be opened.
     QString baseDir;
@@ -234,5 +290,19 @@ private:
     // opened project if any
     QSettings* projectSettings;
 
+    SessionStore* session;
+
+    // prefetchTimer materializes the editors of the tabs next to the current
+    // one, once the current one is shown.
+    QTimer* prefetchTimer;
+
+    // hibernateTimer regularly hibernates the tabs not used for a while.
+    QTimer* hibernateTimer;
+
     LSPManager* lspManager;
+
+    FileContentService* fileContents;
+
+    // git repositories of the opened files, by root.
+    QMap<QString, GitRepository*> gitRepositories;
 };
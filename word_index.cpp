@@ -0,0 +1,52 @@
+#include "word_index.h"
+
+WordIndex::WordIndex() :
+    built(false) {
+}
+
+void WordIndex::build(const QString& text) {
+    this->words.clear();
+    this->built = true;
+    this->add(text);
+}
+
+void WordIndex::clear() {
+    this->words.clear();
+    this->built = false;
+}
+
+void WordIndex::add(QStringView text) {
+    if (!this->built) {
+        // it will be read entirely when needed
+        return;
+    }
+    WordIndex::forEachWord(text, [this](QStringView word) {
+        this->words[word.toString()]++;
+    });
+}
+
+void WordIndex::remove(QStringView text) {
+    if (!this->built) {
+        return;
+    }
+    WordIndex::forEachWord(text, [this](QStringView word) {
+        auto it = this->words.find(word.toString());
+        if (it == this->words.end()) {
+            return;
+        }
+        if (--it.value() <= 0) {
+            this->words.erase(it);
+        }
+    });
+}
+
+void WordIndex::complete(const QString& prefix, QHash<QString, int>* candidates) const {
+    for (auto it = this->words.lowerBound(prefix); it != this->words.constEnd(); ++it) {
+        if (!it.key().startsWith(prefix)) {
+            break;
+        }
+        if (it.key().size() > prefix.size()) {
+            (*candidates)[it.key()] += it.value();
+        }
+    }
+}
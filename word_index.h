@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QStringView>
+
+// words shorter than this are not indexed.
+#define WORD_INDEX_MIN_LENGTH 2
+
+// WordIndex is the set of the words of a text, with how many times each one
+// of them is used in the text. It is sorted to find the words starting
+// with a prefix without going through all of them.
+//
+// It is kept up-to-date by removing the words of the text being replaced
+// and adding the ones of the text replacing it.
+class WordIndex
+{
+public:
+    WordIndex();
+
+    // isBuilt returns true if the words of the whole text have been indexed.
+    bool isBuilt() const { return this->built; }
+
+    // build indexes the words of the whole text.
+    void build(const QString& text);
+
+    // clear removes all the words, the index has to be built again.
+    void clear();
+
+    // add adds the words of the given text.
+    void add(QStringView text);
+
+    // remove removes the words of the given text.
+    void remove(QStringView text);
+
+    // complete adds to candidates the words starting with prefix, longer
+    // than prefix, with their count.
+    void complete(const QString& prefix, QHash<QString, int>* candidates) const;
+
+    // size returns how many different words are in the index.
+    int size() const { return this->words.size(); }
+
+    // forEachWord calls f with every word of the text.
+    template <typename F>
+    static void forEachWord(QStringView text, F f) {
+        const int size = text.size();
+        int i = 0;
+        while (i < size) {
+            if (!WordIndex::isWordChar(text[i])) {
+                i++;
+                continue;
+            }
+            int start = i;
+            while (i < size && WordIndex::isWordChar(text[i])) {
+                i++;
+            }
+            // numbers are not words
+            if (i - start >= WORD_INDEX_MIN_LENGTH && !text[start].isDigit()) {
+                f(text.mid(start, i - start));
+            }
+        }
+    }
+
+    static bool isWordChar(QChar c) {
+        return c.isLetterOrNumber() || c == '_';
+    }
+
+private:
+    QMap<QString, int> words;
+    bool built;
+};